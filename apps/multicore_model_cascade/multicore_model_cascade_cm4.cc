@@ -57,7 +57,9 @@ bool DetectPerson(tflite::MicroInterpreter* interpreter) {
                                     kNumCols,
                                     kNumRows,
                                     /*preserve_ration=*/false,
-                                    tflite::GetTensorData<uint8>(input_tensor)};
+                                    tflite::GetTensorData<uint8>(input_tensor),
+                                    /*white_balance=*/true,
+                                    CameraPrecision::kFixedPoint};
   if (!coralmicro::CameraTask::GetSingleton()->GetFrame({fmt})) {
     printf("Image capture failed\r\n");
     vTaskSuspend(nullptr);
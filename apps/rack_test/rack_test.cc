@@ -239,6 +239,28 @@ extern "C" void app_main(void* param) {
   jsonrpc_export(kMethodGetFrame, GetFrame);
   jsonrpc_export(coralmicro::testlib::kMethodCaptureAudio,
                  coralmicro::testlib::CaptureAudio);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckCameraConversion,
+                 coralmicro::testlib::CheckCameraConversion);
+  jsonrpc_export(coralmicro::testlib::kMethodDecimateAudio,
+                 coralmicro::testlib::DecimateAudio);
+  jsonrpc_export(coralmicro::testlib::kMethodRunTracker,
+                 coralmicro::testlib::RunTracker);
+  jsonrpc_export(coralmicro::testlib::kMethodDetectMotion,
+                 coralmicro::testlib::DetectMotion);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckParameterCache,
+                 coralmicro::testlib::CheckParameterCache);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckPosenetDecoder,
+                 coralmicro::testlib::CheckPosenetDecoder);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckSignConversion,
+                 coralmicro::testlib::CheckSignConversion);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckSampleRing,
+                 coralmicro::testlib::CheckSampleRing);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckAudioWindows,
+                 coralmicro::testlib::CheckAudioWindows);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckAudioConversion,
+                 coralmicro::testlib::CheckAudioConversion);
+  jsonrpc_export(coralmicro::testlib::kMethodCheckNms,
+                 coralmicro::testlib::CheckNms);
   jsonrpc_export(coralmicro::testlib::kMethodCryptoInit,
                  coralmicro::testlib::CryptoInit);
   jsonrpc_export(coralmicro::testlib::kMethodCryptoGetUId,
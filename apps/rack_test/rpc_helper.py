@@ -18,6 +18,7 @@ import copy
 import enum
 import math
 import os
+import struct
 from typing import Any
 
 from PIL import Image
@@ -128,6 +129,266 @@ class CoralMicroRPCHelper(object):
     payload['params'].append({'iterations': iterations})
     return self.send_rpc(payload)
 
+  def decimate_audio(self, frequency_hz, num_samples, chunk_size):
+    """Downsamples a 48 kHz tone to 16 kHz on the device.
+
+    Args:
+      frequency_hz: Frequency of the half-scale input tone.
+      num_samples: Number of 48 kHz input samples.
+      chunk_size: Number of input samples per call to the decimator.
+
+    Returns:
+      A list of the 16 kHz output samples, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'decimate_audio'
+    payload['params'].append({
+        'frequency_hz': frequency_hz,
+        'num_samples': num_samples,
+        'chunk_size': chunk_size,
+    })
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    data = base64.b64decode(result['result']['data'])
+    return list(struct.unpack(f'<{len(data) // 4}f', data))
+
+  def check_camera_conversion(self, raw_resource_name, rotation):
+    """Compares the camera conversions with their references on the device.
+
+    Args:
+      raw_resource_name: Name of an uploaded 324x324 raw Bayer frame, or '' to
+        capture one with the camera.
+      rotation: The rotation to check, in 90-degree steps.
+
+    Returns:
+      A dict with the number of 'cases' checked, 'max_fixed_point_diff' and
+      'max_white_balance_diff', or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_camera_conversion'
+    payload['params'].append({
+        'raw_resource_name': raw_resource_name,
+        'rotation': rotation,
+    })
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']
+
+  def run_tracker(self, kind, resource_name, num_frames, num_detections,
+                  inference_interval):
+    """Runs an object or pose tracker over uploaded detections on the device.
+
+    Args:
+      kind: 'objects' or 'poses'.
+      resource_name: Name of an uploaded resource with the detections of each
+        frame as float32 values.
+      num_frames: Number of frames in the resource.
+      num_detections: Number of detections per frame.
+      inference_interval: Number of frames per tracker update. The tracker
+        predicts the frames in between.
+
+    Returns:
+      A list with the id of the closest track, or 0, for each frame and
+      detection, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'run_tracker'
+    payload['params'].append({
+        'kind': kind,
+        'resource_name': resource_name,
+        'num_frames': num_frames,
+        'num_detections': num_detections,
+        'inference_interval': inference_interval,
+    })
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    data = base64.b64decode(result['result']['track_ids'])
+    return list(struct.unpack(f'<{len(data) // 4}i', data))
+
+  def detect_motion(self, resource_name, num_frames, block_size, threshold,
+                    rotation):
+    """Runs the software motion detector over uploaded raw frames.
+
+    Args:
+      resource_name: Name of an uploaded resource with consecutive 324x324
+        raw Bayer frames.
+      num_frames: Number of frames in the resource.
+      block_size: Side of the detector's blocks, in pixels.
+      threshold: Mean difference per 2x2 cell at which a block changes.
+      rotation: The rotation of the reported boxes, in 90-degree steps.
+
+    Returns:
+      A list with a dict for each frame, with 'changed' and the 'boxes' as
+      (x, y, width, height) tuples, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'detect_motion'
+    payload['params'].append({
+        'resource_name': resource_name,
+        'num_frames': num_frames,
+        'block_size': block_size,
+        'threshold': threshold,
+        'rotation': rotation,
+    })
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    data = base64.b64decode(result['result']['results'])
+    values = struct.unpack(f'<{len(data) // 4}i', data)
+    frame_size = len(values) // num_frames
+    frames = []
+    for frame in range(num_frames):
+      v = values[frame * frame_size:(frame + 1) * frame_size]
+      frames.append({
+          'changed': bool(v[0]),
+          'boxes': [tuple(v[2 + 4 * i:6 + 4 * i]) for i in range(v[1])],
+      })
+    return frames
+
+  def check_parameter_cache(self, capacity_bytes, script):
+    """Runs a script of Edge TPU parameter cache operations on the device.
+
+    Args:
+      capacity_bytes: The size of the cache.
+      script: Space-separated operations: 'A<key>,<token>,<bytes>' acquires,
+        'R<key>' removes, 'I' invalidates, 'N<uploaded>' counts an invoke and
+        'B<bytes>' counts uploaded bytes.
+
+    Returns:
+      A dict with 'acquired', a 'U' or 'C' for each acquire that needs an
+      upload or is cached, and 'used_bytes', 'hits', 'misses', 'evictions'
+      and 'bytes_uploaded', or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_parameter_cache'
+    payload['params'].append({
+        'capacity_bytes': capacity_bytes,
+        'script': script,
+    })
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']
+
+  def check_posenet_decoder(self, model_resource_name, image_resource_name):
+    """Checks the PoseNet decoder against the old one on the device.
+
+    Args:
+      model_resource_name: Name of a previously uploaded PoseNet model with
+        the decoder op.
+      image_resource_name: Name of a previously uploaded raw input for it.
+
+    Returns:
+      A dict with 'poses', the number of poses decoded, 'mask_pixels', the
+      number of pixels in their instance masks, and 'coarse_mask_diffs', the
+      number of mask pixels a coarse_step of 2 gets wrong, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_posenet_decoder'
+    payload['params'].append({
+        'model_resource_name': model_resource_name,
+        'image_resource_name': image_resource_name,
+    })
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']
+
+  def check_sign_conversion(self, max_elements):
+    """Checks the Edge TPU sign conversion against a byte loop on the device.
+
+    Args:
+      max_elements: The largest number of elements to convert, at most 1024.
+
+    Returns:
+      The number of conversions checked, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_sign_conversion'
+    payload['params'].append({'max_elements': max_elements})
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']['cases']
+
+  def check_sample_ring(self, num_samples):
+    """Checks the views of a SampleRing against a ramp on the device.
+
+    Args:
+      num_samples: The number of samples per view, from 1 to 4096.
+
+    Returns:
+      A dict with the ring capacity and the number of views checked, or None
+      on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_sample_ring'
+    payload['params'].append({'num_samples': num_samples})
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']
+
+  def check_audio_windows(self, window_samples, hop_samples, duration_ms):
+    """Checks AudioService window callbacks against the recorded audio.
+
+    Args:
+      window_samples: The number of samples in each window, from 16 to 16000.
+      hop_samples: The number of samples between windows, from 1 to 16000.
+      duration_ms: How long to capture 16 kHz audio, at most 2000 ms.
+
+    Returns:
+      A dict with the number of samples recorded and the number of int32,
+      int16 and float windows, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_audio_windows'
+    payload['params'].append({'window_samples': window_samples,
+                              'hop_samples': hop_samples,
+                              'duration_ms': duration_ms})
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']
+
+  def check_audio_conversion(self, max_samples):
+    """Checks the audio sample conversions against references on the device.
+
+    Args:
+      max_samples: The largest number of samples to convert, at most 1024.
+
+    Returns:
+      The number of conversions checked, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_audio_conversion'
+    payload['params'].append({'max_samples': max_samples})
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']['cases']
+
+  def check_nms(self, count):
+    """Checks every non-maximum suppression method against a reference.
+
+    Args:
+      count: The number of boxes to suppress, at most 1000.
+
+    Returns:
+      A dict with the number of runs checked and the total number of boxes
+      they kept, or None on error.
+    """
+    payload = self.get_new_payload()
+    payload['method'] = 'check_nms'
+    payload['params'].append({'count': count})
+    result = self.send_rpc(payload)
+    if not self.check_result_for_error(result):
+      return None
+    return result['result']
+
   def a71ch_get_random(self, num_bytes):
     """Gets random bytes from the a71ch module."""
     payload = self.get_new_payload()
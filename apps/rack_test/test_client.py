@@ -25,10 +25,35 @@ prototyping, the real test are on google3.
   python3 apps/RackTest/test_client.py --test stress_test
 - ble_tests:
   python3 apps/RackTest/test_client.py --test ble_tests
+- audio_decimator:
+  python3 apps/RackTest/test_client.py --test audio_decimator
+- camera_conversion:
+  python3 apps/RackTest/test_client.py --test camera_conversion [--raw_frame frame.raw]
+- tracker:
+  python3 apps/RackTest/test_client.py --test tracker
+- motion_detector:
+  python3 apps/RackTest/test_client.py --test motion_detector [--raw_frames frames.raw]
+- parameter_cache:
+  python3 apps/RackTest/test_client.py --test parameter_cache
+- posenet_decoder:
+  python3 apps/RackTest/test_client.py --test posenet_decoder
+- sign_conversion:
+  python3 apps/RackTest/test_client.py --test sign_conversion
+- sample_ring:
+  python3 apps/RackTest/test_client.py --test sample_ring
+- audio_windows:
+  python3 apps/RackTest/test_client.py --test audio_windows
+- audio_conversion:
+  python3 apps/RackTest/test_client.py --test audio_conversion
+- nms:
+  python3 apps/RackTest/test_client.py --test nms
 """
 import argparse
 import os
 import json
+import math
+import random
+import struct
 import time
 from rpc_helper import CoralMicroRPCHelper
 from rpc_helper import Antenna
@@ -40,10 +65,16 @@ parser.add_argument('--host', type=str, default='10.10.10.1',
 parser.add_argument('--port', type=int, default=80,
                     help='Port of the Dev Board Micro')
 parser.add_argument('--test', type=str, default='detection',
-                    help='Test to run, currently support ["detection", "classification", "segmentation", "wifi_tests", "stress_test", "crypto_tests", "ble_tests"]')
+                    help='Test to run, currently support ["detection", "classification", "segmentation", "wifi_tests", "stress_test", "crypto_tests", "ble_tests", "audio_decimator", "camera_conversion", "tracker", "motion_detector", "parameter_cache", "posenet_decoder", "sign_conversion", "sample_ring", "audio_windows", "audio_conversion", "nms"]')
 parser.add_argument('--test_image', type=str, default='test_data/cat.bmp')
 parser.add_argument('--model', type=str,
                     default='models/tf2_ssd_mobilenet_v2_coco17_ptq_edgetpu.tflite')
+parser.add_argument('--raw_frame', type=str, default='',
+                    help='A recorded 324x324 raw camera frame, for camera_conversion. '
+                         'Captures one with the camera if omitted.')
+parser.add_argument('--raw_frames', type=str, default='',
+                    help='Recorded consecutive 324x324 raw camera frames, for '
+                         'motion_detector. The detections are printed.')
 args = parser.parse_args()
 
 
@@ -144,6 +175,384 @@ def run_ble_test(url):
   print(json.dumps(rpc_helper.ble_scan(), indent=2))
 
 
+def run_audio_decimator_test(url):
+  """Checks the 48 kHz to 16 kHz decimator against an ideal resampler.
+
+  Tones up to 7 kHz must pass within 0.01 dB and tones from 8.5 kHz must be
+  at least 60 dB down. The decimator delays its output by 59.5 input samples
+  and needs 40 output samples to fill its history.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  num_samples = 4800
+  settle = 40
+  delay = 59.5
+  failed = False
+  for frequency in (100, 1000, 3000, 5000, 7000):
+    output = rpc_helper.decimate_audio(frequency, num_samples, num_samples)
+    reference = [
+        0.5 * math.sin(2 * math.pi * frequency * (3 * m - delay) / 48000)
+        for m in range(len(output))
+    ]
+    output, reference = output[settle:], reference[settle:]
+    gain = 20 * math.log10(
+        math.sqrt(sum(x * x for x in output) / sum(x * x for x in reference)))
+    error = max(abs(x - y) for x, y in zip(output, reference))
+    ok = abs(gain) <= 0.01 and error <= 2e-3
+    failed |= not ok
+    print(f'{frequency} Hz: gain {gain:+.4f} dB, max error {error:.2e}'
+          f' {"OK" if ok else "FAIL"}')
+
+  for frequency in range(8500, 24001, 250):
+    output = rpc_helper.decimate_audio(frequency, num_samples, num_samples)
+    output = output[settle:]
+    rms = math.sqrt(sum(x * x for x in output) / len(output))
+    rejection = 20 * math.log10(rms / (0.5 / math.sqrt(2)) + 1e-12)
+    ok = rejection <= -60
+    failed |= not ok
+    print(f'{frequency} Hz: {rejection:.1f} dB {"OK" if ok else "FAIL"}')
+
+  whole = rpc_helper.decimate_audio(1000, num_samples, num_samples)
+  chunked = rpc_helper.decimate_audio(1000, num_samples, 7)
+  ok = whole == chunked
+  failed |= not ok
+  print(f'Chunked output matches: {"OK" if ok else "FAIL"}')
+  print('Audio decimator test ' + ('FAILED' if failed else 'PASSED'))
+
+
+def run_camera_conversion_test(url):
+  """Checks the camera conversions against their references on the device.
+
+  Runs every rotation on one raw frame, either --raw_frame or a frame the
+  device captures. Fails on the first mismatch.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  raw_resource_name = ''
+  if args.raw_frame:
+    with open(args.raw_frame, 'rb') as f:
+      raw_frame = f.read()
+    raw_resource_name = 'camera_raw_frame'
+    rpc_helper.upload_resource(raw_resource_name, raw_frame, len(raw_frame))
+  failed = False
+  for rotation in range(4):
+    result = rpc_helper.check_camera_conversion(raw_resource_name, rotation)
+    if result is None:
+      failed = True
+      print(f'Rotation {rotation * 90}: FAIL')
+      continue
+    print(f'Rotation {rotation * 90}: {result["cases"]} cases OK, fixed point'
+          f' within {result["max_fixed_point_diff"]}, white balance differs'
+          f' from the native-size gains by up to'
+          f' {result["max_white_balance_diff"]}')
+  print('Camera conversion test ' + ('FAILED' if failed else 'PASSED'))
+
+
+def make_tracker_detections(kind, num_frames, num_objects, rng):
+  """Makes jittered detections of objects moving across the frame.
+
+  Returns the detections as float32 values in the layout "run_tracker"
+  expects. About 5% of the detections are marked as missed after the first
+  frames.
+  """
+  values = []
+  for frame in range(num_frames):
+    for i in range(num_objects):
+      y = 0.1 + frame * (0.002 + 0.0005 * i)
+      x = 0.05 + i * 0.22 + frame * 0.001 * (1 if i % 2 else -1)
+      score = 0.9 - 0.1 * i
+      if frame >= 8 and rng.random() < 0.05:
+        score = -1.0
+      jitter = lambda: rng.uniform(-0.005, 0.005)
+      if kind == 'objects':
+        values += [i % 2, score, y + jitter(), x + jitter(),
+                   y + 0.15 + jitter(), x + 0.15 + jitter()]
+      else:
+        values.append(score)
+        for k in range(17):
+          values += [x + 0.03 * (k % 5) + jitter(),
+                     y + 0.03 * (k // 5) + jitter(), 0.8]
+  return struct.pack(f'<{len(values)}f', *values)
+
+
+def run_tracker_test(url):
+  """Checks that tracks keep their ids while objects and poses move.
+
+  Runs the trackers with inference on every frame and on alternate frames.
+  After two updates, every object must map to its own track, and keep it.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  num_frames = 120
+  num_objects = 4
+  failed = False
+  for kind in ('objects', 'poses'):
+    data = make_tracker_detections(kind, num_frames, num_objects,
+                                   random.Random(0))
+    resource_name = f'tracker_{kind}'
+    rpc_helper.upload_resource(resource_name, data, len(data))
+    for inference_interval in (1, 2):
+      track_ids = rpc_helper.run_tracker(kind, resource_name, num_frames,
+                                         num_objects, inference_interval)
+      if track_ids is None:
+        failed = True
+        print(f'{kind}, inference every {inference_interval} frames: FAIL')
+        continue
+      first = 2 * inference_interval - 1
+      ids = [track_ids[first * num_objects + i] for i in range(num_objects)]
+      switches = sum(
+          track_ids[frame * num_objects + i] != ids[i]
+          for frame in range(first, num_frames) for i in range(num_objects))
+      ok = switches == 0 and 0 not in ids and len(set(ids)) == num_objects
+      failed |= not ok
+      print(f'{kind}, inference every {inference_interval} frames: track ids'
+            f' {ids}, {switches} switches {"OK" if ok else "FAIL"}')
+    rpc_helper.delete_resource(resource_name)
+  print('Tracker test ' + ('FAILED' if failed else 'PASSED'))
+
+
+def make_motion_frames(rng):
+  """Makes raw frames of a bright square moving over a noisy background.
+
+  Returns the frames and, for each frame, the square as (x, y, size), or
+  None. The first two frames only have the background.
+  """
+  width = height = 324
+  size = 36
+  frames = bytearray()
+  squares = []
+  for frame in range(8):
+    pixels = bytearray(rng.randrange(97, 104) for _ in range(width * height))
+    square = None
+    if frame >= 2:
+      square = (40 + 30 * (frame - 2), 100 + 10 * (frame - 2), size)
+      x, y, _ = square
+      for row in range(y, y + size):
+        pixels[row * width + x:row * width + x + size] = bytes([200]) * size
+    frames += pixels
+    squares.append(square)
+  return bytes(frames), squares
+
+
+def run_motion_detector_test(url):
+  """Checks the software motion detector on a moving square.
+
+  The background frames must report no motion, and a box must cover the
+  square in every frame it moves. With --raw_frames, also prints the boxes
+  found in the recorded sequence.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  frame_size = 324 * 324
+  frames, squares = make_motion_frames(random.Random(0))
+  rpc_helper.upload_resource('motion_frames', frames, len(frames))
+  results = rpc_helper.detect_motion('motion_frames', len(squares),
+                                     block_size=18, threshold=12, rotation=0)
+  rpc_helper.delete_resource('motion_frames')
+  failed = results is None
+  for frame, (square, result) in enumerate(zip(squares, results or [])):
+    if square is None:
+      ok = not result['changed'] and not result['boxes']
+    else:
+      x, y, size = square
+      ok = result['changed'] and any(
+          bx <= x and by <= y and bx + bw >= x + size and by + bh >= y + size
+          for bx, by, bw, bh in result['boxes'])
+    failed |= not ok
+    print(f'Frame {frame}: square {square}, boxes {result["boxes"]}'
+          f' {"OK" if ok else "FAIL"}')
+
+  if args.raw_frames:
+    with open(args.raw_frames, 'rb') as f:
+      recorded = f.read()
+    num_frames = len(recorded) // frame_size
+    rpc_helper.upload_resource('motion_frames', recorded,
+                               num_frames * frame_size)
+    results = rpc_helper.detect_motion('motion_frames', num_frames,
+                                       block_size=18, threshold=12,
+                                       rotation=3)
+    rpc_helper.delete_resource('motion_frames')
+    failed |= results is None
+    for frame, result in enumerate(results or []):
+      print(f'Recorded frame {frame}: boxes {result["boxes"]}')
+  print('Motion detector test ' + ('FAILED' if failed else 'PASSED'))
+
+
+def run_parameter_cache_test(url):
+  """Checks the Edge TPU parameter cache bookkeeping.
+
+  Replays the calls the Edge TPU manager makes for a sequence of invokes in a
+  100-byte cache, including a failed upload and a failed inference, neither
+  of which may count as a hit or miss.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  steps = [
+      # Model 1 fails to upload, then uploads and runs.
+      'A1,1,60 R1',
+      'A1,1,60 B60 N1',
+      # Model 1 is cached.
+      'A1,1,60 N0',
+      # Model 2 fits next to model 1; model 3 evicts model 1.
+      'A2,1,30 B30 N1',
+      'A3,1,30 B30 N1',
+      # Model 1 evicts model 2, but its inference fails.
+      'A1,1,60 B60',
+      'A3,1,30 N0',
+      # Another parameter caching token drops models 1 and 3.
+      'A4,2,10 B10 N1',
+      'I',
+      'A4,2,10',
+  ]
+  expected = {
+      'acquired': 'UUCUUUCUU',
+      'used_bytes': 10,
+      'hits': 2,
+      'misses': 4,
+      'evictions': 5,
+      'bytes_uploaded': 190,
+  }
+  result = rpc_helper.check_parameter_cache(100, ' '.join(steps))
+  ok = result == expected
+  print(f'Parameter cache: {result}, expected {expected}'
+        f' {"OK" if ok else "FAIL"}')
+  print('Parameter cache test ' + ('PASSED' if ok else 'FAILED'))
+
+
+def run_posenet_decoder_test(url):
+  """Checks the PoseNet decoder against the old one on the bundled inputs.
+
+  The device decodes the outputs of PoseNet on models/posenet_test_input.bin
+  and of BodyPix on models/posenet_test_input_324.bin with the old decoder,
+  with the current float decoder and, in the models' decoder op, straight
+  from the quantized outputs. All three must find the same poses bit for
+  bit, and for BodyPix the exact instance masks of those poses must match
+  the old decoder's masks.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  cases = [
+      ('models/posenet_mobilenet_v1_075_353_481_quant_decoder_edgetpu.tflite',
+       'models/posenet_test_input.bin', False),
+      ('models/bodypix_mobilenet_v1_075_324_324_16_quant_decoder_edgetpu.tflite',
+       'models/posenet_test_input_324.bin', True),
+  ]
+  failed = False
+  for model_path, input_path, has_masks in cases:
+    resources = []
+    for path in (model_path, input_path):
+      with open(path, 'rb') as f:
+        data = f.read()
+      name = path.split('/')[-1]
+      rpc_helper.upload_resource(name, data, len(data))
+      resources.append(name)
+    result = rpc_helper.check_posenet_decoder(*resources)
+    for name in resources:
+      rpc_helper.delete_resource(name)
+    # The test inputs have people in them, so some poses must be found.
+    ok = (result is not None and result['poses'] > 0 and
+          (result['mask_pixels'] > 0) == has_masks)
+    failed = failed or not ok
+    print(f'{resources[0]}: {result} {"OK" if ok else "FAIL"}')
+  print('PoseNet decoder test ' + ('FAILED' if failed else 'PASSED'))
+
+
+def run_sign_conversion_test(url):
+  """Checks the word-at-a-time sign conversion of Edge TPU data.
+
+  The device compares it with a byte loop for every element size, size up to
+  the given number of elements, and source and destination alignment.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  max_elements = 64
+  # 3 element sizes, 4 source offsets, and 4 copies plus 1 in place each.
+  expected = 3 * (max_elements + 1) * 4 * 5
+  cases = rpc_helper.check_sign_conversion(max_elements)
+  ok = cases == expected
+  print(f'Sign conversion: {cases} cases, expected {expected}'
+        f' {"OK" if ok else "FAIL"}')
+  print('Sign conversion test ' + ('PASSED' if ok else 'FAILED'))
+
+
+def run_sample_ring_test(url):
+  """Checks SampleRing views, including ones the producer wrapped into.
+
+  The device appends a ramp in chunks of random sizes and checks 3 views per
+  chunk: the one taken before the chunk, a full view and a shorter one.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  passed = True
+  for num_samples in [1, 100, 1024, 4000]:
+    result = rpc_helper.check_sample_ring(num_samples)
+    # 200 chunks.
+    ok = result is not None and result['cases'] == 200 * 3
+    if ok:
+      capacity = result['capacity']
+      ok = capacity >= 2 * num_samples and capacity & (capacity - 1) == 0
+    print(f'Sample ring of {num_samples}: {result} {"OK" if ok else "FAIL"}')
+    passed = passed and ok
+  print('Sample ring test ' + ('PASSED' if passed else 'FAILED'))
+
+
+def run_audio_windows_test(url):
+  """Checks AudioService window callbacks on microphone audio.
+
+  The device compares every int32, int16 and float window with the samples
+  a plain callback recorded, for hops smaller and larger than a DMA buffer
+  and than the window.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  duration_ms = 2000
+  # 30 ms DMA buffers at 16 kHz.
+  buffer_samples = 480
+  passed = True
+  for window, hop in [(1600, 160), (15600, 8000), (480, 480), (1000, 1500)]:
+    result = rpc_helper.check_audio_windows(window, hop, duration_ms)
+    ok = result is not None
+    if ok:
+      # Windows end once a full window is captured, then every hop. The
+      # recording may start a buffer earlier and end a few buffers later.
+      samples = result['samples']
+      slack = 4 * buffer_samples
+      min_windows = (samples - slack - window) // hop + 1
+      max_windows = (samples - window) // hop + 1
+      counts = result['windows']
+      ok = all(min_windows <= count <= max_windows for count in counts)
+    print(f'Audio windows of {window} every {hop}: {result}'
+          f' {"OK" if ok else "FAIL"}')
+    passed = passed and ok
+  print('Audio windows test ' + ('PASSED' if passed else 'FAILED'))
+
+
+def run_audio_conversion_test(url):
+  """Checks the int16, int32 and float audio sample conversions.
+
+  The device compares them with scalar references, including saturation,
+  for every number of samples up to the given one.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  max_samples = 64
+  # 4 conversions for each size.
+  expected = 4 * (max_samples + 1)
+  cases = rpc_helper.check_audio_conversion(max_samples)
+  ok = cases == expected
+  print(f'Audio conversion: {cases} cases, expected {expected}'
+        f' {"OK" if ok else "FAIL"}')
+  print('Audio conversion test ' + ('PASSED' if ok else 'FAILED'))
+
+
+def run_nms_test(url):
+  """Checks greedy and soft non-maximum suppression on clustered boxes.
+
+  The device compares every method, per class and class agnostic, on
+  normalized and unnormalized boxes, with a direct implementation.
+  """
+  rpc_helper = CoralMicroRPCHelper(url)
+  passed = True
+  for count in [0, 1, 10, 100, 1000]:
+    result = rpc_helper.check_nms(count)
+    # 2 box scales, 2 class modes, and greedy with and without scratch plus
+    # 2 soft methods each.
+    ok = result is not None and result['cases'] == 2 * 2 * 4
+    print(f'NMS of {count} boxes: {result} {"OK" if ok else "FAIL"}')
+    passed = passed and ok
+  print('NMS test ' + ('PASSED' if passed else 'FAILED'))
+
+
 def main():
   url = f"http://{args.host}:{args.port}/jsonrpc"
   print(f"Dev Board Micro url: {url}")
@@ -157,6 +566,28 @@ def main():
     run_crypto_test(url)
   elif args.test == "ble_tests":
     run_ble_test(url)
+  elif args.test == "audio_decimator":
+    run_audio_decimator_test(url)
+  elif args.test == "camera_conversion":
+    run_camera_conversion_test(url)
+  elif args.test == "tracker":
+    run_tracker_test(url)
+  elif args.test == "motion_detector":
+    run_motion_detector_test(url)
+  elif args.test == "parameter_cache":
+    run_parameter_cache_test(url)
+  elif args.test == "posenet_decoder":
+    run_posenet_decoder_test(url)
+  elif args.test == "sign_conversion":
+    run_sign_conversion_test(url)
+  elif args.test == "sample_ring":
+    run_sample_ring_test(url)
+  elif args.test == "audio_windows":
+    run_audio_windows_test(url)
+  elif args.test == "audio_conversion":
+    run_audio_conversion_test(url)
+  elif args.test == "nms":
+    run_nms_test(url)
   else:
     print('Test not supported')
     parser.print_help()
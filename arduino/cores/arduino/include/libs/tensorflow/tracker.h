@@ -0,0 +1 @@
+../../../../../../libs/tensorflow/tracker.h
\ No newline at end of file
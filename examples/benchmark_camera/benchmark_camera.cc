@@ -0,0 +1,142 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdio>
+#include <vector>
+
+#include "libs/base/led.h"
+#include "libs/base/timer.h"
+#include "libs/camera/camera.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/task.h"
+
+// Measures `CameraTask::GetFrame()` converting a raw frame into RGB at common
+// model input sizes, with each resize method, and into Y8.
+//
+// The camera runs in trigger mode, and each frame is triggered and given time
+// to arrive before `GetFrame()` is timed, so the times include only the
+// conversion and the cost of leasing the frame. The lease alone is measured
+// first for reference. Results are printed to the serial console.
+//
+// To build and flash from coralmicro root:
+//    bash build.sh
+//    python3 scripts/flashtool.py -e benchmark_camera
+
+namespace coralmicro {
+namespace {
+
+struct Size {
+  int width;
+  int height;
+};
+
+constexpr Size kSizes[] = {{96, 96}, {160, 120}, {224, 224}, {324, 324}};
+constexpr int kRepetitions = 20;
+// Long enough for a triggered frame to be captured.
+constexpr int kFrameDelayMs = 100;
+
+CameraFrameScratch scratch;
+
+void TriggerAndWait() {
+  CameraTask::GetSingleton()->Trigger();
+  vTaskDelay(pdMS_TO_TICKS(kFrameDelayMs));
+}
+
+// Prints the average time to lease a frame without converting it.
+void MeasureLease() {
+  uint64_t total = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    TriggerAndWait();
+    const auto start = TimerMicros();
+    auto frame = CameraTask::GetSingleton()->LeaseFrame();
+    total += TimerMicros() - start;
+    if (!frame.Ok()) {
+      printf("  LeaseFrame failed\r\n");
+      return;
+    }
+  }
+  printf("  %-24s %8lu us\r\n", "lease only",
+         static_cast<uint32_t>(total / kRepetitions));
+}
+
+// Converts `kRepetitions` frames and prints the average time.
+//
+// @param name The name to print for this run.
+// @param fmt The format to convert each frame into.
+void Measure(const char* name, const CameraFrameFormat& fmt) {
+  uint64_t total = 0;
+  for (int i = 0; i < kRepetitions; ++i) {
+    TriggerAndWait();
+    const auto start = TimerMicros();
+    const bool ok = CameraTask::GetSingleton()->GetFrame(&fmt, 1, &scratch);
+    total += TimerMicros() - start;
+    if (!ok) {
+      printf("  %-24s GetFrame failed\r\n", name);
+      return;
+    }
+  }
+  printf("  %-24s %8lu us\r\n", name,
+         static_cast<uint32_t>(total / kRepetitions));
+}
+
+void Main() {
+  printf("Camera conversion benchmark!\r\n");
+  // Turn on Status LED to show the board is on.
+  LedSet(Led::kStatus, true);
+
+  CameraTask::GetSingleton()->SetPower(true);
+  CameraTask::GetSingleton()->Enable(CameraMode::kTrigger);
+
+  std::vector<uint8_t> buffer(CameraTask::kWidth * CameraTask::kHeight *
+                              CameraFormatBpp(CameraFormat::kRgb));
+  MeasureLease();
+  for (const auto& size : kSizes) {
+    printf("%dx%d:\r\n", size.width, size.height);
+    CameraFrameFormat fmt{};
+    fmt.fmt = CameraFormat::kRgb;
+    fmt.width = size.width;
+    fmt.height = size.height;
+    fmt.preserve_ratio = false;
+    fmt.buffer = buffer.data();
+
+    fmt.resize = CameraResizeMethod::kNearestNeighbor;
+    Measure("rgb nearest", fmt);
+    fmt.resize = CameraResizeMethod::kBilinear;
+    Measure("rgb bilinear", fmt);
+    fmt.resize = CameraResizeMethod::kArea;
+    Measure("rgb area", fmt);
+    fmt.resize = CameraResizeMethod::kNearestNeighbor;
+    fmt.filter = CameraFilterMethod::kNearestNeighbor;
+    Measure("rgb nearest demosaic", fmt);
+    fmt.filter = CameraFilterMethod::kBilinear;
+    fmt.white_balance = false;
+    Measure("rgb no white balance", fmt);
+    fmt.white_balance = true;
+    fmt.fmt = CameraFormat::kY8;
+    Measure("y8", fmt);
+    fmt.precision = CameraPrecision::kFixedPoint;
+    Measure("y8 fixed point", fmt);
+  }
+
+  CameraTask::GetSingleton()->SetPower(false);
+}
+
+}  // namespace
+}  // namespace coralmicro
+
+extern "C" void app_main(void* param) {
+  (void)param;
+  coralmicro::Main();
+  vTaskSuspend(nullptr);
+}
@@ -0,0 +1,168 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include "libs/base/led.h"
+#include "libs/base/timer.h"
+#include "libs/tensorflow/detection.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/task.h"
+
+// Measures `tensorflow::NonMaxSuppression()` with 100 to 2000 candidate
+// boxes, for each suppression method, with normalized boxes (compared in
+// fixed point) and unnormalized boxes (compared with floats). Also checks
+// that greedy suppression keeps the same boxes with and without scratch
+// memory.
+//
+// The boxes are random but clustered on a grid, so that many overlap, and
+// spread over 10 classes. Results are printed to the serial console.
+//
+// To build and flash from coralmicro root:
+//    bash build.sh
+//    python3 scripts/flashtool.py -e benchmark_nms
+
+namespace coralmicro {
+namespace {
+using tensorflow::NmsBox;
+using tensorflow::NmsMethod;
+using tensorflow::NmsOptions;
+using tensorflow::Object;
+
+constexpr int kBoxCounts[] = {100, 500, 1000, 2000};
+constexpr int kMaxBoxes = 2000;
+constexpr int kNumClasses = 10;
+
+// A small deterministic generator, so every run uses the same boxes.
+class Random {
+ public:
+  // Gets a value from 0 to 1.
+  float Uniform() {
+    state_ = state_ * 1664525u + 1013904223u;
+    return (state_ >> 8) * (1.0f / (1 << 24));
+  }
+  uint32_t Next() {
+    state_ = state_ * 1664525u + 1013904223u;
+    return state_ >> 8;
+  }
+
+ private:
+  uint32_t state_ = 7;
+};
+
+void GenerateBoxes(Random* random, int count, std::vector<Object>* objects) {
+  objects->resize(count);
+  for (auto& object : *objects) {
+    const float cy = static_cast<int>(random->Uniform() * 8) / 8.0f + 0.06f +
+                     0.03f * random->Uniform();
+    const float cx = static_cast<int>(random->Uniform() * 8) / 8.0f + 0.06f +
+                     0.03f * random->Uniform();
+    const float h = 0.1f + 0.05f * random->Uniform();
+    const float w = 0.1f + 0.05f * random->Uniform();
+    object.id = static_cast<int>(random->Next() % kNumClasses);
+    object.score = random->Uniform();
+    object.bbox = {cy, cx, std::min(1.0f, cy + h), std::min(1.0f, cx + w)};
+  }
+}
+
+// Scales the boxes out of the normalized range, so they are compared with
+// floats. Scaling both coordinates keeps every IoU the same.
+void Denormalize(std::vector<Object>* objects) {
+  for (auto& object : *objects) {
+    object.bbox.ymin *= 2;
+    object.bbox.xmin *= 2;
+    object.bbox.ymax *= 2;
+    object.bbox.xmax *= 2;
+  }
+}
+
+// Runs `NonMaxSuppression()` on copies of `objects` and prints the average
+// time.
+//
+// @param name The name to print for this run.
+// @param objects The candidate boxes.
+// @param options The suppression options.
+// @param scratch Scratch memory for the boxes, or null.
+// @param result Gets the kept boxes of the last repetition.
+void Measure(const char* name, const std::vector<Object>& objects,
+             const NmsOptions& options, NmsBox* scratch,
+             std::vector<Object>* result) {
+  const int repetitions = 20000 / static_cast<int>(objects.size()) + 5;
+  uint64_t total = 0;
+  for (int i = 0; i < repetitions; ++i) {
+    *result = objects;
+    const auto start = TimerMicros();
+    result->resize(tensorflow::NonMaxSuppression(
+        result->data(), result->size(), options, scratch));
+    total += TimerMicros() - start;
+  }
+  printf("  %-24s %8lu us, %4u kept\r\n", name,
+         static_cast<uint32_t>(total / repetitions),
+         static_cast<unsigned>(result->size()));
+}
+
+bool SameScores(const std::vector<Object>& a, const std::vector<Object>& b) {
+  if (a.size() != b.size()) return false;
+  for (size_t i = 0; i < a.size(); ++i) {
+    if (a[i].id != b[i].id || a[i].score != b[i].score) return false;
+  }
+  return true;
+}
+
+void Main() {
+  printf("Non-maximum suppression benchmark!\r\n");
+  // Turn on Status LED to show the board is on.
+  LedSet(Led::kStatus, true);
+
+  Random random;
+  std::vector<Object> objects;
+  std::vector<Object> denormalized;
+  std::vector<Object> kept;
+  std::vector<Object> reference;
+  std::vector<NmsBox> scratch(kMaxBoxes);
+
+  NmsOptions greedy;
+  NmsOptions agnostic;
+  agnostic.class_agnostic = true;
+  NmsOptions soft_linear;
+  soft_linear.method = NmsMethod::kSoftLinear;
+  NmsOptions soft_gaussian;
+  soft_gaussian.method = NmsMethod::kSoftGaussian;
+
+  for (int count : kBoxCounts) {
+    GenerateBoxes(&random, count, &objects);
+    denormalized = objects;
+    Denormalize(&denormalized);
+
+    printf("%d boxes:\r\n", count);
+    Measure("greedy per class", objects, greedy, scratch.data(), &reference);
+    Measure("greedy, no scratch", objects, greedy, nullptr, &kept);
+    if (!SameScores(kept, reference)) printf("  MISMATCH without scratch\r\n");
+    Measure("greedy, float", denormalized, greedy, nullptr, &kept);
+    Measure("greedy class agnostic", objects, agnostic, scratch.data(), &kept);
+    Measure("soft linear", objects, soft_linear, nullptr, &kept);
+    Measure("soft gaussian", objects, soft_gaussian, nullptr, &kept);
+  }
+}
+
+}  // namespace
+}  // namespace coralmicro
+
+extern "C" void app_main(void* param) {
+  (void)param;
+  coralmicro::Main();
+  vTaskSuspend(nullptr);
+}
@@ -0,0 +1,146 @@
+// Copyright 2022 Google LLC
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstring>
+#include <vector>
+
+#include "libs/base/filesystem.h"
+#include "libs/base/led.h"
+#include "libs/base/timer.h"
+#include "libs/tensorflow/posenet.h"
+#include "libs/tensorflow/posenet_decoder_op.h"
+#include "libs/tpu/edgetpu_manager.h"
+#include "libs/tpu/edgetpu_op.h"
+#include "third_party/tflite-micro/tensorflow/lite/micro/micro_error_reporter.h"
+#include "third_party/tflite-micro/tensorflow/lite/micro/micro_interpreter.h"
+#include "third_party/tflite-micro/tensorflow/lite/micro/micro_mutable_op_resolver.h"
+
+// Measures PoseNet frames per second on the Edge TPU, first with the regular
+// Edge TPU op and then with the pipelined op, which runs each frame on the
+// Edge TPU while the CPU decodes the poses of the previous frame and
+// prepares the next input.
+//
+// Each frame copies the test image into the input tensor, invokes the
+// model, and reads the poses. Results are printed to the serial console.
+//
+// To build and flash from coralmicro root:
+//    bash build.sh
+//    python3 scripts/flashtool.py -e benchmark_poses
+
+namespace coralmicro {
+namespace {
+
+constexpr int kModelArenaSize = 1 * 1024 * 1024;
+constexpr int kExtraArenaSize = 1 * 1024 * 1024;
+constexpr int kTensorArenaSize = kModelArenaSize + kExtraArenaSize;
+STATIC_TENSOR_ARENA_IN_SDRAM(tensor_arena, kTensorArenaSize);
+constexpr char kModelPath[] =
+    "/models/posenet_mobilenet_v1_075_324_324_16_quant_decoder_edgetpu.tflite";
+constexpr char kTestInputPath[] = "/models/posenet_test_input_324.bin";
+constexpr int kNumFrames = 100;
+
+// Runs `kNumFrames` frames and prints the frame rate.
+//
+// @param name The name to print for this run.
+// @param model The PoseNet model.
+// @param edgetpu_op The registration of the Edge TPU op.
+// @param input The test image.
+// @return True if all frames ran successfully.
+bool RunBenchmark(const char* name, const tflite::Model* model,
+                  TfLiteRegistration* edgetpu_op,
+                  const std::vector<uint8_t>& input) {
+  tflite::MicroErrorReporter error_reporter;
+  tflite::MicroMutableOpResolver<2> resolver;
+  resolver.AddCustom(kCustomOp, edgetpu_op);
+  resolver.AddCustom(kPosenetDecoderOp, RegisterPosenetDecoderOp());
+  auto interpreter = tflite::MicroInterpreter{
+      model, resolver, tensor_arena, kTensorArenaSize, &error_reporter};
+  if (interpreter.AllocateTensors() != kTfLiteOk) {
+    printf("AllocateTensors failed.\r\n");
+    return false;
+  }
+  auto* posenet_input = interpreter.input(0);
+  if (posenet_input->bytes != input.size()) {
+    printf("Input tensor length doesn't match canned input\r\n");
+    return false;
+  }
+
+  size_t num_poses = 0;
+  auto start = TimerMillis();
+  for (int i = 0; i < kNumFrames; ++i) {
+    std::memcpy(tflite::GetTensorData<uint8_t>(posenet_input), input.data(),
+                input.size());
+    if (interpreter.Invoke() != kTfLiteOk) {
+      printf("Invoke failed.\r\n");
+      return false;
+    }
+    num_poses += tensorflow::GetPosenetOutput(&interpreter,
+                                              /*threshold=*/0.5)
+                     .size();
+  }
+  // Lets the Edge TPU finish the last input of the pipelined op, so the time
+  // includes every inference started. The poses counted are one frame
+  // behind, and the results of that input are dropped with the interpreter.
+  if (EdgeTpuManager::GetSingleton()->Finish() != kTfLiteOk) {
+    printf("Finish failed.\r\n");
+    return false;
+  }
+  auto elapsed = TimerMillis() - start;
+
+  printf("%s: %d frames in %lu ms, %.1f frames/s, %u poses\r\n", name,
+         kNumFrames, static_cast<uint32_t>(elapsed),
+         kNumFrames * 1000.0f / elapsed, static_cast<unsigned>(num_poses));
+  return true;
+}
+
+void Main() {
+  printf("PoseNet pipelining benchmark!\r\n");
+  // Turn on Status LED to show the board is on.
+  LedSet(Led::kStatus, true);
+
+  auto tpu_context =
+      EdgeTpuManager::GetSingleton()->OpenDevice(PerformanceMode::kMax);
+  if (!tpu_context) {
+    printf("ERROR: Failed to get EdgeTpu context\r\n");
+    return;
+  }
+  std::vector<uint8_t> posenet_tflite;
+  if (!LfsReadFile(kModelPath, &posenet_tflite)) {
+    printf("ERROR: Failed to load %s\r\n", kModelPath);
+    return;
+  }
+  auto* model = tflite::GetModel(posenet_tflite.data());
+  if (model->version() != TFLITE_SCHEMA_VERSION) {
+    printf("ERROR: Model schema version is %lu, supported is %d\r\n",
+           model->version(), TFLITE_SCHEMA_VERSION);
+    return;
+  }
+  std::vector<uint8_t> input;
+  if (!LfsReadFile(kTestInputPath, &input)) {
+    printf("ERROR: Failed to load %s\r\n", kTestInputPath);
+    return;
+  }
+
+  if (!RunBenchmark("Sequential", model, RegisterCustomOp(), input)) return;
+  RunBenchmark("Pipelined", model, RegisterPipelinedCustomOp(), input);
+}
+
+}  // namespace
+}  // namespace coralmicro
+
+extern "C" void app_main(void* param) {
+  (void)param;
+  coralmicro::Main();
+  vTaskSuspend(nullptr);
+}
@@ -155,30 +155,25 @@ void run(tflite::MicroInterpreter* interpreter, FrontendState* frontend_state) {
                                  kDmaBufferSizeMs};
   AudioService audio_service(&audio_driver, audio_config, kAudioServicePriority,
                              kDropFirstSamplesMs);
-  LatestSamples audio_latest(
+  SampleRing audio_latest(
       MsToSamples(AudioSampleRate::k16000_Hz, tensorflow::kYamnetDurationMs));
   audio_service.AddCallback(
       &audio_latest,
       +[](void* ctx, const int32_t* samples, size_t num_samples) {
-        static_cast<LatestSamples*>(ctx)->Append(samples, num_samples);
+        static_cast<SampleRing*>(ctx)->Append(samples, num_samples);
         return true;
       });
   // Delay for the first buffers to fill.
   vTaskDelay(pdMS_TO_TICKS(tensorflow::kYamnetDurationMs));
   while (true) {
-    audio_latest.AccessLatestSamples(
-        [](const std::vector<int32_t>& samples, size_t start_index) {
-          size_t i, j = 0;
-          // Starting with start_index, grab until the end of the buffer.
-          for (i = 0; i < samples.size() - start_index; ++i) {
-            audio_input[i] = samples[i + start_index] >> 16;
-          }
-          // Now fill the rest of the data with the beginning of the
-          // buffer.
-          for (j = 0; j < samples.size() - i; ++j) {
-            audio_input[i + j] = samples[j] >> 16;
-          }
-        });
+    SampleView view;
+    do {
+      view = audio_latest.View();
+      auto* out = audio_input.data();
+      for (size_t i = 0; i < view.first_size; ++i) *out++ = view.first[i] >> 16;
+      for (size_t i = 0; i < view.second_size; ++i)
+        *out++ = view.second[i] >> 16;
+    } while (!audio_latest.IsValid(view));
     run(&interpreter, &frontend_state);
 #ifndef YAMNET_CPU
     // Delay 975 ms to rate limit the TPU version.
@@ -19,7 +19,6 @@
 #include "libs/tensorflow/utils.h"
 #include "libs/tpu/edgetpu_manager.h"
 #include "libs/tpu/edgetpu_op.h"
-#include "third_party/tflite-micro/tensorflow/lite/experimental/microfrontend/lib/frontend.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_interpreter.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_mutable_op_resolver.h"
 
@@ -38,27 +37,24 @@ constexpr int kDropFirstSamplesMs = 150;
 AudioDriverBuffers<kNumDmaBuffers, kDmaBufferSize> audio_buffers;
 AudioDriver audio_driver(audio_buffers);
 
-constexpr int kAudioBufferSizeMs = tensorflow::kKeywordDetectorDurationMs;
-constexpr int kAudioBufferSize =
-    kAudioBufferSizeMs * tensorflow::kKeywordDetectorSampleRateMs;
+// Time between inferences. Features are computed as audio arrives, so this
+// only bounds how often the TPU runs.
+constexpr int kInferenceIntervalMs = 200;
 
 constexpr float kThreshold = 0.3;
 constexpr int kTopK = 5;
 constexpr char kModelName[] = "/models/voice_commands_v0.7_edgetpu.tflite";
 constexpr char kLabelsName[] = "/models/labels_gc2.raw.txt";
 
-std::array<int16_t, tensorflow::kKeywordDetectorAudioSize> audio_input;
 std::vector<std::string> labels;
 
-// Run invoke and get the results after the interpreter have already been
-// populated with raw audio input.
-void run(tflite::MicroInterpreter* interpreter, FrontendState* frontend_state) {
+// Copies the latest features into the input tensor, runs invoke and prints
+// the results.
+void run(tflite::MicroInterpreter* interpreter,
+         const tensorflow::AudioFeatureStream& feature_stream) {
   auto input_tensor = interpreter->input_tensor(0);
   auto preprocess_start = TimerMillis();
-  tensorflow::KeywordDetectorPreprocessInput(audio_input.data(), input_tensor,
-                                             frontend_state);
-  // Reset frontend state.
-  FrontendReset(frontend_state);
+  feature_stream.CopyToInputTensor(input_tensor);
   auto preprocess_end = TimerMillis();
   if (interpreter->Invoke() != kTfLiteOk) {
     printf("Failed to invoke on test input\r\n");
@@ -124,10 +120,9 @@ void run(tflite::MicroInterpreter* interpreter, FrontendState* frontend_state) {
     vTaskSuspend(nullptr);
   }
 
-  FrontendState frontend_state{};
-  if (!tensorflow::PrepareAudioFrontEnd(
-          &frontend_state, tensorflow::AudioModel::kKeywordDetector)) {
-    printf("tensorflow::PrepareAudioFrontEnd() failed.\r\n");
+  tensorflow::AudioFeatureStream feature_stream;
+  if (!feature_stream.Init(tensorflow::AudioModel::kKeywordDetector)) {
+    printf("tensorflow::AudioFeatureStream::Init() failed.\r\n");
     vTaskSuspend(nullptr);
   }
 
@@ -136,36 +131,20 @@ void run(tflite::MicroInterpreter* interpreter, FrontendState* frontend_state) {
                                  kDmaBufferSizeMs};
   AudioService audio_service(&audio_driver, audio_config, kAudioServicePriority,
                              kDropFirstSamplesMs);
-  LatestSamples audio_latest(MsToSamples(
-      AudioSampleRate::k16000_Hz, tensorflow::kKeywordDetectorDurationMs));
   audio_service.AddCallback(
-      &audio_latest,
+      &feature_stream,
       +[](void* ctx, const int32_t* samples, size_t num_samples) {
-        static_cast<LatestSamples*>(ctx)->Append(samples, num_samples);
+        static_cast<tensorflow::AudioFeatureStream*>(ctx)->AddSamples(
+            samples, num_samples);
         return true;
       });
 
-  // Delay for the first buffers to fill.
+  // Delay for the first features to fill.
   vTaskDelay(pdMS_TO_TICKS(tensorflow::kKeywordDetectorDurationMs));
 
   while (true) {
-    audio_latest.AccessLatestSamples(
-        [](const std::vector<int32_t>& samples, size_t start_index) {
-          size_t i, j = 0;
-          // Starting with start_index, grab until the end of the buffer.
-          for (i = 0; i < samples.size() - start_index; ++i) {
-            audio_input[i] = samples[i + start_index] >> 16;
-          }
-          // Now fill the rest of the data with the beginning of the
-          // buffer.
-          for (j = 0; j < samples.size() - i; ++j) {
-            audio_input[i + j] = samples[j] >> 16;
-          }
-        });
-    run(&interpreter, &frontend_state);
-
-    // Delay 2000ms to rate limit the TPU version.
-    vTaskDelay(pdMS_TO_TICKS(tensorflow::kKeywordDetectorDurationMs));
+    if (feature_stream.Ready()) run(&interpreter, feature_stream);
+    vTaskDelay(pdMS_TO_TICKS(kInferenceIntervalMs));
   }
 }
 }  // namespace coralmicro
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/audio/audio_convert.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+#include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/fsl_device_registers.h"
+#endif
+
+namespace coralmicro {
+namespace {
+constexpr float kInt32ToFloat = 1.0f / 2147483648.0f;
+
+// First half of the symmetric low-pass filter: 120-tap Kaiser-windowed sinc
+// (beta = 5.65) with a 7.75 kHz cutoff at 48 kHz, normalized to unity gain.
+constexpr int kHalfTaps = AudioDecimator::kNumTaps / 2;
+constexpr float kDecimatorTaps[kHalfTaps] = {
+    -6.79974281e-05f, 4.81314130e-05f, 1.77155039e-04f,
+    1.56402150e-04f, -6.66400108e-05f, -3.13968081e-04f,
+    -2.98835929e-04f, 6.76596506e-05f, 4.93533111e-04f,
+    5.12122051e-04f, -3.51501873e-05f, -7.15976917e-04f,
+    -8.14346566e-04f, -5.17463229e-05f, 9.77324504e-04f,
+    1.22417708e-03f, 2.18974946e-04f, -1.26854998e-03f,
+    -1.76016771e-03f, -4.97801084e-04f, 1.57469250e-03f,
+    2.44017973e-03f, 9.25154109e-04f, -1.87401827e-03f,
+    -3.28109774e-03f, -1.54434685e-03f, 2.13713461e-03f,
+    4.29909688e-03f, 2.40663476e-03f, -2.32583089e-03f,
+    -5.51084911e-03f, -3.57443894e-03f, 2.39117913e-03f,
+    6.93631951e-03f, 5.12777254e-03f, -2.26994744e-03f,
+    -8.60437327e-03f, -7.17695907e-03f, 1.87733213e-03f,
+    1.05637521e-02f, 9.88840721e-03f, -1.09148242e-03f,
+    -1.29054152e-02f, -1.35398924e-02f, -2.81605307e-04f,
+    1.58121272e-02f, 1.86508642e-02f, 2.59599646e-03f,
+    -1.96843452e-02f, -2.63371582e-02f, -6.62323295e-03f,
+    2.55300987e-02f, 3.95173271e-02f, 1.45264448e-02f,
+    -3.66259080e-02f, -6.89428481e-02f, -3.58498144e-02f,
+    7.21244185e-02f, 2.11580812e-01f, 3.09153520e-01f,
+};
+
+template <typename T>
+T Saturate(float value, float scale) {
+  constexpr float kMin = static_cast<float>(std::numeric_limits<T>::min());
+  constexpr float kMax = static_cast<float>(std::numeric_limits<T>::max());
+  // Compare in float so that the cast below is always in range.
+  const float scaled = value * scale;
+  if (scaled <= kMin) return std::numeric_limits<T>::min();
+  if (scaled >= kMax) return std::numeric_limits<T>::max();
+  return static_cast<T>(scaled);
+}
+}  // namespace
+
+void AudioToInt16(const int32_t* in, int16_t* out, size_t num_samples) {
+  size_t i = 0;
+#if defined(__ARM_FEATURE_DSP) && __ARM_FEATURE_DSP
+  // Packs the upper halves of two samples with a single instruction.
+  for (; i + 2 <= num_samples; i += 2) {
+    const uint32_t packed = __PKHTB(in[i + 1], in[i], 16);
+    std::memcpy(out + i, &packed, sizeof(packed));
+  }
+#endif
+  for (; i < num_samples; ++i) out[i] = in[i] >> 16;
+}
+
+void AudioToFloat(const int32_t* in, float* out, size_t num_samples) {
+  for (size_t i = 0; i < num_samples; ++i) out[i] = in[i] * kInt32ToFloat;
+}
+
+void AudioToInt16(const float* in, int16_t* out, size_t num_samples) {
+  for (size_t i = 0; i < num_samples; ++i)
+    out[i] = Saturate<int16_t>(in[i], 32768.0f);
+}
+
+void AudioToInt32(const float* in, int32_t* out, size_t num_samples) {
+  for (size_t i = 0; i < num_samples; ++i)
+    out[i] = Saturate<int32_t>(in[i], 2147483648.0f);
+}
+
+AudioDecimator::AudioDecimator() { Reset(); }
+
+void AudioDecimator::Reset() {
+  history_.assign(kNumTaps - 1, 0.0f);
+  skip_ = 0;
+}
+
+size_t AudioDecimator::Process(const int32_t* in, size_t num_samples,
+                               float* out) {
+  const size_t history_size = kNumTaps - 1;
+  history_.resize(history_size + num_samples);
+  AudioToFloat(in, history_.data() + history_size, num_samples);
+
+  size_t count = 0;
+  size_t pos = skip_;
+  for (; pos < num_samples; pos += kFactor) {
+    // The window ends with input sample pos. The taps are symmetric, so pair
+    // up samples from both ends of the window and halve the multiplies.
+    const float* first = history_.data() + pos;
+    const float* last = first + kNumTaps - 1;
+    float sum = 0.0f;
+    for (int j = 0; j < kHalfTaps; ++j)
+      sum += kDecimatorTaps[j] * (first[j] + last[-j]);
+    out[count++] = sum;
+  }
+  skip_ = pos - num_samples;
+
+  std::memmove(history_.data(), history_.data() + num_samples,
+               history_size * sizeof(float));
+  history_.resize(history_size);
+  return count;
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_AUDIO_AUDIO_CONVERT_H_
+#define LIBS_AUDIO_AUDIO_CONVERT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace coralmicro {
+
+// Converts samples from the audio driver to signed 16-bit samples by keeping
+// the upper 16 bits of each sample.
+//
+// @param in Samples from the audio driver.
+// @param out Buffer for `num_samples` converted samples.
+// @param num_samples The number of samples to convert.
+void AudioToInt16(const int32_t* in, int16_t* out, size_t num_samples);
+
+// Converts samples from the audio driver to floats in the range [-1, 1).
+//
+// @param in Samples from the audio driver.
+// @param out Buffer for `num_samples` converted samples.
+// @param num_samples The number of samples to convert.
+void AudioToFloat(const int32_t* in, float* out, size_t num_samples);
+
+// Converts float samples in the range [-1, 1) to signed 16-bit samples,
+// saturating values out of range.
+//
+// @param in Float samples.
+// @param out Buffer for `num_samples` converted samples.
+// @param num_samples The number of samples to convert.
+void AudioToInt16(const float* in, int16_t* out, size_t num_samples);
+
+// Converts float samples in the range [-1, 1) to the audio driver's signed
+// 32-bit format, saturating values out of range.
+//
+// @param in Float samples.
+// @param out Buffer for `num_samples` converted samples.
+// @param num_samples The number of samples to convert.
+void AudioToInt32(const float* in, int32_t* out, size_t num_samples);
+
+// Downsamples 48 kHz audio to 16 kHz with a linear-phase FIR low-pass
+// filter. The filter passes up to 7 kHz within 0.01 dB and attenuates
+// everything above 8.5 kHz by at least 60 dB.
+//
+// Only every third output of the filter is computed, and the filter state
+// is kept across calls, so you can feed audio in chunks of any size.
+class AudioDecimator {
+ public:
+  // The ratio between input and output sample rates.
+  static constexpr int kFactor = 3;
+  // The number of filter taps.
+  static constexpr int kNumTaps = 120;
+
+  AudioDecimator();
+
+  // Clears the filter history, as if the input started over.
+  void Reset();
+
+  // Gets the maximum number of output samples for the given number of input
+  // samples.
+  //
+  // @param num_samples The number of input samples.
+  // @return The maximum number of samples `Process()` writes.
+  static size_t MaxOutputSize(size_t num_samples) {
+    return num_samples / kFactor + 1;
+  }
+
+  // Filters and downsamples input samples.
+  //
+  // @param in Samples from the audio driver at 48 kHz.
+  // @param num_samples The number of input samples.
+  // @param out Buffer for at least `MaxOutputSize(num_samples)` float samples
+  // at 16 kHz, in the range [-1, 1).
+  // @return The number of samples written to `out`.
+  size_t Process(const int32_t* in, size_t num_samples, float* out);
+
+ private:
+  // The last `kNumTaps - 1` input samples followed by the new input.
+  std::vector<float> history_;
+  // Input samples to skip before the next output.
+  int skip_ = 0;
+};
+
+}  // namespace coralmicro
+
+#endif  // LIBS_AUDIO_AUDIO_CONVERT_H_
@@ -16,8 +16,11 @@
 
 #include "libs/audio/audio_service.h"
 
+#include <cstdio>
+#include <cstring>
 #include <memory>
 
+#include "libs/audio/audio_convert.h"
 #include "libs/base/check.h"
 
 namespace coralmicro {
@@ -35,6 +38,10 @@ struct Message {
     struct {
       void* ctx;
       AudioService::Callback fn;
+      AudioService::Format format;
+      bool decimate;
+      size_t window;
+      size_t hop;
     } add;
 
     struct {
@@ -47,6 +54,218 @@ struct Cb {
   int id;
   void* ctx;
   AudioService::Callback fn;
+  AudioService::Format format;
+  bool decimate;
+  // Window and hop in samples, or 0 to receive each buffer as it arrives.
+  size_t window;
+  size_t hop;
+  // Stream position at which the next window ends.
+  uint64_t next_end;
+};
+
+// Keeps the latest samples of one stream contiguous in memory so that
+// overlapping windows can be given to callbacks by reference.
+class SampleHistory {
+ public:
+  explicit SampleHistory(size_t sample_size) : sample_size_(sample_size) {}
+
+  // Gets the stream position after the newest sample.
+  uint64_t End() const { return end_; }
+
+  // Makes sure that windows of up to `window` samples stay available.
+  void Reserve(size_t window) { window_ = std::max(window_, window); }
+
+  void Append(const void* samples, size_t num_samples) {
+    // Keep at least one window of old samples, and move them to the front
+    // only once the buffer is full, so each sample is moved about once.
+    if ((size_ + num_samples) * sample_size_ > buffer_.size()) {
+      const size_t kept = std::min(size_, window_);
+      if (kept) {
+        std::memmove(buffer_.data(),
+                     buffer_.data() + (size_ - kept) * sample_size_,
+                     kept * sample_size_);
+      }
+      size_ = kept;
+      const size_t capacity = 2 * window_ + num_samples;
+      buffer_.resize(std::max(buffer_.size(), capacity * sample_size_));
+    }
+    std::memcpy(buffer_.data() + size_ * sample_size_, samples,
+                num_samples * sample_size_);
+    size_ += num_samples;
+    end_ += num_samples;
+  }
+
+  // Gets the window of `size` samples that ends at stream position `end`.
+  const void* Window(uint64_t end, size_t size) const {
+    const size_t last = size_ - static_cast<size_t>(end_ - end);
+    return buffer_.data() + (last - size) * sample_size_;
+  }
+
+ private:
+  size_t sample_size_;
+  size_t window_ = 0;
+  std::vector<uint8_t> buffer_;
+  size_t size_ = 0;
+  uint64_t end_ = 0;
+};
+
+// Converts each buffer from the reader into the formats that callbacks ask
+// for. Every conversion runs at most once per buffer and its result is
+// shared by all callbacks that use it. Callbacks that ask for windows read
+// them from one history per format, shared by all such callbacks.
+class SharedConversions {
+ public:
+  // Clears the decimator history, for when capture restarts.
+  void Reset() { decimator_.Reset(); }
+
+  // Gets the stream position at which the next window of a callback ends.
+  uint64_t FirstWindowEnd(const Cb& cb) const {
+    return histories_[Stream(cb)].End() + cb.window;
+  }
+
+  // Sets the next buffer of samples.
+  //
+  // The decimator must see every buffer to keep its history continuous, so
+  // it runs right away whenever any callback needs downsampled samples.
+  void Update(const int32_t* samples, size_t num_samples,
+              const std::vector<Cb>& callbacks) {
+    samples_ = samples;
+    num_samples_ = num_samples;
+    int16_ready_ = float_ready_ = false;
+    decimated_int16_ready_ = decimated_int32_ready_ = false;
+    num_decimated_ = 0;
+    const bool decimate =
+        std::any_of(std::begin(callbacks), std::end(callbacks),
+                    [](const auto& cb) { return cb.decimate; });
+    if (decimate) {
+      decimated_.resize(AudioDecimator::MaxOutputSize(num_samples));
+      num_decimated_ =
+          decimator_.Process(samples, num_samples, decimated_.data());
+    }
+
+    bool append[kNumStreams] = {};
+    for (const auto& cb : callbacks) {
+      if (!cb.window) continue;
+      histories_[Stream(cb)].Reserve(cb.window);
+      append[Stream(cb)] = true;
+    }
+    for (int i = 0; i < kNumStreams; ++i) {
+      if (!append[i]) continue;
+      size_t size;
+      const void* data = Samples(static_cast<AudioService::Format>(i / 2),
+                                 i % 2, &size);
+      histories_[i].Append(data, size);
+    }
+  }
+
+  // Calls the callback with samples in its format, once per window that
+  // ended in the current buffer for windowed callbacks.
+  bool Call(Cb& cb) {
+    if (!cb.window) {
+      size_t size;
+      const void* data = Samples(cb.format, cb.decimate, &size);
+      return Invoke(cb, data, size);
+    }
+    const auto& history = histories_[Stream(cb)];
+    for (; cb.next_end <= history.End(); cb.next_end += cb.hop)
+      if (!Invoke(cb, history.Window(cb.next_end, cb.window), cb.window))
+        return false;
+    return true;
+  }
+
+ private:
+  // One stream for each format at the capture and the downsampled rate.
+  static constexpr int kNumStreams = 6;
+
+  static int Stream(const Cb& cb) {
+    return static_cast<int>(cb.format) * 2 + cb.decimate;
+  }
+
+  static bool Invoke(const Cb& cb, const void* samples, size_t num_samples) {
+    using Format = AudioService::Format;
+    switch (cb.format) {
+      case Format::kInt32:
+        break;
+      case Format::kInt16:
+        return reinterpret_cast<AudioService::Int16Callback>(cb.fn)(
+            cb.ctx, static_cast<const int16_t*>(samples), num_samples);
+      case Format::kFloat:
+        return reinterpret_cast<AudioService::FloatCallback>(cb.fn)(
+            cb.ctx, static_cast<const float*>(samples), num_samples);
+    }
+    return cb.fn(cb.ctx, static_cast<const int32_t*>(samples), num_samples);
+  }
+
+  const void* Samples(AudioService::Format format, bool decimate,
+                      size_t* num_samples) {
+    using Format = AudioService::Format;
+    if (decimate) {
+      *num_samples = num_decimated_;
+      switch (format) {
+        case Format::kInt32:
+          if (!decimated_int32_ready_) {
+            decimated_int32_.resize(num_decimated_);
+            AudioToInt32(decimated_.data(), decimated_int32_.data(),
+                         num_decimated_);
+            decimated_int32_ready_ = true;
+          }
+          return decimated_int32_.data();
+        case Format::kInt16:
+          if (!decimated_int16_ready_) {
+            decimated_int16_.resize(num_decimated_);
+            AudioToInt16(decimated_.data(), decimated_int16_.data(),
+                         num_decimated_);
+            decimated_int16_ready_ = true;
+          }
+          return decimated_int16_.data();
+        case Format::kFloat:
+          return decimated_.data();
+      }
+    }
+
+    *num_samples = num_samples_;
+    switch (format) {
+      case Format::kInt32:
+        break;
+      case Format::kInt16:
+        if (!int16_ready_) {
+          int16_.resize(num_samples_);
+          AudioToInt16(samples_, int16_.data(), num_samples_);
+          int16_ready_ = true;
+        }
+        return int16_.data();
+      case Format::kFloat:
+        if (!float_ready_) {
+          float_.resize(num_samples_);
+          AudioToFloat(samples_, float_.data(), num_samples_);
+          float_ready_ = true;
+        }
+        return float_.data();
+    }
+    return samples_;
+  }
+
+  const int32_t* samples_ = nullptr;
+  size_t num_samples_ = 0;
+
+  std::vector<int16_t> int16_;
+  bool int16_ready_ = false;
+  std::vector<float> float_;
+  bool float_ready_ = false;
+
+  AudioDecimator decimator_;
+  std::vector<float> decimated_;
+  size_t num_decimated_ = 0;
+  std::vector<int16_t> decimated_int16_;
+  bool decimated_int16_ready_ = false;
+  std::vector<int32_t> decimated_int32_;
+  bool decimated_int32_ready_ = false;
+
+  SampleHistory histories_[kNumStreams] = {
+      SampleHistory(sizeof(int32_t)), SampleHistory(sizeof(int32_t)),
+      SampleHistory(sizeof(int16_t)), SampleHistory(sizeof(int16_t)),
+      SampleHistory(sizeof(float)),   SampleHistory(sizeof(float)),
+  };
 };
 
 bool EraseCallbackById(std::vector<Cb>& callbacks, int id) {
@@ -112,12 +331,31 @@ AudioService::~AudioService() {
   vQueueDelete(queue_);
 }
 
-int AudioService::AddCallback(void* ctx, AudioService::Callback fn) {
+int AudioService::AddCallback(void* ctx, Format format,
+                              AudioService::Callback fn,
+                              AudioSampleRate sample_rate, size_t window,
+                              size_t hop) {
+  bool decimate = false;
+  if (sample_rate != config_.sample_rate) {
+    if (config_.sample_rate != AudioSampleRate::k48000_Hz ||
+        sample_rate != AudioSampleRate::k16000_Hz) {
+      printf("Unsupported callback sample rate %ld Hz for %ld Hz capture\r\n",
+             static_cast<long>(sample_rate),
+             static_cast<long>(config_.sample_rate));
+      return -1;
+    }
+    decimate = true;
+  }
+
   Message msg{};
   msg.type = MessageType::kAddCallback;
   msg.queue = xQueueCreate(1, sizeof(int));
   msg.add.ctx = ctx;
   msg.add.fn = fn;
+  msg.add.format = format;
+  msg.add.decimate = decimate;
+  msg.add.window = window;
+  msg.add.hop = hop;
   CHECK(msg.queue);
   CHECK(xQueueSendToBack(queue_, &msg, portMAX_DELAY) == pdTRUE);
 
@@ -154,6 +392,7 @@ void AudioService::Run() const {
   callbacks_to_remove.reserve(3);
 
   std::unique_ptr<AudioReader> reader;
+  SharedConversions conversions;
 
   int id_counter = 0;
 
@@ -164,7 +403,16 @@ void AudioService::Run() const {
       switch (msg.type) {
         case MessageType::kAddCallback: {
           int id = id_counter++;
-          callbacks.push_back({id, msg.add.ctx, msg.add.fn});
+          Cb cb{id,
+                msg.add.ctx,
+                msg.add.fn,
+                msg.add.format,
+                msg.add.decimate,
+                msg.add.window,
+                msg.add.hop,
+                /*next_end=*/0};
+          cb.next_end = conversions.FirstWindowEnd(cb);
+          callbacks.push_back(cb);
           CHECK(xQueueSendToBack(msg.queue, &id, portMAX_DELAY) == pdTRUE);
         } break;
 
@@ -186,15 +434,17 @@ void AudioService::Run() const {
     if (!reader) {
       reader = std::make_unique<AudioReader>(driver_, config_);
       reader->Drop(drop_first_samples_);
+      conversions.Reset();
     }
 
     // Blocks until buffer is full or timeout.
     auto size = reader->FillBuffer();
 
+    conversions.Update(reader->Buffer().data(), size, callbacks);
+
     callbacks_to_remove.clear();
-    for (const auto& cb : callbacks)
-      if (!cb.fn(cb.ctx, reader->Buffer().data(), size))
-        callbacks_to_remove.push_back(cb.id);
+    for (auto& cb : callbacks)
+      if (!conversions.Call(cb)) callbacks_to_remove.push_back(cb.id);
 
     for (int id : callbacks_to_remove) EraseCallbackById(callbacks, id);
 
@@ -209,4 +459,64 @@ LatestSamples::LatestSamples(size_t num_samples)
 
 LatestSamples::~LatestSamples() { vSemaphoreDelete(mutex_); }
 
+namespace {
+size_t RingCapacity(size_t num_samples) {
+  size_t capacity = 1;
+  while (capacity < 2 * num_samples) capacity <<= 1;
+  return capacity;
+}
+}  // namespace
+
+SampleRing::SampleRing(size_t num_samples)
+    : samples_(RingCapacity(num_samples)),
+      num_samples_(num_samples),
+      mask_(samples_.size() - 1) {}
+
+void SampleRing::Append(const int32_t* samples, size_t num_samples) {
+  const size_t capacity = samples_.size();
+  const uint32_t end =
+      written_.load(std::memory_order_relaxed) + num_samples;
+  // Publish the claim before touching any sample so that readers can tell
+  // their view is being overwritten.
+  claimed_.store(end, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  if (num_samples > capacity) {
+    samples += num_samples - capacity;
+    num_samples = capacity;
+  }
+  const size_t pos = (end - num_samples) & mask_;
+  const size_t first = std::min(num_samples, capacity - pos);
+  std::memcpy(samples_.data() + pos, samples, first * sizeof(int32_t));
+  std::memcpy(samples_.data(), samples + first,
+              (num_samples - first) * sizeof(int32_t));
+
+  const uint32_t filled = filled_.load(std::memory_order_relaxed);
+  filled_.store(std::min<size_t>(filled + num_samples, capacity),
+                std::memory_order_relaxed);
+  written_.store(end, std::memory_order_release);
+}
+
+SampleView SampleRing::View(size_t num_samples) const {
+  const uint32_t end = written_.load(std::memory_order_acquire);
+  num_samples = std::min<size_t>(
+      {num_samples, num_samples_, filled_.load(std::memory_order_relaxed)});
+
+  SampleView view;
+  view.start = end - num_samples;
+  const size_t pos = view.start & mask_;
+  view.first = samples_.data() + pos;
+  view.first_size = std::min(num_samples, samples_.size() - pos);
+  view.second = samples_.data();
+  view.second_size = num_samples - view.first_size;
+  return view;
+}
+
+bool SampleRing::IsValid(const SampleView& view) const {
+  // Order the reads of the view before reading the claim.
+  std::atomic_thread_fence(std::memory_order_acquire);
+  const uint32_t claimed = claimed_.load(std::memory_order_relaxed);
+  return claimed - view.start <= samples_.size();
+}
+
 }  // namespace coralmicro
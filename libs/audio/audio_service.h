@@ -18,6 +18,7 @@
 #define LIBS_AUDIO_AUDIO_SERVICE_H_
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
 #include <vector>
 
@@ -251,6 +252,38 @@ class AudioService {
   using Callback = bool (*)(void* ctx, const int32_t* samples,
                             size_t num_samples);
 
+  // The function type that receives new audio samples as signed 16-bit
+  // values (the upper 16 bits of each driver sample).
+  //
+  // @param ctx Extra parameters, defined with `AddCallback()`.
+  // @param samples A pointer to the buffer.
+  // @param num_samples The number of audio samples in the buffer.
+  // @return True if the callback should be continued to be called,
+  // false otherwise.
+  using Int16Callback = bool (*)(void* ctx, const int16_t* samples,
+                                 size_t num_samples);
+
+  // The function type that receives new audio samples as floats in the
+  // range [-1, 1).
+  //
+  // @param ctx Extra parameters, defined with `AddCallback()`.
+  // @param samples A pointer to the buffer.
+  // @param num_samples The number of audio samples in the buffer.
+  // @return True if the callback should be continued to be called,
+  // false otherwise.
+  using FloatCallback = bool (*)(void* ctx, const float* samples,
+                                 size_t num_samples);
+
+  // @cond
+  // Sample format given to a callback. Callbacks for formats other than
+  // `kInt32` are stored as `Callback` and cast back before they are called.
+  enum class Format : uint8_t {
+    kInt32,
+    kInt16,
+    kFloat,
+  };
+  // @endcond
+
   // Constructor.
   //
   // @param driver An audio driver to manage the microphone.
@@ -276,7 +309,138 @@ class AudioService {
   // @param ctx Extra parameters to pass through to the callback function.
   // @param fn The function to receive audio samples.
   // @return A unique id for the callback function.
-  int AddCallback(void* ctx, Callback fn);
+  int AddCallback(void* ctx, Callback fn) {
+    return AddCallback(ctx, Format::kInt32, fn, config_.sample_rate);
+  }
+
+  // Adds a callback function to receive audio samples as 16-bit values.
+  //
+  // The conversion runs once per buffer and is shared by all callbacks that
+  // receive the same format.
+  //
+  // @param ctx Extra parameters to pass through to the callback function.
+  // @param fn The function to receive audio samples.
+  // @return A unique id for the callback function.
+  int AddCallback(void* ctx, Int16Callback fn) {
+    return AddCallback(ctx, Format::kInt16, reinterpret_cast<Callback>(fn),
+                       config_.sample_rate);
+  }
+
+  // Adds a callback function to receive audio samples as floats.
+  //
+  // The conversion runs once per buffer and is shared by all callbacks that
+  // receive the same format.
+  //
+  // @param ctx Extra parameters to pass through to the callback function.
+  // @param fn The function to receive audio samples.
+  // @return A unique id for the callback function.
+  int AddCallback(void* ctx, FloatCallback fn) {
+    return AddCallback(ctx, Format::kFloat, reinterpret_cast<Callback>(fn),
+                       config_.sample_rate);
+  }
+
+  // Adds a callback function to receive audio samples at the given sample
+  // rate.
+  //
+  // When the driver captures at 48 kHz, you can ask for 16 kHz samples. The
+  // service then filters and downsamples each buffer once (see
+  // `AudioDecimator`) and shares the result with all such callbacks.
+  //
+  // @param ctx Extra parameters to pass through to the callback function.
+  // @param fn The function to receive audio samples.
+  // @param sample_rate The sample rate of the samples given to `fn`.
+  // @return A unique id for the callback function, or -1 if the service
+  // can't produce `sample_rate`.
+  int AddCallback(void* ctx, Callback fn, AudioSampleRate sample_rate) {
+    return AddCallback(ctx, Format::kInt32, fn, sample_rate);
+  }
+
+  // Adds a callback function to receive 16-bit audio samples at the given
+  // sample rate.
+  //
+  // @param ctx Extra parameters to pass through to the callback function.
+  // @param fn The function to receive audio samples.
+  // @param sample_rate The sample rate of the samples given to `fn`.
+  // @return A unique id for the callback function, or -1 if the service
+  // can't produce `sample_rate`.
+  int AddCallback(void* ctx, Int16Callback fn, AudioSampleRate sample_rate) {
+    return AddCallback(ctx, Format::kInt16, reinterpret_cast<Callback>(fn),
+                       sample_rate);
+  }
+
+  // Adds a callback function to receive float audio samples at the given
+  // sample rate.
+  //
+  // @param ctx Extra parameters to pass through to the callback function.
+  // @param fn The function to receive audio samples.
+  // @param sample_rate The sample rate of the samples given to `fn`.
+  // @return A unique id for the callback function, or -1 if the service
+  // can't produce `sample_rate`.
+  int AddCallback(void* ctx, FloatCallback fn, AudioSampleRate sample_rate) {
+    return AddCallback(ctx, Format::kFloat, reinterpret_cast<Callback>(fn),
+                       sample_rate);
+  }
+
+  // Adds a callback function that receives overlapping windows of audio.
+  //
+  // Rather than one DMA buffer at a time, the callback receives the latest
+  // `window_samples` samples every `hop_samples` samples, which may be more
+  // or less often than once per buffer. Windows are read by reference from
+  // a history that the service keeps once per sample format and rate, and
+  // that all windowed callbacks share. So several models with different
+  // window and hop sizes can run off one capture without each of them
+  // buffering its own copy. The first window holds only audio captured
+  // after the callback was added.
+  //
+  // For example, to run YAMNet every 500 ms and the keyword detector every
+  // 100 ms on the same 16 kHz capture:
+  //
+  // ```
+  // service.AddWindowCallback(&yamnet, +[](void* ctx, const int16_t* samples,
+  //                                        size_t num_samples) { ... },
+  //                           /*window_samples=*/15600,
+  //                           /*hop_samples=*/8000);
+  // service.AddWindowCallback(&keyword, +[](void* ctx, const int16_t* samples,
+  //                                         size_t num_samples) { ... },
+  //                           /*window_samples=*/32000,
+  //                           /*hop_samples=*/1600);
+  // ```
+  //
+  // @param ctx Extra parameters to pass through to the callback function.
+  // @param fn The function to receive audio samples, of type `Callback`,
+  // `Int16Callback` or `FloatCallback`.
+  // @param window_samples The number of samples in each window.
+  // @param hop_samples The number of samples between the starts of two
+  // consecutive windows.
+  // @return A unique id for the callback function, or -1 if
+  // `window_samples` or `hop_samples` is 0.
+  template <typename Fn>
+  int AddWindowCallback(void* ctx, Fn fn, size_t window_samples,
+                        size_t hop_samples) {
+    return AddWindowCallback(ctx, fn, window_samples, hop_samples,
+                             config_.sample_rate);
+  }
+
+  // Adds a callback function that receives overlapping windows of audio at
+  // the given sample rate. See the other `AddWindowCallback()`.
+  //
+  // @param ctx Extra parameters to pass through to the callback function.
+  // @param fn The function to receive audio samples, of type `Callback`,
+  // `Int16Callback` or `FloatCallback`.
+  // @param window_samples The number of samples in each window.
+  // @param hop_samples The number of samples between the starts of two
+  // consecutive windows.
+  // @param sample_rate The sample rate of the samples given to `fn`.
+  // @return A unique id for the callback function, or -1 if
+  // `window_samples` or `hop_samples` is 0 or the service can't produce
+  // `sample_rate`.
+  template <typename Fn>
+  int AddWindowCallback(void* ctx, Fn fn, size_t window_samples,
+                        size_t hop_samples, AudioSampleRate sample_rate) {
+    if (!window_samples || !hop_samples) return -1;
+    return AddCallback(ctx, FormatOf(fn), reinterpret_cast<Callback>(fn),
+                       sample_rate, window_samples, hop_samples);
+  }
 
   // Removes a callback function.
   //
@@ -290,6 +454,14 @@ class AudioService {
   const AudioDriverConfig& Config() const { return config_; }
 
  private:
+  static constexpr Format FormatOf(Callback) { return Format::kInt32; }
+  static constexpr Format FormatOf(Int16Callback) { return Format::kInt16; }
+  static constexpr Format FormatOf(FloatCallback) { return Format::kFloat; }
+
+  int AddCallback(void* ctx, Format format, Callback fn,
+                  AudioSampleRate sample_rate, size_t window = 0,
+                  size_t hop = 0);
+
   AudioDriver* driver_;
   AudioDriverConfig config_;
   int drop_first_samples_;
@@ -372,9 +544,15 @@ class LatestSamples {
   // @param num_samples The number of audio samples to add from the buffer.
   void Append(const int32_t* samples, size_t num_samples) {
     MutexLock lock(mutex_);
-    for (size_t i = 0; i < num_samples; ++i)
-      samples_[(pos_ + i) % samples_.size()] = samples[i];
-    pos_ = (pos_ + num_samples) % samples_.size();
+    const size_t size = samples_.size();
+    if (num_samples > size) {
+      samples += num_samples - size;
+      num_samples = size;
+    }
+    const size_t first = std::min(num_samples, size - pos_);
+    std::copy(samples, samples + first, samples_.begin() + pos_);
+    std::copy(samples + first, samples + num_samples, samples_.begin());
+    pos_ = (pos_ + num_samples) % size;
   }
 
   // Gets the latest samples without a copy and applies a function to them.
@@ -409,6 +587,114 @@ class LatestSamples {
   std::vector<int32_t> samples_;  // protected by mutex_;
 };
 
+// A read-only view of samples saved in a `SampleRing`, in chronological
+// order. Because the view can wrap around the end of the ring, the samples
+// are split into two contiguous spans: all of `first` comes before `second`.
+struct SampleView {
+  // The oldest samples.
+  const int32_t* first = nullptr;
+  // The number of samples in `first`.
+  size_t first_size = 0;
+  // The newest samples, may be empty.
+  const int32_t* second = nullptr;
+  // The number of samples in `second`.
+  size_t second_size = 0;
+  // @cond
+  // Stream position of the first sample, checked by `SampleRing::IsValid()`.
+  uint32_t start = 0;
+  // @endcond
+
+  // Gets the total number of samples in the view.
+  size_t Size() const { return first_size + second_size; }
+};
+
+// Provides a lock-free alternative to `LatestSamples` for one producer, such
+// as an `AudioService` callback, and any number of readers.
+//
+// The producer copies samples in with `Append()` and never waits for readers.
+// Readers get the latest samples as a `SampleView` without copying and
+// without taking a lock. The ring has room for at least twice the requested
+// number of samples, so a view stays intact for at least that much audio
+// time. A reader that might be slower can check `IsValid()` when it's done
+// and retry if the producer wrapped around into the view:
+//
+// ```
+// SampleRing ring(MsToSamples(AudioSampleRate::k16000_Hz, 1000));
+// service->AddCallback(
+//     &ring, +[](void* ctx, const int32_t* samples, size_t num_samples) {
+//         static_cast<SampleRing*>(ctx)->Append(samples, num_samples);
+//         return true;
+//     });
+// ...
+// SampleView view;
+// do {
+//   view = ring.View();
+//   Process(view.first, view.first_size);
+//   Process(view.second, view.second_size);
+// } while (!ring.IsValid(view));
+// ```
+//
+// For a complete example, see `examples/classify_audio/`.
+class SampleRing {
+ public:
+  // Constructor.
+  //
+  // @param num_samples Number of latest samples returned by `View()`.
+  explicit SampleRing(size_t num_samples);
+  // @cond
+  SampleRing(const SampleRing&) = delete;
+  SampleRing& operator=(const SampleRing&) = delete;
+  // @endcond
+
+  // Gets the number of samples returned by `View()` once the ring is full.
+  //
+  // @return The number of samples per view.
+  size_t NumSamples() const { return num_samples_; }
+
+  // Gets the number of samples the ring holds, a power of two.
+  //
+  // @return The ring capacity in samples.
+  size_t Capacity() const { return samples_.size(); }
+
+  // Adds new audio samples. Must only be called from one task.
+  //
+  // @param samples A pointer to the samples to add.
+  // @param num_samples The number of audio samples to add.
+  void Append(const int32_t* samples, size_t num_samples);
+
+  // Gets the latest `NumSamples()` samples without a copy. Until enough
+  // samples have been appended, the view holds all of them.
+  //
+  // @return A view of the latest samples.
+  SampleView View() const { return View(num_samples_); }
+
+  // Gets the latest samples without a copy.
+  //
+  // @param num_samples The maximum number of samples to view, at most
+  // `NumSamples()`.
+  // @return A view of the latest samples.
+  SampleView View(size_t num_samples) const;
+
+  // Checks that the producer hasn't overwritten any sample in a view. Call
+  // this after you have read the samples.
+  //
+  // @param view A view returned by `View()`.
+  // @return True if the samples read from `view` were intact, false if you
+  // should get a new view and read it again.
+  bool IsValid(const SampleView& view) const;
+
+ private:
+  std::vector<int32_t> samples_;
+  size_t num_samples_;
+  uint32_t mask_;
+  // Stream position up to which the producer may be writing.
+  std::atomic<uint32_t> claimed_{0};
+  // Stream position up to which samples are complete.
+  std::atomic<uint32_t> written_{0};
+  // Number of valid samples in the ring, at most `Capacity()`.
+  std::atomic<uint32_t> filled_{0};
+};
+
 }  // namespace coralmicro
 
 #endif  // LIBS_AUDIO_AUDIO_SERVICE_H_
@@ -18,6 +18,8 @@
 
 #include "libs/base/check.h"
 #include "libs/base/gpio.h"
+#include "libs/base/mutex.h"
+#include "libs/base/timer.h"
 #include "libs/pmic/pmic.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_csi.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_lpi2c.h"
@@ -29,11 +31,14 @@
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/cm4/fsl_cache.h"
 #endif
 
+#include <algorithm>
 #include <cstring>
-#include <memory>
+#include <utility>
 
 namespace coralmicro {
 namespace {
+static_assert(CameraFrameScratch::kRowWidth == CameraTask::kWidth,
+              "Row cache must hold a native row");
 constexpr uint8_t kCameraAddress = 0x24;
 constexpr int kFramebufferCount = 4;
 constexpr float kRedCoefficient = .2126;
@@ -119,6 +124,38 @@ uint8_t* IndexToFramebufferPtr(int index) {
   return reinterpret_cast<uint8_t*>(framebuffers[index]);
 }
 
+// Frame metadata, written by the CSI interrupt before the framebuffer can be
+// fetched.
+struct FrameTracker {
+  CameraFrameInfo info[kFramebufferCount];
+  // Every frame the sensor sent, from the CSI frame counter.
+  volatile uint32_t sequence;
+  // The last value of the 16-bit CSI frame counter.
+  volatile uint16_t last_count;
+  // Frames stored in a framebuffer.
+  volatile uint32_t stored;
+  volatile uint32_t discarded;
+};
+FrameTracker frame_tracker;
+
+// The CSI frame counter register is named differently across SDK versions.
+#if defined(CSI_CR3_FRMCNT_MASK)
+constexpr uint32_t kFrameCountMask = CSI_CR3_FRMCNT_MASK;
+constexpr uint32_t kFrameCountShift = CSI_CR3_FRMCNT_SHIFT;
+constexpr uint32_t kFrameCountResetMask = CSI_CR3_FRMCNT_RST_MASK;
+#else
+constexpr uint32_t kFrameCountMask = CSI_CSICR3_FRMCNT_MASK;
+constexpr uint32_t kFrameCountShift = CSI_CSICR3_FRMCNT_SHIFT;
+constexpr uint32_t kFrameCountResetMask = CSI_CSICR3_FRMCNT_RST_MASK;
+#endif
+
+void ResetFrameCount() {
+  CSI_REG_CR3(CSI) |= kFrameCountResetMask;
+  while (CSI_REG_CR3(CSI) & kFrameCountResetMask) {
+  }
+  frame_tracker.last_count = 0;
+}
+
 int FramebufferPtrToIndex(const uint8_t* framebuffer_ptr) {
   for (int i = 0; i < kFramebufferCount; ++i) {
     if (reinterpret_cast<uint8_t*>(framebuffers[i]) == framebuffer_ptr) {
@@ -128,308 +165,525 @@ int FramebufferPtrToIndex(const uint8_t* framebuffer_ptr) {
   return -1;
 }
 
-void ResizeNearestNeighbor(const uint8_t* src, int src_w, int src_h,
-                           uint8_t* dst, int dst_w, int dst_h, int comps,
-                           bool preserve_aspect) {
-  int src_p = src_w * comps;
-  int dst_p = dst_w * comps;
-  float ratio_src = (float)src_w / src_h;
-  float ratio_dst = (float)dst_w / dst_h;
-  int scaled_w =
-      preserve_aspect
-          ? (ratio_dst > ratio_src ? src_w * (float)dst_h / src_h : dst_w)
-          : dst_w;
-  int scaled_h =
-      preserve_aspect
-          ? (ratio_dst > ratio_src ? dst_h : src_h * (float)dst_w / src_w)
-          : dst_h;
-  float ratio_x = (float)src_w / scaled_w;
-  float ratio_y = (float)src_h / scaled_h;
-
-  for (int y = 0; y < dst_h; y++) {
-    if (y >= scaled_h) {
-      std::memset(dst, 0, dst_p);
-      dst += dst_p;
-      continue;
+// Demosaics the single sensor pixel at (x, y), producing exactly the value
+// the full-frame demosaic produces there. Returns false for the border
+// pixels that the demosaic never writes (these are left black).
+template <CameraFilterMethod Filter>
+inline bool DemosaicPixel(const uint8_t* camera_raw, int x, int y,
+                          uint8_t* rgb) {
+  constexpr int kStride = CameraTask::kWidth;
+  if (y < 2 || y >= static_cast<int>(CameraTask::kHeight) - 2) return false;
+  const bool odd_row = y & 1;
+
+  if (Filter == CameraFilterMethod::kNearestNeighbor) {
+    // Pixels are produced in pairs starting at column 2 on even rows and
+    // column 3 on odd rows.
+    if (x < 2 + odd_row || x >= kStride - 2 + odd_row) return false;
+    const bool first = (x & 1) == odd_row;
+    const uint8_t* row = camera_raw + y * kStride + (first ? x : x - 1);
+    const uint8_t* next_row = row + kStride;
+    if (!odd_row) {
+      rgb[0] = next_row[1];
+      rgb[1] = first ? row[1] : next_row[2];
+      rgb[2] = first ? row[0] : row[2];
+    } else {
+      rgb[0] = first ? row[0] : row[2];
+      rgb[1] = first ? row[1] : next_row[2];
+      rgb[2] = next_row[1];
     }
+    return true;
+  }
 
-    int offset_y = static_cast<int>(y * ratio_y) * src_p;
-    for (int x = 0; x < dst_w; x++) {
-      int offset_x = static_cast<int>(x * ratio_x) * comps;
-      const uint8_t* src_y = src + offset_y;
-      for (int i = 0; i < comps; i++) {
-        *dst++ = x < scaled_w ? src_y[offset_x + i] : 0;
-      }
-    }
+  // Bilinear: output row y is centered on sensor row y - 1.
+  if (x < 1 || x >= kStride - 1) return false;
+  const uint8_t* c = camera_raw + (y - 1) * kStride + x;
+  if ((x + y) & 1) {
+    uint8_t diag = (static_cast<uint32_t>(c[-kStride - 1]) +
+                    static_cast<uint32_t>(c[-kStride + 1]) +
+                    static_cast<uint32_t>(c[kStride - 1]) +
+                    static_cast<uint32_t>(c[kStride + 1]) + 2) >>
+                   2;
+    rgb[1] = (static_cast<uint32_t>(c[-kStride]) +
+              static_cast<uint32_t>(c[-1]) + static_cast<uint32_t>(c[1]) +
+              static_cast<uint32_t>(c[kStride]) + 2) >>
+             2;
+    rgb[0] = odd_row ? diag : c[0];
+    rgb[2] = odd_row ? c[0] : diag;
+  } else {
+    uint8_t vert = (static_cast<uint32_t>(c[-kStride]) +
+                    static_cast<uint32_t>(c[kStride]) + 1) >>
+                   1;
+    uint8_t horiz =
+        (static_cast<uint32_t>(c[-1]) + static_cast<uint32_t>(c[1]) + 1) >> 1;
+    rgb[0] = odd_row ? vert : horiz;
+    rgb[1] = c[0];
+    rgb[2] = odd_row ? horiz : vert;
   }
+  return true;
 }
 
-template <typename Callback>
-void BayerInternal(const uint8_t* camera_raw, int width, int height,
-                   CameraFilterMethod filter, Callback callback) {
-  if (filter == CameraFilterMethod::kNearestNeighbor) {
-    bool blue = true, green = false;
-    for (int y = 2; y < height - 2; y++) {
-      int start = green ? 3 : 2;
-      for (int x = start; x < width - 2; x += 2) {
-        int g1x = x + 1, g1y = y;
-        int g2x = x + 2, g2y = y + 1;
-        int r1x, r1y, r2x, r2y;
-        int b1x, b1y, b2x, b2y;
-        if (blue) {
-          r1x = r2x = x + 1;
-          r1y = r2y = y + 1;
-          b1x = x;
-          b1y = y;
-          b2x = x + 2;
-          b2y = y;
-        } else {
-          r1x = x;
-          r1y = y;
-          r2x = x + 2;
-          r2y = y;
-          b1x = b2x = x + 1;
-          b1y = b2y = y + 1;
-        }
-        uint8_t r1 = camera_raw[r1x + (r1y * width)];
-        uint8_t g1 = camera_raw[g1x + (g1y * width)];
-        uint8_t b1 = camera_raw[b1x + (b1y * width)];
-        uint8_t r2 = camera_raw[r2x + (r2y * width)];
-        uint8_t g2 = camera_raw[g2x + (g2y * width)];
-        uint8_t b2 = camera_raw[b2x + (b2y * width)];
-        callback(x, y, r1, g1, b1);
-        callback(x + 1, y, r2, g2, b2);
-      }
-      blue = !blue;
-      green = !green;
-    }
-  } else if (filter == CameraFilterMethod::kBilinear) {
-    int bayer_stride = width;
-
-    size_t bayer_offset = 0;
-    for (int y = 2; y < height - 2; y++) {
-      bool odd_row = y & 1;
-      int x = 1;
-      size_t bayer_end = bayer_offset + (width - 2);
-
-      if (odd_row) {
-        uint8_t r = (static_cast<uint32_t>(camera_raw[bayer_offset + 1]) +
-                     static_cast<uint32_t>(
-                         camera_raw[bayer_offset + (bayer_stride * 2 + 1)]) +
-                     1) >>
-                    1;
-        uint8_t b =
-            (static_cast<uint32_t>(camera_raw[bayer_offset + bayer_stride]) +
-             static_cast<uint32_t>(
-                 camera_raw[bayer_offset + (bayer_stride + 2)]) +
-             1) >>
-            1;
-        uint8_t g = camera_raw[bayer_offset + (bayer_stride + 1)];
-        callback(x, y, r, g, b);
-        bayer_offset += 1;
-        ++x;
-      }
+// Weighted, squared channel values that are summed to form a gray pixel.
+// The float tables use the same single-precision operations as computing
+// each term per pixel, so their sum is identical. The fixed-point tables
+// hold the same terms scaled by 2^16 and rounded.
+struct LumaTables {
+  float r[256];
+  float g[256];
+  float b[256];
+  uint32_t r_fixed[256];
+  uint32_t g_fixed[256];
+  uint32_t b_fixed[256];
+};
 
-      while (bayer_offset <= (bayer_end - 2)) {
-        uint8_t r1 = 0, g1 = 0, b1 = 0, r2 = 0, g2 = 0, b2 = 0;
-        uint8_t t0 = (static_cast<uint32_t>(camera_raw[bayer_offset]) +
-                      static_cast<uint32_t>(camera_raw[bayer_offset + 2]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2)]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2 + 2)]) +
-                      2) >>
-                     2;
-        g1 = (static_cast<uint32_t>(camera_raw[bayer_offset + 1]) +
-              static_cast<uint32_t>(camera_raw[bayer_offset + bayer_stride]) +
-              static_cast<uint32_t>(
-                  camera_raw[bayer_offset + (bayer_stride + 2)]) +
-              static_cast<uint32_t>(
-                  camera_raw[bayer_offset + (bayer_stride * 2 + 1)]) +
-              2) >>
-             2;
-        uint8_t t1 = (static_cast<uint32_t>(camera_raw[bayer_offset + 2]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2 + 2)]) +
-                      1) >>
-                     1;
-        uint8_t t2 = (static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride + 1)]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride + 3)]) +
-                      1) >>
-                     1;
-        uint8_t t3 = camera_raw[bayer_offset + (bayer_stride + 1)];
-        g2 = camera_raw[bayer_offset + (bayer_stride + 2)];
-        if (odd_row) {
-          r1 = t0;
-          b1 = t3;
-
-          r2 = t1;
-          b2 = t2;
-        } else {
-          b1 = t0;
-          r1 = t3;
-
-          b2 = t1;
-          r2 = t2;
-        }
-        callback(x, y, r1, g1, b1);
-        callback(x + 1, y, r2, g2, b2);
-        bayer_offset += 2;
-        x += 2;
-      }
+constexpr int kLumaFixedShift = 16;
 
-      while (bayer_offset < bayer_end) {
-        uint8_t t0 = (static_cast<uint32_t>(camera_raw[bayer_offset]) +
-                      static_cast<uint32_t>(camera_raw[bayer_offset + 2]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2)]) +
-                      static_cast<uint32_t>(
-                          camera_raw[bayer_offset + (bayer_stride * 2 + 2)]) +
-                      2) >>
-                     2;
-        uint8_t g =
-            (static_cast<uint32_t>(camera_raw[bayer_offset + 1]) +
-             static_cast<uint32_t>(camera_raw[bayer_offset + bayer_stride]) +
-             static_cast<uint32_t>(
-                 camera_raw[bayer_offset + (bayer_stride + 2)]) +
-             static_cast<uint32_t>(
-                 camera_raw[bayer_offset + (bayer_stride * 2 + 1)]) +
-             2) >>
-            2;
-        uint8_t t1 = camera_raw[bayer_offset + bayer_stride + 1];
-        if (odd_row) {
-          callback(x, y, t0, g, t1);
-        } else {
-          callback(x, y, t1, g, t0);
-        }
-        bayer_offset += 1;
-        ++x;
-      }
+constexpr uint32_t LumaFixed(float coefficient, int v) {
+  return static_cast<uint32_t>(static_cast<double>(coefficient) * v * v /
+                                   kUint8Max * (1 << kLumaFixedShift) +
+                               0.5);
+}
 
-      bayer_offset += 2;
-    }
+constexpr LumaTables MakeLumaTables() {
+  LumaTables tables{};
+  for (int v = 0; v < 256; ++v) {
+    float v_f = static_cast<float>(v) / kUint8Max;
+    tables.r[v] = kRedCoefficient * v_f * v_f;
+    tables.g[v] = kGreenCoefficient * v_f * v_f;
+    tables.b[v] = kBlueCoefficient * v_f * v_f;
+    tables.r_fixed[v] = LumaFixed(kRedCoefficient, v);
+    tables.g_fixed[v] = LumaFixed(kGreenCoefficient, v);
+    tables.b_fixed[v] = LumaFixed(kBlueCoefficient, v);
   }
+  return tables;
 }
 
-void RotateXY(CameraRotation rotation, int in_x, int in_y, int* out_x,
-              int* out_y) {
-  CHECK(out_x);
-  CHECK(out_y);
+constexpr LumaTables kLumaTables = MakeLumaTables();
 
-  // Short-circuit for no rotation
-  if (rotation == CameraRotation::k0) {
-    *out_x = in_x;
-    *out_y = in_y;
-    return;
+template <CameraPrecision Precision>
+inline uint8_t RgbToGray(uint8_t r, uint8_t g, uint8_t b) {
+  if (Precision == CameraPrecision::kFixedPoint) {
+    return (kLumaTables.r_fixed[r] + kLumaTables.g_fixed[g] +
+            kLumaTables.b_fixed[b]) >>
+           kLumaFixedShift;
+  }
+  return static_cast<uint8_t>(
+      (kLumaTables.r[r] + kLumaTables.g[g] + kLumaTables.b[b]) * kUint8Max);
+}
+
+// Per-axis lookup tables mapping each destination pixel of a
+// `CameraFrameFormat` to the sensor pixel it samples, with both the
+// nearest-neighbor resize and the rotation folded in. Entries of -1 mark
+// destination pixels outside of the scaled image (letterboxing).
+//
+// For k0 and k180 the destination column selects the sensor column; for k90
+// and k270 the axes are swapped and the destination column selects the sensor
+// row instead. The tables live in the caller's `CameraFrameScratch`.
+struct SensorMap {
+  const int16_t* cols;
+  const int16_t* rows;
+  bool transposed;
+};
+
+// Gets the region of the rotated, native-size image that `fmt` resizes into
+// its output.
+CameraCropRect SourceRect(const CameraFrameFormat& fmt) {
+  if (fmt.crop.width == 0 && fmt.crop.height == 0) {
+    return {0, 0, static_cast<int>(CameraTask::kWidth),
+            static_cast<int>(CameraTask::kHeight)};
+  }
+  return fmt.crop;
+}
+
+// Computes the size of the image within `fmt`, which is smaller than the
+// output when `preserve_ratio` letterboxes it.
+void ScaledSize(const CameraFrameFormat& fmt, int* scaled_w, int* scaled_h) {
+  const CameraCropRect src = SourceRect(fmt);
+  const int kSrcW = src.width;
+  const int kSrcH = src.height;
+  float ratio_src = (float)kSrcW / kSrcH;
+  float ratio_dst = (float)fmt.width / fmt.height;
+  *scaled_w = fmt.preserve_ratio ? (ratio_dst > ratio_src
+                                        ? kSrcW * (float)fmt.height / kSrcH
+                                        : fmt.width)
+                                 : fmt.width;
+  *scaled_h = fmt.preserve_ratio ? (ratio_dst > ratio_src
+                                        ? fmt.height
+                                        : kSrcH * (float)fmt.width / kSrcW)
+                                 : fmt.height;
+}
+
+SensorMap BuildSensorMap(const CameraFrameFormat& fmt,
+                         CameraFrameScratch* scratch) {
+  const CameraCropRect src = SourceRect(fmt);
+  int scaled_w, scaled_h;
+  ScaledSize(fmt, &scaled_w, &scaled_h);
+  float ratio_x = (float)src.width / scaled_w;
+  float ratio_y = (float)src.height / scaled_h;
+
+  const bool transposed = fmt.rotation == CameraRotation::k90 ||
+                          fmt.rotation == CameraRotation::k270;
+  // Mirrored coordinates follow the rotation about the image center: a
+  // rotated coordinate c maps back to kWidth / 2 + kHeight / 2 - c.
+  constexpr int kMirror = CameraTask::kWidth / 2 + CameraTask::kHeight / 2;
+  const bool mirror_cols = fmt.rotation == CameraRotation::k90 ||
+                           fmt.rotation == CameraRotation::k180;
+  const bool mirror_rows = fmt.rotation == CameraRotation::k180 ||
+                           fmt.rotation == CameraRotation::k270;
+  for (int x = 0; x < fmt.width; ++x) {
+    int c = src.x + static_cast<int>(x * ratio_x);
+    scratch->cols[x] = x < scaled_w ? (mirror_cols ? kMirror - c : c) : -1;
+  }
+  for (int y = 0; y < fmt.height; ++y) {
+    int r = src.y + static_cast<int>(y * ratio_y);
+    scratch->rows[y] = y < scaled_h ? (mirror_rows ? kMirror - r : r) : -1;
   }
+  return {scratch->cols, scratch->rows, transposed};
+}
+
+// Walks the destination pixels once, demosaicing only the sensor pixels
+// that are actually sampled and handing each RGB triple to `write`.
+template <CameraFilterMethod Filter, bool Transposed, typename Writer>
+void SampleNearest(const uint8_t* camera_raw, const SensorMap& map, int width,
+                   int height, Writer write) {
+  for (int y = 0; y < height; ++y) {
+    const int row = map.rows[y];
+    for (int x = 0; x < width; ++x) {
+      const int col = map.cols[x];
+      uint8_t rgb[3] = {0, 0, 0};
+      if (row >= 0 && col >= 0) {
+        DemosaicPixel<Filter>(camera_raw, Transposed ? row : col,
+                              Transposed ? col : row, rgb);
+      }
+      write(rgb);
+    }
+  }
+}
 
-  // Shift our coordinates so that the center of the image is 0,0
-  in_x = in_x - (CameraTask::kWidth / 2);
-  in_y = in_y - (CameraTask::kHeight / 2);
+// Maps coordinates (u, v) of the rotated, native-size image to sensor
+// coordinates (x0 + u * du_x + v * dv_x, y0 + u * du_y + v * dv_y). This is
+// the same mapping `BuildSensorMap()` folds into its tables.
+struct RotatedToSensor {
+  int x0, y0;
+  int du_x, du_y;
+  int dv_x, dv_y;
+};
 
-  // Simple rotation around origin
+RotatedToSensor GetRotatedToSensor(CameraRotation rotation) {
+  constexpr int kMirror = CameraTask::kWidth / 2 + CameraTask::kHeight / 2;
   switch (rotation) {
     case CameraRotation::k90:
-      *out_x = -in_y;
-      *out_y = in_x;
-      break;
+      return {0, kMirror, 0, -1, 1, 0};
     case CameraRotation::k180:
-      *out_x = -in_x;
-      *out_y = -in_y;
-      break;
+      return {kMirror, kMirror, -1, 0, 0, -1};
     case CameraRotation::k270:
-      *out_x = in_y;
-      *out_y = -in_x;
-      break;
+      return {kMirror, 0, 0, 1, -1, 0};
     case CameraRotation::k0:
     default:
-      CHECK(false);
-  }
-
-  // Undo coordinate space shift
-  *out_x = *out_x + (CameraTask::kWidth / 2);
-  *out_y = *out_y + (CameraTask::kHeight / 2);
-  CHECK(*out_x >= 0);
-  CHECK(*out_x < static_cast<int>(CameraTask::kWidth));
-  CHECK(*out_y >= 0);
-  CHECK(*out_y < static_cast<int>(CameraTask::kHeight));
-}
-
-void BayerToRgb(const uint8_t* camera_raw, uint8_t* camera_rgb, int width,
-                int height, CameraFilterMethod filter,
-                CameraRotation rotation) {
-  std::memset(camera_rgb, 0, width * height * 3);
-  BayerInternal(camera_raw, width, height, filter,
-                [camera_rgb, width, height, rotation](int x, int y, uint8_t r,
-                                                      uint8_t g, uint8_t b) {
-                  int rot_x, rot_y;
-                  RotateXY(rotation, x, y, &rot_x, &rot_y);
-                  camera_rgb[(rot_x * 3) + (rot_y * width * 3) + 0] = r;
-                  camera_rgb[(rot_x * 3) + (rot_y * width * 3) + 1] = g;
-                  camera_rgb[(rot_x * 3) + (rot_y * width * 3) + 2] = b;
-                });
-}
-
-void BayerToGrayscale(const uint8_t* camera_raw, uint8_t* camera_grayscale,
-                      int width, int height, CameraFilterMethod filter,
-                      CameraRotation rotation) {
-  BayerInternal(camera_raw, width, height, filter,
-                [camera_grayscale, width, height, rotation](
-                    int x, int y, uint8_t r, uint8_t g, uint8_t b) {
-                  int rot_x, rot_y;
-                  RotateXY(rotation, x, y, &rot_x, &rot_y);
-                  float r_f = static_cast<float>(r) / kUint8Max;
-                  float g_f = static_cast<float>(g) / kUint8Max;
-                  float b_f = static_cast<float>(b) / kUint8Max;
-                  camera_grayscale[rot_x + (rot_y * width)] =
-                      static_cast<uint8_t>(((kRedCoefficient * r_f * r_f) +
-                                            (kGreenCoefficient * g_f * g_f) +
-                                            (kBlueCoefficient * b_f * b_f)) *
-                                           kUint8Max);
-                });
+      return {0, 0, 1, 0, 0, 1};
+  }
+}
+
+// Caches the two most recently used rows of the rotated image in
+// `CameraFrameScratch::row_cache` so that each row is demosaiced at most once
+// while it is needed.
+template <CameraFilterMethod Filter>
+class RotatedRowCache {
+ public:
+  // Only columns [`col_begin`, `col_end`) of each row are demosaiced.
+  RotatedRowCache(const uint8_t* camera_raw, CameraRotation rotation,
+                  int col_begin, int col_end, CameraFrameScratch* scratch)
+      : camera_raw_(camera_raw),
+        map_(GetRotatedToSensor(rotation)),
+        col_begin_(col_begin),
+        col_end_(col_end),
+        scratch_(scratch) {}
+
+  // Gets rows `v` and `v + 1` (clamped to the last row).
+  void Get(int v, const uint8_t** top, const uint8_t** bottom) {
+    const int next = v + (v < static_cast<int>(CameraTask::kHeight) - 1);
+    int top_slot = Find(v);
+    if (top_slot < 0) {
+      top_slot = Find(next) == 0 ? 1 : 0;
+      Fill(v, top_slot);
+    }
+    int bottom_slot = Find(next);
+    if (bottom_slot < 0) {
+      bottom_slot = 1 - top_slot;
+      Fill(next, bottom_slot);
+    }
+    *top = scratch_->row_cache[top_slot];
+    *bottom = scratch_->row_cache[bottom_slot];
+  }
+
+ private:
+  int Find(int v) const { return rows_[0] == v ? 0 : rows_[1] == v ? 1 : -1; }
+
+  void Fill(int v, int slot) {
+    uint8_t* rgb = scratch_->row_cache[slot] + col_begin_ * 3;
+    int x = map_.x0 + col_begin_ * map_.du_x + v * map_.dv_x;
+    int y = map_.y0 + col_begin_ * map_.du_y + v * map_.dv_y;
+    for (int u = col_begin_; u < col_end_; ++u) {
+      rgb[0] = rgb[1] = rgb[2] = 0;
+      DemosaicPixel<Filter>(camera_raw_, x, y, rgb);
+      rgb += 3;
+      x += map_.du_x;
+      y += map_.du_y;
+    }
+    rows_[slot] = v;
+  }
+
+  const uint8_t* camera_raw_;
+  RotatedToSensor map_;
+  int col_begin_;
+  int col_end_;
+  CameraFrameScratch* scratch_;
+  int rows_[2] = {-1, -1};
+};
+
+// Fills `index` with the first of the two source pixels each output pixel
+// interpolates between and `weight` with the distance to the second, in
+// 1/256ths. Samples are taken at pixel centers of the source range
+// [`src_begin`, `src_begin + src_size`).
+void BuildBilinearAxis(int dst_size, int scaled_size, int src_begin,
+                       int src_size, int16_t* index, uint8_t* weight) {
+  for (int i = 0; i < dst_size; ++i) {
+    if (i >= scaled_size) {
+      index[i] = -1;
+      weight[i] = 0;
+      continue;
+    }
+    // (i + 0.5) * src_size / scaled_size - 0.5, in 1/256ths.
+    int pos = (2 * i + 1) * src_size * 128 / scaled_size - 128;
+    pos = std::min(std::max(pos, 0), (src_size - 1) << 8);
+    index[i] = src_begin + (pos >> 8);
+    weight[i] = pos & 0xFF;
+  }
+}
+
+template <CameraFilterMethod Filter, typename Writer>
+void SampleBilinear(const uint8_t* camera_raw, const CameraFrameFormat& fmt,
+                    int scaled_w, int scaled_h, CameraFrameScratch* scratch,
+                    Writer write) {
+  constexpr int kSrcW = CameraTask::kWidth;
+  const CameraCropRect src = SourceRect(fmt);
+  BuildBilinearAxis(fmt.width, scaled_w, src.x, src.width, scratch->cols,
+                    scratch->col_weights);
+  BuildBilinearAxis(fmt.height, scaled_h, src.y, src.height, scratch->rows,
+                    scratch->row_weights);
+  // The last column may be interpolated with the one after it.
+  RotatedRowCache<Filter> cache(camera_raw, fmt.rotation, src.x,
+                                std::min(src.x + src.width + 1, kSrcW),
+                                scratch);
+  const uint8_t kBlack[3] = {0, 0, 0};
+  for (int y = 0; y < fmt.height; ++y) {
+    const int row = scratch->rows[y];
+    if (row < 0) {
+      for (int x = 0; x < fmt.width; ++x) write(kBlack);
+      continue;
+    }
+    const uint8_t* top;
+    const uint8_t* bottom;
+    cache.Get(row, &top, &bottom);
+    const uint32_t wy = scratch->row_weights[y];
+    for (int x = 0; x < fmt.width; ++x) {
+      const int col = scratch->cols[x];
+      if (col < 0) {
+        write(kBlack);
+        continue;
+      }
+      const int c0 = col * 3;
+      const int c1 = c0 + (col < kSrcW - 1 ? 3 : 0);
+      const uint32_t wx = scratch->col_weights[x];
+      uint8_t rgb[3];
+      for (int i = 0; i < 3; ++i) {
+        uint32_t t = top[c0 + i] * (256 - wx) + top[c1 + i] * wx;
+        uint32_t b = bottom[c0 + i] * (256 - wx) + bottom[c1 + i] * wx;
+        rgb[i] = (t * (256 - wy) + b * wy + (1 << 15)) >> 16;
+      }
+      write(rgb);
+    }
+  }
+}
+
+// Fills `index` with the first source pixel covered by each output pixel.
+// The last one covered is one before the next output pixel's first.
+void BuildAreaAxis(int dst_size, int scaled_size, int src_begin, int src_size,
+                   int16_t* index) {
+  for (int i = 0; i < dst_size; ++i) {
+    index[i] =
+        i < scaled_size ? src_begin + i * src_size / scaled_size : -1;
+  }
+}
+
+template <CameraFilterMethod Filter, typename Writer>
+void SampleArea(const uint8_t* camera_raw, const CameraFrameFormat& fmt,
+                int scaled_w, int scaled_h, CameraFrameScratch* scratch,
+                Writer write) {
+  const CameraCropRect src = SourceRect(fmt);
+  BuildAreaAxis(fmt.width, scaled_w, src.x, src.width, scratch->cols);
+  BuildAreaAxis(fmt.height, scaled_h, src.y, src.height, scratch->rows);
+  const RotatedToSensor map = GetRotatedToSensor(fmt.rotation);
+  const uint8_t kBlack[3] = {0, 0, 0};
+  for (int y = 0; y < fmt.height; ++y) {
+    const int v0 = scratch->rows[y];
+    if (v0 < 0) {
+      for (int x = 0; x < fmt.width; ++x) write(kBlack);
+      continue;
+    }
+    const int v1 =
+        y + 1 < scaled_h ? scratch->rows[y + 1] : src.y + src.height;
+    for (int x = 0; x < fmt.width; ++x) {
+      const int u0 = scratch->cols[x];
+      if (u0 < 0) {
+        write(kBlack);
+        continue;
+      }
+      const int u1 =
+          x + 1 < scaled_w ? scratch->cols[x + 1] : src.x + src.width;
+      uint32_t sum[3] = {0, 0, 0};
+      for (int v = v0; v < v1; ++v) {
+        int sx = map.x0 + u0 * map.du_x + v * map.dv_x;
+        int sy = map.y0 + u0 * map.du_y + v * map.dv_y;
+        for (int u = u0; u < u1; ++u) {
+          uint8_t px[3] = {0, 0, 0};
+          DemosaicPixel<Filter>(camera_raw, sx, sy, px);
+          sum[0] += px[0];
+          sum[1] += px[1];
+          sum[2] += px[2];
+          sx += map.du_x;
+          sy += map.du_y;
+        }
+      }
+      const uint32_t n = (v1 - v0) * (u1 - u0);
+      const uint8_t rgb[3] = {static_cast<uint8_t>((sum[0] + n / 2) / n),
+                              static_cast<uint8_t>((sum[1] + n / 2) / n),
+                              static_cast<uint8_t>((sum[2] + n / 2) / n)};
+      write(rgb);
+    }
+  }
+}
+
+template <CameraFilterMethod Filter, typename Writer>
+void SampleBayer(const uint8_t* camera_raw, const CameraFrameFormat& fmt,
+                 CameraFrameScratch* scratch, Writer write) {
+  const CameraCropRect src = SourceRect(fmt);
+  int scaled_w, scaled_h;
+  ScaledSize(fmt, &scaled_w, &scaled_h);
+  // Without scaling every method samples each source pixel exactly.
+  if (fmt.resize == CameraResizeMethod::kNearestNeighbor ||
+      (scaled_w == src.width && scaled_h == src.height)) {
+    const SensorMap map = BuildSensorMap(fmt, scratch);
+    if (map.transposed) {
+      SampleNearest<Filter, true>(camera_raw, map, fmt.width, fmt.height,
+                                  write);
+    } else {
+      SampleNearest<Filter, false>(camera_raw, map, fmt.width, fmt.height,
+                                   write);
+    }
+    return;
+  }
+  // Area averaging needs at least one source pixel per output pixel.
+  if (fmt.resize == CameraResizeMethod::kArea && scaled_w <= src.width &&
+      scaled_h <= src.height) {
+    SampleArea<Filter>(camera_raw, fmt, scaled_w, scaled_h, scratch, write);
+  } else {
+    SampleBilinear<Filter>(camera_raw, fmt, scaled_w, scaled_h, scratch,
+                           write);
+  }
+}
+
+template <typename Writer>
+void SampleBayer(const uint8_t* camera_raw, const CameraFrameFormat& fmt,
+                 CameraFrameScratch* scratch, Writer write) {
+  if (fmt.filter == CameraFilterMethod::kNearestNeighbor) {
+    SampleBayer<CameraFilterMethod::kNearestNeighbor>(camera_raw, fmt, scratch,
+                                                      write);
+  } else {
+    SampleBayer<CameraFilterMethod::kBilinear>(camera_raw, fmt, scratch,
+                                               write);
+  }
+}
+
+// Demosaics, rotates and resizes the raw frame into `fmt.buffer` in a single
+// pass over the destination pixels.
+void BayerToRgbResized(const uint8_t* camera_raw, const CameraFrameFormat& fmt,
+                       CameraFrameScratch* scratch) {
+  uint8_t* dst = fmt.buffer;
+  SampleBayer(camera_raw, fmt, scratch, [&dst](const uint8_t* rgb) {
+    *dst++ = rgb[0];
+    *dst++ = rgb[1];
+    *dst++ = rgb[2];
+  });
+}
+
+template <CameraPrecision Precision>
+void BayerToGrayscaleResized(const uint8_t* camera_raw,
+                             const CameraFrameFormat& fmt,
+                             CameraFrameScratch* scratch) {
+  uint8_t* dst = fmt.buffer;
+  SampleBayer(camera_raw, fmt, scratch, [&dst](const uint8_t* rgb) {
+    *dst++ = RgbToGray<Precision>(rgb[0], rgb[1], rgb[2]);
+  });
+}
+
+void BayerToGrayscaleResized(const uint8_t* camera_raw,
+                             const CameraFrameFormat& fmt,
+                             CameraFrameScratch* scratch) {
+  if (fmt.precision == CameraPrecision::kFixedPoint) {
+    BayerToGrayscaleResized<CameraPrecision::kFixedPoint>(camera_raw, fmt,
+                                                          scratch);
+  } else {
+    BayerToGrayscaleResized<CameraPrecision::kFloat>(camera_raw, fmt, scratch);
+  }
 }
 
+template <CameraPrecision Precision>
 void RgbToGrayscale(const uint8_t* camera_rgb, uint8_t* camera_grayscale,
                     int width, int height) {
-  for (int y = 0; y < height; ++y) {
-    for (int x = 0; x < width; ++x) {
-      float r_f =
-          static_cast<float>(camera_rgb[(x * 3) + (y * width * 3) + 0]) /
-          kUint8Max;
-      float g_f =
-          static_cast<float>(camera_rgb[(x * 3) + (y * width * 3) + 1]) /
-          kUint8Max;
-      float b_f =
-          static_cast<float>(camera_rgb[(x * 3) + (y * width * 3) + 2]) /
-          kUint8Max;
-      camera_grayscale[x + (y * width)] = static_cast<uint8_t>(
-          ((kRedCoefficient * r_f * r_f) + (kGreenCoefficient * g_f * g_f) +
-           (kBlueCoefficient * b_f * b_f)) *
-          kUint8Max);
-    }
+  for (int i = 0; i < width * height; ++i) {
+    camera_grayscale[i] =
+        RgbToGray<Precision>(camera_rgb[i * 3 + 0], camera_rgb[i * 3 + 1],
+                             camera_rgb[i * 3 + 2]);
+  }
+}
+
+void RgbToGrayscale(const uint8_t* camera_rgb, uint8_t* camera_grayscale,
+                    int width, int height, CameraPrecision precision) {
+  if (precision == CameraPrecision::kFixedPoint) {
+    RgbToGrayscale<CameraPrecision::kFixedPoint>(camera_rgb, camera_grayscale,
+                                                 width, height);
+  } else {
+    RgbToGrayscale<CameraPrecision::kFloat>(camera_rgb, camera_grayscale,
+                                            width, height);
   }
 }
 
-void AutoWhiteBalance(uint8_t* camera_rgb, int width, int height) {
+// Per-channel white balance gains in 8.8 fixed point.
+struct WhiteBalanceGains {
+  uint16_t r;
+  uint16_t g;
+  uint16_t b;
+};
+
+WhiteBalanceGains ComputeWhiteBalanceGains(const uint8_t* camera_rgb,
+                                           int width, int height) {
   unsigned int r_sum = 0, g_sum = 0, b_sum = 0;
   float r_sum_f = 0.0, g_sum_f = 0.0, b_sum_f = 0.0;
   float threshold = 0.9f;
-  uint16_t threshold16 = static_cast<uint16_t>(threshold * 255);
-  uint16_t min_rgb, max_rgb;
+  uint32_t threshold16 = static_cast<uint32_t>(threshold * 255);
   for (int i = 0; i < width * height; ++i) {
-    uint8_t r = camera_rgb[i * 3 + 0];
-    uint8_t g = camera_rgb[i * 3 + 1];
-    uint8_t b = camera_rgb[i * 3 + 2];
-    min_rgb = static_cast<uint16_t>(std::min(r, std::min(g, b)));
-    max_rgb = static_cast<uint16_t>(std::max(r, std::max(g, b)));
-    if (((max_rgb - min_rgb) * 255) > (threshold16 * max_rgb)) {
-      continue;
-    }
-    r_sum += r;
-    g_sum += g;
-    b_sum += b;
+    uint32_t r = camera_rgb[i * 3 + 0];
+    uint32_t g = camera_rgb[i * 3 + 1];
+    uint32_t b = camera_rgb[i * 3 + 2];
+    uint32_t min_rgb = std::min(r, std::min(g, b));
+    uint32_t max_rgb = std::max(r, std::max(g, b));
+    // Skip saturated pixels without branching: all ones if the pixel counts,
+    // zero otherwise.
+    uint32_t mask = -static_cast<uint32_t>((max_rgb - min_rgb) * 255 <=
+                                           threshold16 * max_rgb);
+    r_sum += r & mask;
+    g_sum += g & mask;
+    b_sum += b & mask;
   }
   r_sum_f = static_cast<float>(r_sum);
   g_sum_f = static_cast<float>(g_sum);
@@ -439,25 +693,101 @@ void AutoWhiteBalance(uint8_t* camera_rgb, int width, int height) {
   float r_gain_f = r_sum_f < epsilon ? 0.0f : max_channel / r_sum_f;
   float g_gain_f = g_sum_f < epsilon ? 0.0f : max_channel / g_sum_f;
   float b_gain_f = b_sum_f < epsilon ? 0.0f : max_channel / b_sum_f;
-  uint16_t r_gain_i = static_cast<uint16_t>(r_gain_f * (1 << 8));
-  uint16_t g_gain_i = static_cast<uint16_t>(g_gain_f * (1 << 8));
-  uint16_t b_gain_i = static_cast<uint16_t>(b_gain_f * (1 << 8));
+  return {static_cast<uint16_t>(r_gain_f * (1 << 8)),
+          static_cast<uint16_t>(g_gain_f * (1 << 8)),
+          static_cast<uint16_t>(b_gain_f * (1 << 8))};
+}
+
+void ApplyWhiteBalance(uint8_t* camera_rgb, int width, int height,
+                       const WhiteBalanceGains& gains) {
+  // The gains only take 256 distinct inputs per channel, so look the
+  // results up instead of multiplying and clamping every pixel.
+  uint8_t r_lut[256], g_lut[256], b_lut[256];
+  for (uint32_t v = 0; v < 256; ++v) {
+    r_lut[v] = std::min<uint32_t>(255, (v * gains.r) >> 8);
+    g_lut[v] = std::min<uint32_t>(255, (v * gains.g) >> 8);
+    b_lut[v] = std::min<uint32_t>(255, (v * gains.b) >> 8);
+  }
   for (int i = 0; i < width * height; ++i) {
-    uint8_t r = camera_rgb[i * 3 + 0];
-    uint8_t g = camera_rgb[i * 3 + 1];
-    uint8_t b = camera_rgb[i * 3 + 2];
-    camera_rgb[i * 3 + 0] = static_cast<uint8_t>(
-        std::min(255UL, (static_cast<uint32_t>(r) * r_gain_i) >> 8));
-    camera_rgb[i * 3 + 1] = static_cast<uint8_t>(
-        std::min(255UL, (static_cast<uint32_t>(g) * g_gain_i) >> 8));
-    camera_rgb[i * 3 + 2] = static_cast<uint8_t>(
-        std::min(255UL, (static_cast<uint32_t>(b) * b_gain_i) >> 8));
+    camera_rgb[i * 3 + 0] = r_lut[camera_rgb[i * 3 + 0]];
+    camera_rgb[i * 3 + 1] = g_lut[camera_rgb[i * 3 + 1]];
+    camera_rgb[i * 3 + 2] = b_lut[camera_rgb[i * 3 + 2]];
+  }
+}
+
+bool IsSupportedSize(const CameraFrameFormat& fmt) {
+  return fmt.width > 0 && fmt.width <= CameraFrameScratch::kMaxDimension &&
+         fmt.height > 0 && fmt.height <= CameraFrameScratch::kMaxDimension;
+}
+
+bool IsValidCrop(const CameraCropRect& crop) {
+  if (crop.width == 0 && crop.height == 0) return true;
+  return crop.x >= 0 && crop.y >= 0 && crop.width > 0 && crop.height > 0 &&
+         crop.x + crop.width <= static_cast<int>(CameraTask::kWidth) &&
+         crop.y + crop.height <= static_cast<int>(CameraTask::kHeight);
+}
+
+// True if `fmt` can be produced from a raw frame.
+bool IsSupported(const CameraFrameFormat& fmt) {
+  return IsSupportedSize(fmt) && IsValidCrop(fmt.crop);
+}
+
+// True if both formats sample the sensor at exactly the same pixels.
+bool SameGeometry(const CameraFrameFormat& a, const CameraFrameFormat& b) {
+  return a.filter == b.filter && a.rotation == b.rotation &&
+         a.width == b.width && a.height == b.height &&
+         a.preserve_ratio == b.preserve_ratio && a.resize == b.resize &&
+         a.crop.x == b.crop.x && a.crop.y == b.crop.y &&
+         a.crop.width == b.crop.width && a.crop.height == b.crop.height;
+}
+
+// Returns the first of `fmts[0, count)` with the given format and the same
+// geometry as `fmt`, or nullptr if there is none.
+const CameraFrameFormat* FindSameGeometry(const CameraFrameFormat* fmts,
+                                          size_t count, CameraFormat format,
+                                          const CameraFrameFormat& fmt) {
+  for (size_t i = 0; i < count; ++i) {
+    if (fmts[i].fmt == format && IsSupported(fmts[i]) &&
+        SameGeometry(fmts[i], fmt)) {
+      return &fmts[i];
+    }
   }
+  return nullptr;
+}
+
+// Records the frame that just completed. Call before the driver handles the
+// interrupt, because it clears the status and reloads the DMA addresses.
+//
+// The CSI counts the start of every frame the sensor sends, including frames
+// the driver writes to its dummy buffer because every framebuffer is full or
+// leased, so frames that don't land in a framebuffer show up as gaps in the
+// sequence.
+void RecordCompletedFrame() {
+  const uint32_t status = CSI_GetStatusFlags(CSI);
+  const bool fb1_done = status & kCSI_Fb1DmaTransferDoneFlag;
+  const bool fb2_done = status & kCSI_Fb2DmaTransferDoneFlag;
+  if (!fb1_done && !fb2_done) return;
+
+  const uint16_t count =
+      (CSI_REG_CR3(CSI) & kFrameCountMask) >> kFrameCountShift;
+  const uint16_t elapsed = count - frame_tracker.last_count;
+  frame_tracker.sequence = frame_tracker.sequence + elapsed;
+  frame_tracker.last_count = count;
+  // With both done, the driver can't tell which is newer and skips both.
+  if (fb1_done && fb2_done) return;
+
+  const uint32_t address =
+      fb1_done ? CSI_REG_DMASA_FB1(CSI) : CSI_REG_DMASA_FB2(CSI);
+  const int index = FramebufferPtrToIndex(reinterpret_cast<uint8_t*>(address));
+  if (index == -1) return;
+  frame_tracker.info[index] = {frame_tracker.sequence, TimerMicros()};
+  frame_tracker.stored = frame_tracker.stored + 1;
 }
 }  // namespace
 
 extern "C" void CSI_DriverIRQHandler(void);
 extern "C" void CSI_IRQHandler(void) {
+  RecordCompletedFrame();
   CSI_DriverIRQHandler();
   __DSB();
 }
@@ -473,86 +803,170 @@ int CameraFormatBpp(CameraFormat fmt) {
   return 0;
 }
 
-bool CameraTask::GetFrame(const std::vector<CameraFrameFormat>& fmts) {
+bool CameraTask::GetFrame(const std::vector<CameraFrameFormat>& fmts,
+                          CameraFrameInfo* info) {
+  MutexLock lock(scratch_mutex_);
+  return GetFrame(fmts.data(), fmts.size(), &scratch_, info);
+}
+
+CameraTask::FrameLease::FrameLease(FrameLease&& other) {
+  *this = std::move(other);
+}
+
+CameraTask::FrameLease& CameraTask::FrameLease::operator=(FrameLease&& other) {
+  if (this != &other) {
+    Release();
+    camera_ = other.camera_;
+    data_ = other.data_;
+    index_ = other.index_;
+    info_ = other.info_;
+    other.camera_ = nullptr;
+    other.data_ = nullptr;
+    other.index_ = -1;
+  }
+  return *this;
+}
+
+void CameraTask::FrameLease::Release() {
+  if (camera_ && index_ != -1) {
+    camera_->ReturnFrame(index_);
+  }
+  camera_ = nullptr;
+  data_ = nullptr;
+  index_ = -1;
+}
+
+CameraTask::FrameLease CameraTask::LeaseFrame(bool block) {
+  FrameLease lease;
   if (!enabled_) {
     printf("Camera is not enabled, cannot capture frame.\r\n");
-    return false;
+    return lease;
   }
   if (mode_ == CameraMode::kTrigger && !GpioGet(Gpio::kCameraTrigger)) {
     printf("Camera is in trigger mode but was never triggered\r\n");
-    return false;
+    return lease;
   }
 
-  bool ret = true;
-  uint8_t* raw = nullptr;
-  int index = GetFrame(&raw, true);
-  if (!raw) {
-    return false;
+  camera::FrameResponse resp = RequestFrame(block);
+  if (resp.index == -1) {
+    return lease;
   }
   if (mode_ == CameraMode::kTrigger) {
     GpioSet(Gpio::kCameraTrigger, false);
   }
+  lease.camera_ = this;
+  lease.data_ = IndexToFramebufferPtr(resp.index);
+  lease.index_ = resp.index;
+  lease.info_ = frame_tracker.info[resp.index];
+  return lease;
+}
+
+bool CameraTask::GetFrame(const CameraFrameFormat* fmts, size_t count,
+                          CameraFrameScratch* scratch, CameraFrameInfo* info) {
+  FrameLease frame = LeaseFrame(/*block=*/true);
+  if (!frame.Ok()) {
+    return false;
+  }
+  if (info) {
+    *info = frame.Info();
+  }
+  return ConvertFrame(frame.Data(), fmts, count, scratch);
+}
+
+bool CameraTask::ConvertFrame(const uint8_t* raw, const CameraFrameFormat* fmts,
+                              size_t count, CameraFrameScratch* scratch) {
+  bool ret = true;
 
-  for (const CameraFrameFormat& fmt : fmts) {
+  // Outputs are produced in dependency order so that work shared between
+  // formats happens once per frame: each distinct RGB geometry is sampled
+  // once and copied for duplicates, Y8 outputs are converted from an RGB
+  // output of the same geometry when there is one, and white balance gains
+  // are estimated once and applied to every RGB output that wants them.
+  const CameraFrameFormat* wb_source = nullptr;
+  for (size_t i = 0; i < count; ++i) {
+    const CameraFrameFormat& fmt = fmts[i];
     switch (fmt.fmt) {
-      case CameraFormat::kRgb: {
-        if (fmt.width == kWidth && fmt.height == kHeight) {
-          BayerToRgb(raw, fmt.buffer, fmt.width, fmt.height, fmt.filter,
-                     fmt.rotation);
-          if (fmt.white_balance &&
-              GetSingleton()->test_pattern_ == CameraTestPattern::kNone) {
-            AutoWhiteBalance(fmt.buffer, fmt.width, fmt.height);
-          }
-        } else {
-          auto buffer_rgb = std::make_unique<uint8_t[]>(
-              CameraFormatBpp(CameraFormat::kRgb) * kWidth * kHeight);
-          BayerToRgb(raw, buffer_rgb.get(), kWidth, kHeight, fmt.filter,
-                     fmt.rotation);
-          if (fmt.white_balance &&
-              GetSingleton()->test_pattern_ == CameraTestPattern::kNone) {
-            AutoWhiteBalance(buffer_rgb.get(), kWidth, kHeight);
-          }
-          ResizeNearestNeighbor(buffer_rgb.get(), kWidth, kHeight, fmt.buffer,
-                                fmt.width, fmt.height,
-                                CameraFormatBpp(CameraFormat::kRgb),
-                                fmt.preserve_ratio);
+      case CameraFormat::kRgb:
+      case CameraFormat::kY8:
+        if (!IsSupportedSize(fmt)) {
+          printf("Unsupported frame size %dx%d\r\n", fmt.width, fmt.height);
+          ret = false;
+        } else if (!IsValidCrop(fmt.crop)) {
+          printf("Crop %dx%d at (%d, %d) is outside the frame\r\n",
+                 fmt.crop.width, fmt.crop.height, fmt.crop.x, fmt.crop.y);
+          ret = false;
         }
         break;
-        case CameraFormat::kY8: {
-          if (fmt.width == kWidth && fmt.height == kHeight) {
-            BayerToGrayscale(raw, fmt.buffer, kWidth, kHeight, fmt.filter,
-                             fmt.rotation);
-          } else {
-            auto buffer_rgb = std::make_unique<uint8_t[]>(
-                CameraFormatBpp(CameraFormat::kRgb) * kWidth * kHeight);
-            auto buffer_rgb_scaled = std::make_unique<uint8_t[]>(
-                CameraFormatBpp(CameraFormat::kRgb) * fmt.width * fmt.height);
-            BayerToRgb(raw, buffer_rgb.get(), kWidth, kHeight, fmt.filter,
-                       fmt.rotation);
-            ResizeNearestNeighbor(
-                buffer_rgb.get(), kWidth, kHeight, buffer_rgb_scaled.get(),
-                fmt.width, fmt.height, CameraFormatBpp(CameraFormat::kRgb),
-                fmt.preserve_ratio);
-            RgbToGrayscale(buffer_rgb_scaled.get(), fmt.buffer, fmt.width,
-                           fmt.height);
-          }
-        } break;
-        case CameraFormat::kRaw:
-          if (fmt.width != kWidth || fmt.height != kHeight) {
-            ret = false;
-            break;
-          }
-          std::memcpy(fmt.buffer, raw,
-                      kWidth * kHeight * CameraFormatBpp(CameraFormat::kRaw));
-          ret = true;
-          break;
-        default:
+      case CameraFormat::kRaw:
+        if (fmt.width != kWidth || fmt.height != kHeight) {
           ret = false;
+          break;
+        }
+        std::memcpy(fmt.buffer, raw,
+                    kWidth * kHeight * CameraFormatBpp(CameraFormat::kRaw));
+        break;
+      default:
+        ret = false;
+    }
+  }
+
+  for (size_t i = 0; i < count; ++i) {
+    const CameraFrameFormat& fmt = fmts[i];
+    if (fmt.fmt != CameraFormat::kRgb || !IsSupported(fmt)) continue;
+    const CameraFrameFormat* same =
+        FindSameGeometry(fmts, i, CameraFormat::kRgb, fmt);
+    if (!same) {
+      BayerToRgbResized(raw, fmt, scratch);
+    } else if (same->buffer != fmt.buffer) {
+      std::memcpy(fmt.buffer, same->buffer,
+                  fmt.width * fmt.height * CameraFormatBpp(CameraFormat::kRgb));
+    }
+    // The largest output gives the best estimate of the gains.
+    if (fmt.white_balance &&
+        (!wb_source ||
+         fmt.width * fmt.height > wb_source->width * wb_source->height)) {
+      wb_source = &fmt;
+    }
+  }
+
+  // Y8 is derived from the RGB values before white balancing.
+  for (size_t i = 0; i < count; ++i) {
+    const CameraFrameFormat& fmt = fmts[i];
+    if (fmt.fmt != CameraFormat::kY8 || !IsSupported(fmt)) continue;
+    if (const CameraFrameFormat* rgb =
+            FindSameGeometry(fmts, count, CameraFormat::kRgb, fmt)) {
+      RgbToGrayscale(rgb->buffer, fmt.buffer, fmt.width, fmt.height,
+                     fmt.precision);
+    } else if (const CameraFrameFormat* same =
+                   FindSameGeometry(fmts, i, CameraFormat::kY8, fmt);
+               same && same->precision == fmt.precision) {
+      if (same->buffer != fmt.buffer) {
+        std::memcpy(fmt.buffer, same->buffer, fmt.width * fmt.height);
       }
+    } else {
+      BayerToGrayscaleResized(raw, fmt, scratch);
+    }
+  }
+
+  if (wb_source && test_pattern_ == CameraTestPattern::kNone) {
+    const WhiteBalanceGains gains = ComputeWhiteBalanceGains(
+        wb_source->buffer, wb_source->width, wb_source->height);
+    for (size_t i = 0; i < count; ++i) {
+      const CameraFrameFormat& fmt = fmts[i];
+      if (fmt.fmt != CameraFormat::kRgb || !fmt.white_balance ||
+          !IsSupported(fmt)) {
+        continue;
+      }
+      // Don't balance a buffer twice if it was requested more than once.
+      bool seen = false;
+      for (size_t j = 0; j < i && !seen; ++j) {
+        seen = fmts[j].fmt == CameraFormat::kRgb && fmts[j].white_balance &&
+               IsSupported(fmts[j]) && fmts[j].buffer == fmt.buffer;
+      }
+      if (!seen) ApplyWhiteBalance(fmt.buffer, fmt.width, fmt.height, gains);
     }
   }
 
-  GetSingleton()->ReturnFrame(index);
   return ret;
 }
 
@@ -586,6 +1000,10 @@ void CameraTask::Init(lpi2c_rtos_handle_t* i2c_handle) {
   QueueTask::Init();
   i2c_handle_ = i2c_handle;
   enabled_ = false;
+  if (!scratch_mutex_) {
+    scratch_mutex_ = xSemaphoreCreateMutex();
+    CHECK(scratch_mutex_);
+  }
   GetMotionDetectionConfigDefault(md_config_);
   md_config_.enable = false;
   GpioConfigureInterrupt(
@@ -596,7 +1014,7 @@ void CameraTask::Init(lpi2c_rtos_handle_t* i2c_handle) {
       });
 }
 
-int CameraTask::GetFrame(uint8_t** buffer, bool block) {
+camera::FrameResponse CameraTask::RequestFrame(bool block) {
   camera::Request req;
   req.type = camera::RequestType::kFrame;
   req.request.frame.index = -1;
@@ -604,8 +1022,7 @@ int CameraTask::GetFrame(uint8_t** buffer, bool block) {
   do {
     resp = SendRequest(req);
   } while (block && resp.response.frame.index == -1);
-  *buffer = IndexToFramebufferPtr(resp.response.frame.index);
-  return resp.response.frame.index;
+  return resp.response.frame;
 }
 
 void CameraTask::ReturnFrame(int index) {
@@ -645,6 +1062,16 @@ void CameraTask::SetTestPattern(CameraTestPattern pattern) {
   SendRequest(req);
 }
 
+CameraFrameStats CameraTask::GetFrameStats() const {
+  // Reads again if the interrupt updated the counters in between.
+  uint32_t captured, stored;
+  do {
+    captured = frame_tracker.sequence;
+    stored = frame_tracker.stored;
+  } while (captured != frame_tracker.sequence);
+  return {captured, captured - stored, frame_tracker.discarded};
+}
+
 void CameraTask::Trigger() { GpioSet(Gpio::kCameraTrigger, true); }
 
 void CameraTask::DiscardFrames(int count) {
@@ -775,6 +1202,7 @@ camera::EnableResponse CameraTask::HandleEnableRequest(const CameraMode& mode) {
     status = CSI_TransferSubmitEmptyBuffer(
         CSI, &csi_handle_, reinterpret_cast<uint32_t>(framebuffers[i]));
   }
+  ResetFrameCount();
 
   // Streaming
   status = CSI_TransferStart(CSI, &csi_handle_);
@@ -863,6 +1291,7 @@ void CameraTask::HandleDiscardRequest(const camera::DiscardRequest& discard) {
     if (resp.index != -1) {
       // Return the frame, and increment the discard counter.
       discarded++;
+      frame_tracker.discarded = frame_tracker.discarded + 1;
       request.index = resp.index;
       HandleFrameRequest(request);
     }
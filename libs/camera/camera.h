@@ -23,6 +23,8 @@
 
 #include "libs/base/queue_task.h"
 #include "libs/base/tasks.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_csi.h"
 #include "third_party/nxp/rt1176-sdk/devices/MIMXRT1176/drivers/fsl_lpi2c_freertos.h"
 
@@ -171,12 +173,26 @@ enum class CameraFormat {
 // @return The number of bytes per pixel.
 int CameraFormatBpp(CameraFormat fmt);
 
-// Image resampling method (when resizing the image).
+// Demosaicing method used to interpolate the color channels missing from
+// each raw Bayer pixel.
 enum class CameraFilterMethod {
   kBilinear,
   kNearestNeighbor,
 };
 
+// Image resampling method used when the requested size differs from the
+// native size.
+enum class CameraResizeMethod {
+  // Each output pixel copies the nearest source pixel (default). Fastest,
+  // but aliases when shrinking the image.
+  kNearestNeighbor,
+  // Each output pixel interpolates the four nearest source pixels.
+  kBilinear,
+  // Each output pixel averages the source pixels it covers. Best quality
+  // when shrinking; behaves like `kBilinear` when enlarging.
+  kArea,
+};
+
 // Clockwise image rotations.
 enum class CameraRotation {
   // The natural orientation for the camera module
@@ -191,12 +207,38 @@ enum class CameraRotation {
   k270,
 };
 
+// Arithmetic used to convert pixels to grayscale.
+enum class CameraPrecision {
+  // Single-precision floating point (default).
+  kFloat,
+  // Integer fixed point, which is considerably faster on the M4. Gray values
+  // differ from `kFloat` by at most 1.
+  kFixedPoint,
+};
+
+// A rectangular region of the native-size image, in pixels.
+//
+// Coordinates are measured after rotation, in the same orientation as the
+// output image. For example, a bounding box detected in a native-size
+// `CameraRotation::k270` image can be used as-is to crop another
+// `CameraRotation::k270` frame.
+struct CameraCropRect {
+  // Left edge.
+  int x = 0;
+  // Top edge.
+  int y = 0;
+  // Width. A rect with zero width and height covers the whole image.
+  int width = 0;
+  // Height.
+  int height = 0;
+};
+
 // Specifies your image buffer location and any image processing you want to
 // perform when fetching images with `CameraTask::GetFrame()`.
 struct CameraFrameFormat {
   // Image format such as RGB or raw.
   CameraFormat fmt;
-  // Filter method such as bilinear (default) or nearest-neighbor.
+  // Demosaic filter method such as bilinear (default) or nearest-neighbor.
   CameraFilterMethod filter = CameraFilterMethod::kBilinear;
   // Image rotation in 90-degree increments. Default is 270 degree which
   // corresponds to the device held vertically with USB port facing down.
@@ -206,12 +248,77 @@ struct CameraFrameFormat {
   // Image height. (Native size is `CameraTask::kHeight`.)
   int height;
   // If using non-native width/height, set this true to maintain the native
-  // aspect ratio, false to crop the image.
+  // (or `crop`) aspect ratio, false to stretch the image.
   bool preserve_ratio;
   // Location to store the image.
   uint8_t* buffer;
   // Set true to perform auto whitebalancing (default), false to disable it.
   bool white_balance = true;
+  // Arithmetic used for grayscale conversion (`CameraFormat::kY8`).
+  CameraPrecision precision = CameraPrecision::kFloat;
+  // Resampling method used when width/height differ from the native size.
+  CameraResizeMethod resize = CameraResizeMethod::kNearestNeighbor;
+  // Region of the image to resize into the output, instead of the whole
+  // image (default). Only the pixels in this region are processed.
+  CameraCropRect crop;
+};
+
+// Working memory used by `CameraTask::GetFrame()` to convert a raw frame into
+// the requested formats.
+//
+// Frames are converted directly from the raw sensor buffer into each output
+// buffer without any full-frame intermediate images, so this is the only
+// memory needed beyond the output buffers themselves. Its footprint is fixed
+// at `sizeof(CameraFrameScratch)` (about 8 KB) regardless of the number of
+// formats requested, and output widths and heights are limited to
+// `kMaxDimension`.
+//
+// You only need one of these if you call the `GetFrame()` overload that takes
+// a scratch buffer; otherwise `CameraTask` uses its own.
+struct CameraFrameScratch {
+  // Maximum width or height of a `CameraFrameFormat`.
+  static constexpr int kMaxDimension = 1024;
+  // @cond Internal only, do not generate docs.
+  // Native row width, the same as `CameraTask::kWidth`.
+  static constexpr int kRowWidth = 324;
+  // Source coordinate sampled by each output column and row.
+  int16_t cols[kMaxDimension];
+  int16_t rows[kMaxDimension];
+  // Fractional distance (in 1/256ths) to the next source pixel, for
+  // `CameraResizeMethod::kBilinear`.
+  uint8_t col_weights[kMaxDimension];
+  uint8_t row_weights[kMaxDimension];
+  // The two most recently demosaiced RGB rows, for
+  // `CameraResizeMethod::kBilinear`.
+  uint8_t row_cache[2][kRowWidth * 3];
+  // @endcond
+};
+
+// Metadata about a frame fetched with `CameraTask::GetFrame()` or
+// `CameraTask::LeaseFrame()`.
+struct CameraFrameInfo {
+  // Sequence number of the frame, from the camera interface's hardware frame
+  // counter. This increases by one for every frame the sensor sends, whether
+  // or not it was stored, so a gap between two frames means the frames in
+  // between were dropped, discarded, or fetched by another caller.
+  uint32_t sequence;
+  // Time the frame finished arriving from the sensor, in microseconds since
+  // boot (see `TimerMicros()`).
+  uint64_t timestamp_us;
+};
+
+// Frame counters for the camera, from `CameraTask::GetFrameStats()`. These
+// count from boot and are not reset by `CameraTask::Disable()`.
+struct CameraFrameStats {
+  // Frames sent by the sensor, including dropped ones.
+  uint32_t captured;
+  // Frames that were not stored: either every framebuffer was still waiting
+  // to be fetched or was leased, or the interrupt for a frame was serviced so
+  // late that the next frame had also completed. A dropped frame is counted
+  // when the next frame completes.
+  uint32_t dropped;
+  // Frames thrown away by `CameraTask::DiscardFrames()`.
+  uint32_t discarded;
 };
 
 // Provides access to the Dev Board Micro camera.
@@ -222,6 +329,45 @@ class CameraTask
                        configMINIMAL_STACK_SIZE * 10, kCameraTaskPriority,
                        /*QueueLength=*/4> {
  public:
+  // Exclusive access to one raw frame in the camera's framebuffer, without
+  // copying it. Get one with `CameraTask::LeaseFrame()`.
+  //
+  // The frame goes back to the camera when the lease is destroyed or
+  // `Release()` is called. The camera only has a few framebuffers and cannot
+  // capture into a leased one, so release frames as soon as you're done.
+  class FrameLease {
+   public:
+    FrameLease() = default;
+    ~FrameLease() { Release(); }
+    FrameLease(FrameLease&& other);
+    FrameLease& operator=(FrameLease&& other);
+    // @cond Do not generate docs.
+    FrameLease(const FrameLease&) = delete;
+    FrameLease& operator=(const FrameLease&) = delete;
+    // @endcond
+
+    // Checks whether the lease holds a frame.
+    // @return True if `Data()` is valid, false otherwise.
+    bool Ok() const { return data_ != nullptr; }
+
+    // Gets the raw Bayer image, `kWidth * kHeight` bytes. This is valid
+    // until the lease is released.
+    const uint8_t* Data() const { return data_; }
+
+    // Gets the frame's sequence number and capture time.
+    const CameraFrameInfo& Info() const { return info_; }
+
+    // Returns the frame to the camera. The lease is empty afterwards.
+    void Release();
+
+   private:
+    friend class CameraTask;
+    CameraTask* camera_ = nullptr;
+    const uint8_t* data_ = nullptr;
+    int index_ = -1;
+    CameraFrameInfo info_{};
+  };
+
   // Initializes the camera.
   //
   // Programs on the M7 do not need to call this because it is automatically
@@ -267,8 +413,64 @@ class CameraTask
   // called.
   //
   // @param fmts A list of image formats you want to receive.
+  // @param info Optional output for the frame's sequence number and capture
+  // time.
   // @return True if image processing succeeds, false otherwise.
-  bool GetFrame(const std::vector<CameraFrameFormat>& fmts);
+  bool GetFrame(const std::vector<CameraFrameFormat>& fmts,
+                CameraFrameInfo* info = nullptr);
+
+  // Gets one frame from the camera buffer and processes it into one or
+  // more formats, using caller-provided working memory.
+  //
+  // This behaves the same as `GetFrame(const std::vector<CameraFrameFormat>&)`
+  // but never allocates, which keeps the heap untouched during long-running
+  // capture loops. Different tasks may call this concurrently as long as each
+  // uses its own `scratch`.
+  //
+  // @param fmts An array of image formats you want to receive.
+  // @param count The number of entries in `fmts`.
+  // @param scratch Working memory for the conversion.
+  // @param info Optional output for the frame's sequence number and capture
+  // time.
+  // @return True if image processing succeeds, false otherwise.
+  bool GetFrame(const CameraFrameFormat* fmts, size_t count,
+                CameraFrameScratch* scratch, CameraFrameInfo* info = nullptr);
+
+  // Processes a raw frame into one or more formats, the same way as
+  // `GetFrame()`.
+  //
+  // Use this to convert a frame from `LeaseFrame()`, or a raw frame you
+  // saved earlier.
+  //
+  // @param raw The raw Bayer image, `kWidth * kHeight` bytes.
+  // @param fmts An array of image formats you want to receive.
+  // @param count The number of entries in `fmts`.
+  // @param scratch Working memory for the conversion.
+  // @return True if image processing succeeds, false otherwise.
+  bool ConvertFrame(const uint8_t* raw, const CameraFrameFormat* fmts,
+                    size_t count, CameraFrameScratch* scratch);
+
+  // Gets one raw frame from the camera buffer without copying it.
+  //
+  // Use this instead of `GetFrame()` with `CameraFormat::kRaw` when you only
+  // need the raw Bayer data; it avoids copying the whole image.
+  //
+  // @note As with `GetFrame()`, in trigger mode this fails if the camera has
+  // not been triggered since the last frame was fetched.
+  //
+  // @param block True to wait for a new frame, false to return immediately
+  // if none is available.
+  // @return A lease on the frame. Check `FrameLease::Ok()` to see if a frame
+  // was available.
+  FrameLease LeaseFrame(bool block = true);
+
+  // Gets counters for captured, dropped and discarded frames.
+  //
+  // Compare `CameraFrameInfo::timestamp_us` with `TimerMicros()` to see how
+  // old a frame is, and these counters to see how many frames were lost while
+  // your program was busy.
+  // @return The frame counters.
+  CameraFrameStats GetFrameStats() const;
 
   // Turns the camera power on and off. You must call this before `Enable()`.
   // @param enable True to turn the camera on, false to turn it off.
@@ -317,7 +519,7 @@ class CameraTask
   static constexpr size_t kHeight = 324;
 
  private:
-  int GetFrame(uint8_t** buffer, bool block);
+  camera::FrameResponse RequestFrame(bool block);
   void ReturnFrame(int index);
   void TaskInit() override;
   void RequestHandler(camera::Request* req) override;
@@ -342,6 +544,9 @@ class CameraTask
   CameraTestPattern test_pattern_;
   CameraMotionDetectionConfig md_config_;
   bool enabled_{false};
+  // Guards `scratch_`, used by the `std::vector` overload of `GetFrame()`.
+  SemaphoreHandle_t scratch_mutex_{nullptr};
+  CameraFrameScratch scratch_;
 };
 
 }  // namespace coralmicro
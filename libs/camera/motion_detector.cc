@@ -0,0 +1,185 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/camera/motion_detector.h"
+
+#include <algorithm>
+
+#include "libs/base/check.h"
+
+namespace coralmicro {
+namespace {
+constexpr int kRawWidth = CameraTask::kWidth;
+constexpr int kCellsPerRow = CameraTask::kWidth / 2;
+}  // namespace
+
+MotionDetector::MotionDetector(const MotionDetectorConfig& config)
+    : config_(config) {
+  CHECK(config_.block_size % 2 == 0);
+  CHECK(config_.block_size >= kMinBlockSize &&
+        config_.block_size <= static_cast<int>(CameraTask::kWidth));
+  CHECK(config_.background_shift >= 0 && config_.background_shift < 8);
+  grid_width_ = CameraTask::kWidth / config_.block_size;
+  grid_height_ = CameraTask::kHeight / config_.block_size;
+}
+
+bool MotionDetector::Update(const uint8_t* raw) {
+  const int cells_per_block = config_.block_size / 2;
+  // Compare the total rather than dividing every block's sum.
+  const uint32_t block_threshold =
+      config_.threshold * cells_per_block * cells_per_block;
+  const int shift = config_.background_shift;
+  const int round = shift > 0 ? 1 << (shift - 1) : 0;
+  const bool initialized = initialized_;
+  bool changed = false;
+
+  bitmap_.fill(0);
+  for (int by = 0; by < grid_height_; ++by) {
+    std::fill_n(block_sad_.begin(), grid_width_, 0);
+    for (int cy = by * cells_per_block; cy < (by + 1) * cells_per_block;
+         ++cy) {
+      const uint8_t* row = raw + 2 * cy * kRawWidth;
+      const uint8_t* next_row = row + kRawWidth;
+      uint8_t* background = background_.data() + cy * kCellsPerRow;
+      for (int bx = 0; bx < grid_width_; ++bx) {
+        uint32_t sad = 0;
+        for (int cx = bx * cells_per_block; cx < (bx + 1) * cells_per_block;
+             ++cx) {
+          // The mean of a 2x2 Bayer cell (R + 2G + B) / 4 serves as luma.
+          const int luma = (row[2 * cx] + row[2 * cx + 1] + next_row[2 * cx] +
+                            next_row[2 * cx + 1] + 2) >>
+                           2;
+          if (!initialized) {
+            background[cx] = luma;
+            continue;
+          }
+          const int diff = luma - background[cx];
+          sad += diff < 0 ? -diff : diff;
+          background[cx] += (diff + round) >> shift;
+        }
+        block_sad_[bx] += sad;
+      }
+    }
+    if (!initialized) continue;
+    for (int bx = 0; bx < grid_width_; ++bx) {
+      if (block_sad_[bx] > block_threshold) {
+        const int i = by * grid_width_ + bx;
+        bitmap_[i / 32] |= 1u << (i % 32);
+        changed = true;
+      }
+    }
+  }
+  initialized_ = true;
+
+  FindBoxes();
+  return changed;
+}
+
+void MotionDetector::FindBoxes() {
+  num_boxes_ = 0;
+  // Blocks not yet assigned to a box.
+  std::array<uint32_t, (kMaxBlocks + 31) / 32> pending = bitmap_;
+  auto take = [&pending](int i) {
+    const bool set = (pending[i / 32] >> (i % 32)) & 1;
+    pending[i / 32] &= ~(1u << (i % 32));
+    return set;
+  };
+
+  for (int start = 0; start < grid_width_ * grid_height_; ++start) {
+    if (!take(start)) continue;
+    // Flood fill the 8-connected group of changed blocks.
+    int x0 = grid_width_, y0 = grid_height_, x1 = -1, y1 = -1;
+    int blocks = 0;
+    int top = 0;
+    stack_[top++] = start;
+    while (top > 0) {
+      const int i = stack_[--top];
+      const int x = i % grid_width_;
+      const int y = i / grid_width_;
+      x0 = std::min(x0, x);
+      y0 = std::min(y0, y);
+      x1 = std::max(x1, x);
+      y1 = std::max(y1, y);
+      ++blocks;
+      for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, grid_height_ - 1);
+           ++ny) {
+        for (int nx = std::max(x - 1, 0);
+             nx <= std::min(x + 1, grid_width_ - 1); ++nx) {
+          const int n = ny * grid_width_ + nx;
+          if (take(n)) stack_[top++] = n;
+        }
+      }
+    }
+
+    // Keep the largest groups.
+    int slot = num_boxes_;
+    if (num_boxes_ == kMaxBoxes) {
+      slot = std::min_element(box_blocks_.begin(), box_blocks_.end()) -
+             box_blocks_.begin();
+      if (box_blocks_[slot] >= blocks) continue;
+    } else {
+      ++num_boxes_;
+    }
+    box_blocks_[slot] = blocks;
+    boxes_[slot] = ToRotatedRect(
+        x0 * config_.block_size, y0 * config_.block_size,
+        (x1 + 1) * config_.block_size, (y1 + 1) * config_.block_size);
+  }
+}
+
+CameraCropRect MotionDetector::ToRotatedRect(int x0, int y0, int x1,
+                                             int y1) const {
+  // Inverse of the rotation `CameraTask::GetFrame()` applies, which maps
+  // rotated coordinates c back to kWidth / 2 + kHeight / 2 - c when mirrored.
+  constexpr int kMirror = CameraTask::kWidth / 2 + CameraTask::kHeight / 2;
+  constexpr int kMax = CameraTask::kWidth - 1;
+  // Inclusive corners.
+  int u0, v0, u1, v1;
+  switch (config_.rotation) {
+    case CameraRotation::k90:
+      u0 = kMirror - (y1 - 1);
+      u1 = kMirror - y0;
+      v0 = x0;
+      v1 = x1 - 1;
+      break;
+    case CameraRotation::k180:
+      u0 = kMirror - (x1 - 1);
+      u1 = kMirror - x0;
+      v0 = kMirror - (y1 - 1);
+      v1 = kMirror - y0;
+      break;
+    case CameraRotation::k270:
+      u0 = y0;
+      u1 = y1 - 1;
+      v0 = kMirror - (x1 - 1);
+      v1 = kMirror - x0;
+      break;
+    case CameraRotation::k0:
+    default:
+      u0 = x0;
+      u1 = x1 - 1;
+      v0 = y0;
+      v1 = y1 - 1;
+      break;
+  }
+  u0 = std::min(u0, kMax);
+  v0 = std::min(v0, kMax);
+  u1 = std::min(u1, kMax);
+  v1 = std::min(v1, kMax);
+  return {u0, v0, u1 - u0 + 1, v1 - v0 + 1};
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,144 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_CAMERA_MOTION_DETECTOR_H_
+#define LIBS_CAMERA_MOTION_DETECTOR_H_
+
+#include <array>
+#include <cstdint>
+
+#include "libs/camera/camera.h"
+
+namespace coralmicro {
+
+// Configuration for `MotionDetector`.
+struct MotionDetectorConfig {
+  // Side length of the square blocks motion is measured over, in native
+  // pixels. Must be even and between `MotionDetector::kMinBlockSize` and
+  // `CameraTask::kWidth`. Pixels past the last whole block are ignored.
+  int block_size = 18;
+  // Mean absolute luma difference from the background, per 2x2 Bayer cell,
+  // above which a block counts as changed.
+  int threshold = 12;
+  // How quickly the background follows the scene: each frame moves it
+  // 1 / 2^`background_shift` of the way towards the current frame.
+  int background_shift = 3;
+  // Orientation used for the reported bounding boxes. Use the same rotation
+  // as your `CameraFrameFormat` so the boxes can be used as its `crop`.
+  CameraRotation rotation = CameraRotation::k270;
+};
+
+// Detects motion in software by comparing raw camera frames against a slowly
+// updated background.
+//
+// Unlike the sensor's motion detection interrupt, this reports which parts of
+// the image changed: a bitmap of changed blocks and bounding boxes around
+// connected groups of them. Each frame takes one pass over the raw image
+// using only integer math, so it is cheap enough to run on every frame on
+// the M4, waking heavier processing only for the regions that changed:
+//
+// ```
+// MotionDetector detector;
+// auto frame = CameraTask::GetSingleton()->LeaseFrame();
+// if (frame.Ok() && detector.Update(frame.Data())) {
+//   for (int i = 0; i < detector.NumBoxes(); ++i) {
+//     fmt.crop = detector.Box(i);
+//     ...
+//   }
+// }
+// ```
+//
+// The detector keeps a background image of every 2x2 Bayer cell, so it
+// takes about 29 KB; allocate it statically rather than on a task stack.
+class MotionDetector {
+ public:
+  // Smallest supported block size.
+  static constexpr int kMinBlockSize = 8;
+  // Maximum number of blocks along each axis.
+  static constexpr int kMaxGridSize = CameraTask::kWidth / kMinBlockSize;
+  // Maximum number of bounding boxes reported per frame. When more regions
+  // change, the largest ones are kept.
+  static constexpr int kMaxBoxes = 8;
+
+  // @param config The detector configuration.
+  explicit MotionDetector(const MotionDetectorConfig& config = {});
+
+  // Compares a raw frame against the background, then updates the
+  // background with it. The first frame after construction or `Reset()`
+  // only initializes the background.
+  //
+  // @param raw A raw Bayer frame of `CameraTask::kWidth` x
+  //   `CameraTask::kHeight` pixels, such as from `CameraTask::LeaseFrame()`.
+  // @return True if any block changed, false otherwise.
+  bool Update(const uint8_t* raw);
+
+  // Forgets the background, so the next frame starts over.
+  void Reset() { initialized_ = false; }
+
+  // Gets the number of blocks along the (unrotated) sensor's x axis.
+  int GridWidth() const { return grid_width_; }
+
+  // Gets the number of blocks along the (unrotated) sensor's y axis.
+  int GridHeight() const { return grid_height_; }
+
+  // Checks whether a block changed in the last frame.
+  // @param x Block column, in unrotated sensor orientation.
+  // @param y Block row, in unrotated sensor orientation.
+  // @return True if the block changed, false otherwise.
+  bool BlockChanged(int x, int y) const {
+    const int i = y * grid_width_ + x;
+    return (bitmap_[i / 32] >> (i % 32)) & 1;
+  }
+
+  // Gets the motion bitmap from the last frame: one bit per block in
+  // row-major order (unrotated), with block `i` at bit `i % 32` of word
+  // `i / 32`.
+  const uint32_t* Bitmap() const { return bitmap_.data(); }
+
+  // Gets the number of bounding boxes found in the last frame.
+  int NumBoxes() const { return num_boxes_; }
+
+  // Gets a bounding box around a connected group of changed blocks, in
+  // native-size pixels of the image rotated by
+  // `MotionDetectorConfig::rotation`.
+  // @param i The box index, less than `NumBoxes()`.
+  const CameraCropRect& Box(int i) const { return boxes_[i]; }
+
+ private:
+  static constexpr int kCells =
+      (CameraTask::kWidth / 2) * (CameraTask::kHeight / 2);
+  static constexpr int kMaxBlocks = kMaxGridSize * kMaxGridSize;
+
+  void FindBoxes();
+  CameraCropRect ToRotatedRect(int x0, int y0, int x1, int y1) const;
+
+  MotionDetectorConfig config_;
+  int grid_width_;
+  int grid_height_;
+  bool initialized_ = false;
+  std::array<uint8_t, kCells> background_;
+  std::array<uint32_t, (kMaxBlocks + 31) / 32> bitmap_{};
+  std::array<uint32_t, kMaxGridSize> block_sad_;
+  // Flood-fill work list and per-box block counts for `FindBoxes()`.
+  std::array<int16_t, kMaxBlocks> stack_;
+  std::array<int, kMaxBoxes> box_blocks_;
+  std::array<CameraCropRect, kMaxBoxes> boxes_;
+  int num_boxes_ = 0;
+};
+
+}  // namespace coralmicro
+
+#endif  // LIBS_CAMERA_MOTION_DETECTOR_H_
@@ -16,6 +16,8 @@
 
 #include "libs/tensorflow/audio_models.h"
 
+#include <algorithm>
+
 #include "libs/base/check.h"
 #include "libs/base/filesystem.h"
 #include "libs/tpu/edgetpu_op.h"
@@ -70,13 +72,17 @@ void YamNetPreprocessInput(const int16_t* audio_input,
                            TfLiteTensor* input_tensor,
                            FrontendState* frontend_state) {
   CHECK(input_tensor);
-  // Run frontend process for raw audio data.
-  // TODO(michaelbrooks): Properly slice the data so that we don't need to
-  // re-run the frontend on windows we've already processed.
+  // Run frontend process for raw audio data. Use `AudioFeatureStream` to
+  // avoid re-running the frontend on windows that were already processed.
   std::vector<int16_t> feature_buffer(kYamnetFeatureElementCount);
   PreprocessAudioInput(audio_input, frontend_state, kYAMNet, feature_buffer,
                        kYamnetAudioSize);
+  YamNetFeaturesToInput(feature_buffer.data(), input_tensor);
+}
 
+void YamNetFeaturesToInput(const int16_t* features,
+                           TfLiteTensor* input_tensor) {
+  CHECK(input_tensor);
   // Converts the int16_t raw_audio input to float spectrogram.
   auto* input = tflite::GetTensorData<float>(input_tensor);
   // Determine the offset and scalar based on the calculated data.
@@ -84,11 +90,11 @@ void YamNetPreprocessInput(const int16_t* audio_input,
   // around the same. Can likely hard code.
   constexpr float kExpectedSpectraMax = 3.5f;
   const auto [min, max] =
-      std::minmax_element(std::begin(feature_buffer), std::end(feature_buffer));
+      std::minmax_element(features, features + kYamnetFeatureElementCount);
   int offset = (*max + *min) / 2;
   float scalar = kExpectedSpectraMax / (*max - offset);
   for (int i = 0; i < kYamnetFeatureElementCount; ++i) {
-    input[i] = (static_cast<float>(feature_buffer[i]) - offset) * scalar;
+    input[i] = (static_cast<float>(features[i]) - offset) * scalar;
   }
 }
 
@@ -96,24 +102,134 @@ void KeywordDetectorPreprocessInput(const int16_t* audio_data,
                                     TfLiteTensor* input_tensor,
                                     FrontendState* frontend_state) {
   CHECK(input_tensor);
-  // Run frontend process for raw audio data.
-  // TODO(michaelbrooks): Properly slice the data so that we don't need to
-  // re-run the frontend on windows we've already processed.
+  // Run frontend process for raw audio data. Use `AudioFeatureStream` to
+  // avoid re-running the frontend on windows that were already processed.
   std::vector<int16_t> feature_buffer(kKeywordDetectorFeatureElementCount);
-  PreprocessAudioInput(audio_data, frontend_state, kYAMNet, feature_buffer,
-                       kKeywordDetectorAudioSize);
+  PreprocessAudioInput(audio_data, frontend_state, kKeywordDetector,
+                       feature_buffer, kKeywordDetectorAudioSize);
+  KeywordDetectorFeaturesToInput(feature_buffer.data(), input_tensor);
+}
 
+void KeywordDetectorFeaturesToInput(const int16_t* features,
+                                    TfLiteTensor* input_tensor) {
+  CHECK(input_tensor);
   auto* input = tflite::GetTensorData<uint8>(input_tensor);
 
-  const auto [min, max] =
-      std::minmax_element(std::begin(feature_buffer), std::end(feature_buffer));
+  const auto [min, max] = std::minmax_element(
+      features, features + kKeywordDetectorFeatureElementCount);
 
   float scale = static_cast<float>(*max - *min) / 256.0f;
 
   for (int i = 0; i < kKeywordDetectorFeatureElementCount; ++i) {
     // This conversion allows for requantization from int16 to uint8
-    input[i] = static_cast<uint8_t>(
-        static_cast<float>(feature_buffer[i] - *min) / scale);
+    input[i] =
+        static_cast<uint8_t>(static_cast<float>(features[i] - *min) / scale);
+  }
+}
+
+AudioFeatureStream::AudioFeatureStream()
+    : mutex_(xSemaphoreCreateMutex()),
+      snapshot_mutex_(xSemaphoreCreateMutex()) {
+  CHECK(mutex_);
+  CHECK(snapshot_mutex_);
+}
+
+AudioFeatureStream::~AudioFeatureStream() {
+  if (frontend_ready_) FrontendFreeStateContents(&frontend_state_);
+  vSemaphoreDelete(snapshot_mutex_);
+  vSemaphoreDelete(mutex_);
+}
+
+bool AudioFeatureStream::Init(AudioModel model_type) {
+  // Same lock order as `CopyToInputTensor()`.
+  MutexLock snapshot_lock(snapshot_mutex_);
+  MutexLock lock(mutex_);
+  if (frontend_ready_) {
+    FrontendFreeStateContents(&frontend_state_);
+    frontend_ready_ = false;
+  }
+  if (!PrepareAudioFrontEnd(&frontend_state_, model_type)) return false;
+  frontend_ready_ = true;
+  model_type_ = model_type;
+  if (model_type == kYAMNet) {
+    slice_size_ = kYamnetFeatureSliceSize;
+    slice_count_ = kYamnetFeatureSliceCount;
+  } else {
+    slice_size_ = kKeywordDetectorFeatureSliceSize;
+    slice_count_ = kKeywordDetectorFeatureSliceCount;
+  }
+  features_.assign(2 * slice_count_ * slice_size_, 0);
+  snapshot_.resize(slice_count_ * slice_size_);
+  num_slices_ = 0;
+  pos_ = 0;
+  return true;
+}
+
+void AudioFeatureStream::AddSamples(const int16_t* samples,
+                                    size_t num_samples) {
+  // `Reset()` and `Init()` change the frontend state from other tasks, so the
+  // lock is held for each frontend step, but not across them.
+  while (num_samples > 0) {
+    MutexLock lock(mutex_);
+    // A failed `Init()` leaves no frontend; drop the samples until the next
+    // successful one.
+    if (!frontend_ready_) return;
+    size_t num_samples_read;
+    auto frontend_output = FrontendProcessSamples(
+        &frontend_state_, samples, num_samples, &num_samples_read);
+    samples += num_samples_read;
+    num_samples -= num_samples_read;
+    if (frontend_output.values != nullptr) AddSlice(frontend_output.values);
+  }
+}
+
+void AudioFeatureStream::AddSamples(const int32_t* samples,
+                                    size_t num_samples) {
+  // One 10 ms stride at 16 kHz.
+  constexpr size_t kChunkSize = 160;
+  int16_t chunk[kChunkSize];
+  while (num_samples > 0) {
+    const size_t n = std::min(num_samples, kChunkSize);
+    for (size_t i = 0; i < n; ++i) chunk[i] = samples[i] >> 16;
+    AddSamples(chunk, n);
+    samples += n;
+    num_samples -= n;
+  }
+}
+
+void AudioFeatureStream::Reset() {
+  MutexLock lock(mutex_);
+  if (frontend_ready_) FrontendReset(&frontend_state_);
+  num_slices_ = 0;
+  pos_ = 0;
+}
+
+void AudioFeatureStream::AddSlice(const uint16_t* values) {
+  const int slot = (pos_ + num_slices_) % slice_count_;
+  auto* first = features_.data() + slot * slice_size_;
+  auto* second = first + slice_count_ * slice_size_;
+  for (int i = 0; i < slice_size_; ++i) first[i] = second[i] = values[i];
+  if (num_slices_ < slice_count_) {
+    ++num_slices_;
+  } else {
+    pos_ = (pos_ + 1) % slice_count_;
+  }
+}
+
+void AudioFeatureStream::CopyToInputTensor(TfLiteTensor* input_tensor) const {
+  // Normalize a copy, so the producer isn't blocked while it runs.
+  MutexLock snapshot_lock(snapshot_mutex_);
+  AudioModel model_type;
+  {
+    MutexLock lock(mutex_);
+    model_type = model_type_;
+    std::copy_n(features_.data() + pos_ * slice_size_, snapshot_.size(),
+                snapshot_.begin());
+  }
+  if (model_type == kYAMNet) {
+    YamNetFeaturesToInput(snapshot_.data(), input_tensor);
+  } else {
+    KeywordDetectorFeaturesToInput(snapshot_.data(), input_tensor);
   }
 }
 
@@ -123,8 +239,6 @@ void PreprocessAudioInput(const int16_t* audio_data,
                           size_t num_samples) {
   CHECK(frontend_state);
   // Run frontend process for raw audio data.
-  // TODO(michaelbrooks): Properly slice the data so that we don't need to
-  // re-run the frontend on windows we've already processed.
   size_t num_samples_remaining = num_samples;
   auto* raw_audio = audio_data;
   int count = 0;
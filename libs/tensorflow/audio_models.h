@@ -19,6 +19,7 @@
 
 #include <vector>
 
+#include "libs/base/mutex.h"
 #include "libs/tensorflow/classification.h"
 #include "libs/tpu/edgetpu_op.h"
 #include "third_party/tflite-micro/tensorflow/lite/c/common.h"
@@ -117,6 +118,134 @@ void KeywordDetectorPreprocessInput(const int16_t* audio_data,
                                     TfLiteTensor* input_tensor,
                                     FrontendState* frontend_state);
 
+// Converts a spectrogram into the YamNet input tensor.
+//
+// @param features `kYamnetFeatureElementCount` feature values in
+// chronological order, such as those produced by `AudioFeatureStream`.
+// @param input_tensor The tensor where the normalized spectrogram is stored.
+void YamNetFeaturesToInput(const int16_t* features,
+                           TfLiteTensor* input_tensor);
+
+// Converts a spectrogram into the keyword detector input tensor.
+//
+// @param features `kKeywordDetectorFeatureElementCount` feature values in
+// chronological order, such as those produced by `AudioFeatureStream`.
+// @param input_tensor The tensor where the requantized spectrogram is stored.
+void KeywordDetectorFeaturesToInput(const int16_t* features,
+                                    TfLiteTensor* input_tensor);
+
+// Incrementally converts streaming audio into spectrogram feature slices.
+//
+// Unlike `YamNetPreprocessInput()` and `KeywordDetectorPreprocessInput()`,
+// which run the frontend over the whole model window on every inference,
+// this runs the frontend only on new samples as they arrive and keeps the
+// latest slices for the model window in a ring. Each new 10 ms stride of audio
+// costs a single slice, so you can run inference as often as you like.
+//
+// Samples are typically added from an `AudioService` callback while
+// another task reads the features:
+//
+// ```
+// tensorflow::AudioFeatureStream stream;
+// stream.Init(tensorflow::AudioModel::kKeywordDetector);
+// audio_service.AddCallback(
+//     &stream, +[](void* ctx, const int32_t* samples, size_t num_samples) {
+//       static_cast<tensorflow::AudioFeatureStream*>(ctx)->AddSamples(
+//           samples, num_samples);
+//       return true;
+//     });
+// ...
+// if (stream.Ready()) stream.CopyToInputTensor(interpreter.input_tensor(0));
+// ```
+class AudioFeatureStream {
+ public:
+  AudioFeatureStream();
+  // @cond
+  AudioFeatureStream(const AudioFeatureStream&) = delete;
+  AudioFeatureStream& operator=(const AudioFeatureStream&) = delete;
+  ~AudioFeatureStream();
+  // @endcond
+
+  // Prepares the frontend and the feature ring for the given model.
+  //
+  // @param model_type The type of audio model to compute features for.
+  // @return True on success, false otherwise.
+  bool Init(AudioModel model_type);
+
+  // Runs the frontend over new samples and stores any completed slices.
+  // The samples are dropped if the last `Init()` failed.
+  //
+  // @param samples Signed 16-bit audio samples.
+  // @param num_samples The number of samples.
+  void AddSamples(const int16_t* samples, size_t num_samples);
+
+  // Runs the frontend over new samples and stores any completed slices.
+  //
+  // @param samples Signed 32-bit audio samples, as delivered by
+  // `AudioService`. Only the upper 16 bits of each sample are used.
+  // @param num_samples The number of samples.
+  void AddSamples(const int32_t* samples, size_t num_samples);
+
+  // Discards all slices and resets the frontend.
+  void Reset();
+
+  // Gets the number of values in one feature slice.
+  int SliceSize() const { return slice_size_; }
+
+  // Gets the number of slices in one model window.
+  int SliceCount() const { return slice_count_; }
+
+  // Gets the number of slices stored so far, up to `SliceCount()`.
+  int NumSlices() const {
+    MutexLock lock(mutex_);
+    return num_slices_;
+  }
+
+  // Checks whether a full model window of slices is available.
+  bool Ready() const { return NumSlices() == slice_count_; }
+
+  // Gets the latest features without a copy and applies a function to them.
+  //
+  // @param f A function to apply to the features. The function receives a
+  // pointer to `SliceCount() * SliceSize()` contiguous `int16_t` values in
+  // chronological order, oldest slice first. The pointer is only valid
+  // inside the function.
+  template <typename F>
+  void AccessFeatures(F f) const {
+    MutexLock lock(mutex_);
+    f(features_.data() + pos_ * slice_size_);
+  }
+
+  // Copies the latest features, in chronological order, into the input
+  // tensor of the model given to `Init()`, using the same normalization as
+  // `YamNetPreprocessInput()` or `KeywordDetectorPreprocessInput()`. The
+  // features are copied out first, so `AddSamples()` only waits for the copy.
+  //
+  // @param input_tensor The model input tensor.
+  void CopyToInputTensor(TfLiteTensor* input_tensor) const;
+
+ private:
+  // Stores a finished slice. Call with `mutex_` held.
+  void AddSlice(const uint16_t* values);
+
+  SemaphoreHandle_t mutex_;
+  // Guards `snapshot_`, the features being normalized by
+  // `CopyToInputTensor()`. `Init()` sizes it, so copies never allocate.
+  SemaphoreHandle_t snapshot_mutex_;
+  mutable std::vector<int16_t> snapshot_;
+  FrontendState frontend_state_{};
+  bool frontend_ready_ = false;
+  AudioModel model_type_ = kYAMNet;
+  int slice_size_ = 0;
+  int slice_count_ = 0;
+  int num_slices_ = 0;
+  // Index of the oldest slice.
+  int pos_ = 0;
+  // Each slice is stored twice, `slice_count_` slices apart, so that the
+  // latest window is always contiguous starting at `pos_`.
+  std::vector<int16_t> features_;
+};
+
 // @cond
 void PreprocessAudioInput(const int16_t* audio_data,
                           FrontendState* frontend_state, AudioModel model_type,
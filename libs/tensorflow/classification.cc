@@ -16,6 +16,9 @@
 
 #include "libs/tensorflow/classification.h"
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <queue>
 #include <vector>
 
@@ -30,6 +33,100 @@ struct ClassComparator {
     return std::tie(lhs.score, lhs.id) > std::tie(rhs.score, rhs.id);
   }
 };
+
+// Gets the lowest quantized value whose dequantized score is at least
+// `threshold`, or `kMax + 1` if there is none. Matches `Dequantize()`
+// exactly, including float rounding at the boundary.
+template <typename T>
+int QuantizedThreshold(float threshold, float scale, int zero_point) {
+  constexpr int kMin = std::numeric_limits<T>::min();
+  constexpr int kMax = std::numeric_limits<T>::max();
+  const auto score = [&](int q) {
+    return scale * (q - static_cast<float>(zero_point));
+  };
+  if (!(threshold > score(kMin))) return kMin;
+  if (threshold > score(kMax)) return kMax + 1;
+  int q = std::clamp(
+      static_cast<int>(std::ceil(zero_point + threshold / scale)), kMin, kMax);
+  while (q > kMin && score(q - 1) >= threshold) --q;
+  while (q <= kMax && score(q) < threshold) ++q;
+  return q;
+}
+
+// Same as `GetClassificationResults()` on the dequantized scores, but
+// selects the top_k directly on quantized values with a histogram, so only
+// the results are dequantized. Requires a positive scale. `results` must
+// have room for `min(top_k, scores_count)` classes.
+template <typename T>
+size_t SelectQuantizedTopK(const T* scores, int scores_count, float scale,
+                           int zero_point, float threshold, size_t top_k,
+                           Class* results) {
+  constexpr int kMin = std::numeric_limits<T>::min();
+  constexpr int kLevels = 256;
+  static_assert(std::numeric_limits<T>::max() - kMin + 1 == kLevels);
+
+  const int min_level = QuantizedThreshold<T>(threshold, scale, zero_point) -
+                        kMin;
+  if (min_level >= kLevels || top_k == 0) return 0;
+
+  int histogram[kLevels] = {};
+  for (int i = 0; i < scores_count; ++i) ++histogram[scores[i] - kMin];
+
+  // Find the lowest level that makes it into the results, and how many of
+  // the scores at that level do.
+  size_t count = 0;
+  int level = kLevels - 1;
+  for (; level >= min_level; --level) {
+    if (count + histogram[level] >= top_k) break;
+    count += histogram[level];
+  }
+  // If everything above the threshold fits, level ends up below min_level.
+  size_t at_level = level >= min_level ? top_k - count : 0;
+
+  // Scores are ranked by (score, id), so ties at the last level go to the
+  // highest ids.
+  size_t size = 0;
+  for (int i = scores_count - 1; i >= 0; --i) {
+    const int q = scores[i] - kMin;
+    if (q > level || (q == level && at_level > 0)) {
+      if (q == level) --at_level;
+      results[size++] = Class{i, static_cast<float>(scores[i])};
+    }
+  }
+  std::sort(results, results + size, ClassComparator());
+  for (size_t i = 0; i < size; ++i)
+    results[i].score = scale * (results[i].score - zero_point);
+  return size;
+}
+
+template <typename T>
+std::vector<Class> GetQuantizedClassificationResults(const T* scores,
+                                                     int scores_count,
+                                                     float scale,
+                                                     int zero_point,
+                                                     float threshold,
+                                                     size_t top_k) {
+  std::vector<Class> ret(
+      std::min(top_k, static_cast<size_t>(std::max(scores_count, 0))));
+  ret.resize(SelectQuantizedTopK(scores, scores_count, scale, zero_point,
+                                 threshold, top_k, ret.data()));
+  return ret;
+}
+
+// Selects the top_k of quantized scores without a positive scale, by
+// dequantizing one score at a time.
+template <typename T>
+size_t SelectDequantizedTopK(const T* scores, int scores_count, float scale,
+                             float zero_point, float threshold, size_t top_k,
+                             Class* results) {
+  size_t size = 0;
+  for (int i = 0; i < scores_count; ++i) {
+    const float score = scale * (scores[i] - zero_point);
+    if (score < threshold) continue;
+    size = InsertTopK(results, size, top_k, Class{i, score}, ClassComparator());
+  }
+  return size;
+}
 }  // namespace
 
 std::string FormatClassificationOutput(
@@ -45,6 +142,60 @@ std::string FormatClassificationOutput(
   return out;
 }
 
+size_t FormatClassificationOutput(const Class* classes, size_t count,
+                                  char* buffer, size_t size) {
+  if (size == 0) return 0;
+  buffer[0] = '\0';
+  if (count == 0) return AppendFormat(buffer, size, 0, "No results\r\n");
+  size_t length = AppendFormat(buffer, size, 0, "Results:\r\n");
+  for (size_t i = 0; i < count; ++i) {
+    length = AppendFormat(buffer, size, length, "%d: %f\r\n", classes[i].id,
+                          static_cast<double>(classes[i].score));
+  }
+  return length;
+}
+
+size_t GetClassificationResults(const float* scores, ssize_t scores_count,
+                                float threshold, Class* results,
+                                size_t max_results) {
+  size_t size = 0;
+  for (int i = 0; i < scores_count; ++i) {
+    if (scores[i] < threshold) continue;
+    size = InsertTopK(results, size, max_results, Class{i, scores[i]},
+                      ClassComparator());
+  }
+  return size;
+}
+
+size_t GetClassificationResults(tflite::MicroInterpreter* interpreter,
+                                float threshold, Class* results,
+                                size_t max_results) {
+  auto tensor = interpreter->output_tensor(0);
+  const float scale = tensor->params.scale;
+  const int zero_point = tensor->params.zero_point;
+  const int size = TensorSize(tensor);
+  if (tensor->type == kTfLiteUInt8) {
+    const auto* scores = tflite::GetTensorData<uint8_t>(tensor);
+    if (scale > 0)
+      return SelectQuantizedTopK(scores, size, scale, zero_point, threshold,
+                                 max_results, results);
+    return SelectDequantizedTopK(scores, size, scale, zero_point, threshold,
+                                 max_results, results);
+  } else if (tensor->type == kTfLiteInt8) {
+    const auto* scores = tflite::GetTensorData<int8_t>(tensor);
+    if (scale > 0)
+      return SelectQuantizedTopK(scores, size, scale, zero_point, threshold,
+                                 max_results, results);
+    return SelectDequantizedTopK(scores, size, scale, zero_point, threshold,
+                                 max_results, results);
+  } else if (tensor->type == kTfLiteFloat32) {
+    return GetClassificationResults(tflite::GetTensorData<float>(tensor), size,
+                                    threshold, results, max_results);
+  }
+  assert(false);
+  return 0;
+}
+
 std::vector<Class> GetClassificationResults(const float* scores,
                                             ssize_t scores_count,
                                             float threshold, size_t top_k) {
@@ -67,7 +218,17 @@ std::vector<Class> GetClassificationResults(const float* scores,
 std::vector<Class> GetClassificationResults(
     tflite::MicroInterpreter* interpreter, float threshold, size_t top_k) {
   auto tensor = interpreter->output_tensor(0);
-  if (tensor->type == kTfLiteUInt8 || tensor->type == kTfLiteInt8) {
+  const float scale = tensor->params.scale;
+  const int zero_point = tensor->params.zero_point;
+  if (tensor->type == kTfLiteUInt8 && scale > 0) {
+    return GetQuantizedClassificationResults(
+        tflite::GetTensorData<uint8_t>(tensor), TensorSize(tensor), scale,
+        zero_point, threshold, top_k);
+  } else if (tensor->type == kTfLiteInt8 && scale > 0) {
+    return GetQuantizedClassificationResults(
+        tflite::GetTensorData<int8_t>(tensor), TensorSize(tensor), scale,
+        zero_point, threshold, top_k);
+  } else if (tensor->type == kTfLiteUInt8 || tensor->type == kTfLiteInt8) {
     auto scores = DequantizeTensor<float>(tensor);
     return GetClassificationResults(scores.data(), scores.size(), threshold,
                                     top_k);
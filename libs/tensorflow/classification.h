@@ -17,6 +17,7 @@
 #ifndef LIBS_TENSORFLOW_CLASSIFICATION_H_
 #define LIBS_TENSORFLOW_CLASSIFICATION_H_
 
+#include <array>
 #include <limits>
 #include <vector>
 
@@ -41,6 +42,18 @@ struct Class {
 std::string FormatClassificationOutput(
     const std::vector<tensorflow::Class>& classes);
 
+// Formats the Classification outputs into a caller-provided buffer, without
+// allocating memory.
+//
+// @param classes The classification class predictions.
+// @param count The number of classes.
+// @param buffer The buffer to write the NUL-terminated text to.
+// @param size The size of `buffer` in bytes. Text that doesn't fit is
+//   truncated.
+// @return The length of the text written to `buffer`.
+size_t FormatClassificationOutput(const Class* classes, size_t count,
+                                  char* buffer, size_t size);
+
 // Converts a classification output tensor into a list of ordered classes.
 //
 // @param scores The dequantized output tensor.
@@ -58,6 +71,9 @@ std::vector<Class> GetClassificationResults(
 
 // Gets results from a classification model as a list of ordered classes.
 //
+// For uint8 and int8 outputs, the threshold and top_k selection run on the
+// quantized scores and only the returned classes are dequantized.
+//
 // @param interpreter The already-invoked interpreter for your classification
 //   model.
 // @param threshold The score threshold for results. All returned results have
@@ -70,6 +86,61 @@ std::vector<Class> GetClassificationResults(
     float threshold = -std::numeric_limits<float>::infinity(),
     size_t top_k = std::numeric_limits<size_t>::max());
 
+// Converts a classification output tensor into ordered classes, written to
+// caller-provided storage without allocating memory.
+//
+// @param scores The dequantized output tensor.
+// @param scores_count The number of scores in the output (the size of
+//   the output tensor).
+// @param threshold The score threshold for results. All returned results have
+//   a score greater-than-or-equal-to this value.
+// @param results The storage for the results, ordered by score (first element
+//   has the highest score).
+// @param max_results The capacity of `results`, which is also the maximum
+//   number of predictions to return.
+// @returns The number of results written.
+size_t GetClassificationResults(const float* scores, ssize_t scores_count,
+                                float threshold, Class* results,
+                                size_t max_results);
+
+// Gets results from a classification model as ordered classes, written to
+// caller-provided storage without allocating memory.
+//
+// @param interpreter The already-invoked interpreter for your classification
+//   model.
+// @param threshold The score threshold for results. All returned results have
+//   a score greater-than-or-equal-to this value.
+// @param results The storage for the results, ordered by score (first element
+//   has the highest score).
+// @param max_results The capacity of `results`, which is also the maximum
+//   number of predictions to return.
+// @returns The number of results written.
+size_t GetClassificationResults(tflite::MicroInterpreter* interpreter,
+                                float threshold, Class* results,
+                                size_t max_results);
+
+// Gets results from a classification model as ordered classes, written to
+// a fixed-size array without allocating memory. For example:
+//
+// ```
+// std::array<tensorflow::Class, 5> results;
+// auto count = tensorflow::GetClassificationResults(&interpreter, &results);
+// ```
+//
+// @param interpreter The already-invoked interpreter for your classification
+//   model.
+// @param results The storage for the top N results, ordered by score (first
+//   element has the highest score).
+// @param threshold The score threshold for results. All returned results have
+//   a score greater-than-or-equal-to this value.
+// @returns The number of results written.
+template <size_t N>
+size_t GetClassificationResults(
+    tflite::MicroInterpreter* interpreter, std::array<Class, N>* results,
+    float threshold = -std::numeric_limits<float>::infinity()) {
+  return GetClassificationResults(interpreter, threshold, results->data(), N);
+}
+
 // Checks whether an input tensor needs pre-processing for classification.
 // @param intput_tensor The tensor intended as input for a classification model.
 // @returns True if the input tensor requires normalization AND quantization
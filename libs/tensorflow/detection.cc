@@ -16,9 +16,12 @@
 
 #include "libs/tensorflow/detection.h"
 
+#include <algorithm>
 #include <cmath>
 #include <queue>
 
+#include "libs/tensorflow/utils.h"
+
 namespace coralmicro::tensorflow {
 
 namespace {
@@ -27,6 +30,174 @@ struct ObjectComparator {
     return std::tie(lhs.score, lhs.id) > std::tie(rhs.score, rhs.id);
   }
 };
+
+Object MakeObject(const float* bboxes, const float* ids, const float* scores,
+                  size_t i) {
+  const int id = std::round(ids[i]);
+  const float ymin = std::max(0.0f, bboxes[4 * i]);
+  const float xmin = std::max(0.0f, bboxes[4 * i + 1]);
+  const float ymax = std::max(0.0f, bboxes[4 * i + 2]);
+  const float xmax = std::max(0.0f, bboxes[4 * i + 3]);
+  return Object{id, scores[i], BBox<float>{ymin, xmin, ymax, xmax}};
+}
+
+struct DetectionTensors {
+  const float* bboxes;
+  const float* ids;
+  const float* scores;
+  size_t count;
+};
+
+bool GetDetectionTensors(tflite::MicroInterpreter* interpreter,
+                         DetectionTensors* tensors) {
+  if (interpreter->outputs().size() != 4) {
+    printf("Output size mismatch\r\n");
+    return false;
+  }
+
+  const auto output = [interpreter](int i) {
+    return tflite::GetTensorData<float>(interpreter->output_tensor(i));
+  };
+  const float* count;
+  if (interpreter->output_tensor(2)->dims->size == 1) {
+    tensors->scores = output(0);
+    tensors->bboxes = output(1);
+    count = output(2);
+    tensors->ids = output(3);
+  } else {
+    tensors->bboxes = output(0);
+    tensors->ids = output(1);
+    tensors->scores = output(2);
+    count = output(3);
+  }
+  tensors->count = static_cast<size_t>(count[0]);
+  return true;
+}
+
+float Area(const BBox<float>& box) {
+  return std::max(0.0f, box.ymax - box.ymin) *
+         std::max(0.0f, box.xmax - box.xmin);
+}
+
+float IntersectionOverUnion(const BBox<float>& a, const BBox<float>& b) {
+  const float h = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
+  const float w = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
+  if (h <= 0 || w <= 0) return 0.0f;
+  const float intersection = h * w;
+  return intersection / (Area(a) + Area(b) - intersection);
+}
+
+bool IsNormalized(const BBox<float>& box) {
+  return box.ymin >= 0 && box.xmin >= 0 && box.ymax <= 1 && box.xmax <= 1;
+}
+
+// Normalized boxes are compared as `NmsBox`es in 16-bit fixed point, so that
+// IoU can be compared to the threshold with integer multiplies instead of a
+// float division.
+constexpr int kFixedBits = 16;
+constexpr int64_t kFixedOne = 1 << kFixedBits;
+
+int32_t ToFixed(float value) {
+  return static_cast<int32_t>(value * kFixedOne + 0.5f);
+}
+
+NmsBox ToFixed(const BBox<float>& bbox) {
+  NmsBox box{ToFixed(bbox.ymin), ToFixed(bbox.xmin), ToFixed(bbox.ymax),
+               ToFixed(bbox.xmax), 0};
+  box.area = static_cast<int64_t>(std::max(0, box.ymax - box.ymin)) *
+             std::max(0, box.xmax - box.xmin);
+  return box;
+}
+
+// Checks IoU(a, b) > threshold, with the threshold in fixed point.
+bool Overlaps(const NmsBox& a, const NmsBox& b, int64_t threshold) {
+  const int64_t h = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
+  const int64_t w = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
+  if (h <= 0 || w <= 0) return false;
+  // i / (a + b - i) > t  <=>  i * (1 + t) > t * (a + b)
+  const int64_t intersection = h * w;
+  return intersection * (kFixedOne + threshold) > threshold * (a.area + b.area);
+}
+
+size_t GreedyNms(Object* objects, size_t count, const NmsOptions& options,
+                 NmsBox* scratch) {
+  // Per-class suppression only compares boxes of the same class, so group
+  // them by class first and restore the score order at the end.
+  if (options.class_agnostic) {
+    std::sort(objects, objects + count, ObjectComparator());
+  } else {
+    std::sort(objects, objects + count,
+              [](const Object& lhs, const Object& rhs) {
+                if (lhs.id != rhs.id) return lhs.id < rhs.id;
+                return ObjectComparator()(lhs, rhs);
+              });
+  }
+  const bool fixed = std::all_of(
+      objects, objects + count,
+      [](const Object& object) { return IsNormalized(object.bbox); });
+  const int64_t threshold = std::llround(options.iou_threshold * kFixedOne);
+
+  // Kept objects are compacted to the front of `objects`, and each box is
+  // compared against that prefix. `scratch` keeps the prefix in fixed point,
+  // otherwise it is converted as it is compared.
+  size_t kept = 0;
+  // The first kept box of the current class.
+  size_t group = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (!options.class_agnostic && i > 0 && objects[i].id != objects[i - 1].id)
+      group = kept;
+    bool suppressed = false;
+    if (fixed) {
+      const NmsBox box = ToFixed(objects[i].bbox);
+      if (scratch) {
+        for (size_t j = group; j < kept && !suppressed; ++j)
+          suppressed = Overlaps(scratch[j], box, threshold);
+        if (!suppressed) scratch[kept] = box;
+      } else {
+        for (size_t j = group; j < kept && !suppressed; ++j)
+          suppressed = Overlaps(ToFixed(objects[j].bbox), box, threshold);
+      }
+    } else {
+      for (size_t j = group; j < kept && !suppressed; ++j)
+        suppressed = IntersectionOverUnion(objects[j].bbox, objects[i].bbox) >
+                     options.iou_threshold;
+    }
+    if (!suppressed) objects[kept++] = objects[i];
+  }
+
+  if (!options.class_agnostic)
+    std::sort(objects, objects + kept, ObjectComparator());
+  return kept;
+}
+
+size_t SoftNms(Object* objects, size_t count, const NmsOptions& options) {
+  const bool linear = options.method == NmsMethod::kSoftLinear;
+  size_t end = count;
+  for (size_t i = 0; i < end; ++i) {
+    // Move the highest remaining score to the front, then decay the scores of
+    // the boxes it overlaps.
+    std::swap(objects[i], *std::min_element(objects + i, objects + end,
+                                            ObjectComparator()));
+    const Object& best = objects[i];
+    for (size_t j = i + 1; j < end;) {
+      Object& other = objects[j];
+      if (options.class_agnostic || other.id == best.id) {
+        const float iou = IntersectionOverUnion(best.bbox, other.bbox);
+        if (linear) {
+          if (iou > options.iou_threshold) other.score *= 1.0f - iou;
+        } else {
+          other.score *= std::exp(-iou * iou / options.sigma);
+        }
+        if (other.score < options.score_threshold) {
+          other = objects[--end];
+          continue;
+        }
+      }
+      ++j;
+    }
+  }
+  return end;
+}
 }  // namespace
 
 std::string FormatDetectionOutput(const std::vector<Object>& objects) {
@@ -42,22 +213,56 @@ std::string FormatDetectionOutput(const std::vector<Object>& objects) {
   return output;
 }
 
+size_t FormatDetectionOutput(const Object* objects, size_t count,
+                             char* buffer, size_t size) {
+  if (size == 0) return 0;
+  buffer[0] = '\0';
+  size_t length = 0;
+  for (size_t i = 0; i < count; ++i) {
+    const auto& object = objects[i];
+    length = AppendFormat(
+        buffer, size, length,
+        "id: %d -- score: %f -- xmin: %f -- ymin: %f -- xmax: %f -- ymax: %f",
+        object.id, static_cast<double>(object.score),
+        static_cast<double>(object.bbox.xmin),
+        static_cast<double>(object.bbox.ymin),
+        static_cast<double>(object.bbox.xmax),
+        static_cast<double>(object.bbox.ymax));
+  }
+  return length;
+}
+
+size_t GetDetectionResults(const float* bboxes, const float* ids,
+                           const float* scores, size_t count, float threshold,
+                           Object* results, size_t max_results) {
+  size_t size = 0;
+  for (size_t i = 0; i < count; ++i) {
+    if (scores[i] < threshold) continue;
+    size = InsertTopK(results, size, max_results,
+                      MakeObject(bboxes, ids, scores, i), ObjectComparator());
+  }
+  return size;
+}
+
+size_t GetDetectionResults(tflite::MicroInterpreter* interpreter,
+                           float threshold, Object* results,
+                           size_t max_results) {
+  DetectionTensors tensors;
+  if (!GetDetectionTensors(interpreter, &tensors)) return 0;
+  return GetDetectionResults(tensors.bboxes, tensors.ids, tensors.scores,
+                             tensors.count, threshold, results, max_results);
+}
+
 std::vector<Object> GetDetectionResults(const float* bboxes, const float* ids,
                                         const float* scores, size_t count,
                                         float threshold, size_t top_k) {
   std::priority_queue<Object, std::vector<Object>, ObjectComparator> q;
 
   for (unsigned int i = 0; i < count; ++i) {
-    const int id = std::round(ids[i]);
-    const float score = scores[i];
-    const float ymin = std::max(0.0f, bboxes[4 * i]);
-    const float xmin = std::max(0.0f, bboxes[4 * i + 1]);
-    const float ymax = std::max(0.0f, bboxes[4 * i + 2]);
-    const float xmax = std::max(0.0f, bboxes[4 * i + 3]);
-    if (score < threshold) {
+    if (scores[i] < threshold) {
       continue;
     }
-    q.push(Object{id, score, BBox<float>{ymin, xmin, ymax, xmax}});
+    q.push(MakeObject(bboxes, ids, scores, i));
     if (q.size() > top_k) {
       q.pop();
     }
@@ -75,26 +280,22 @@ std::vector<Object> GetDetectionResults(const float* bboxes, const float* ids,
 
 std::vector<Object> GetDetectionResults(tflite::MicroInterpreter* interpreter,
                                         float threshold, size_t top_k) {
-  if (interpreter->outputs().size() != 4) {
-    printf("Output size mismatch\r\n");
-    return {};
-  }
+  DetectionTensors tensors;
+  if (!GetDetectionTensors(interpreter, &tensors)) return {};
+  return GetDetectionResults(tensors.bboxes, tensors.ids, tensors.scores,
+                             tensors.count, threshold, top_k);
+}
 
-  const float *bboxes, *ids, *scores, *count;
-  if (interpreter->output_tensor(2)->dims->size == 1) {
-    scores = tflite::GetTensorData<float>(interpreter->output_tensor(0));
-    bboxes = tflite::GetTensorData<float>(interpreter->output_tensor(1));
-    count = tflite::GetTensorData<float>(interpreter->output_tensor(2));
-    ids = tflite::GetTensorData<float>(interpreter->output_tensor(3));
-  } else {
-    bboxes = tflite::GetTensorData<float>(interpreter->output_tensor(0));
-    ids = tflite::GetTensorData<float>(interpreter->output_tensor(1));
-    scores = tflite::GetTensorData<float>(interpreter->output_tensor(2));
-    count = tflite::GetTensorData<float>(interpreter->output_tensor(3));
-  }
+size_t NonMaxSuppression(Object* objects, size_t count,
+                         const NmsOptions& options, NmsBox* scratch) {
+  if (options.method == NmsMethod::kGreedy)
+    return GreedyNms(objects, count, options, scratch);
+  return SoftNms(objects, count, options);
+}
 
-  return GetDetectionResults(bboxes, ids, scores, static_cast<size_t>(count[0]),
-                             threshold, top_k);
+void NonMaxSuppression(std::vector<Object>* objects,
+                       const NmsOptions& options) {
+  objects->resize(NonMaxSuppression(objects->data(), objects->size(), options));
 }
 
 }  // namespace coralmicro::tensorflow
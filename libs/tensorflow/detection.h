@@ -17,6 +17,8 @@
 #ifndef LIBS_TENSORFLOW_DETECTION_H_
 #define LIBS_TENSORFLOW_DETECTION_H_
 
+#include <array>
+#include <cstdint>
 #include <limits>
 #include <vector>
 
@@ -47,6 +49,41 @@ struct Object {
   BBox<float> bbox;
 };
 
+// Non-maximum suppression methods for `NonMaxSuppression()`.
+enum class NmsMethod {
+  // Drops every box that overlaps a higher-scoring box by more than the IoU
+  // threshold.
+  kGreedy,
+  // Scales the score of overlapping boxes by (1 - IoU) instead of dropping
+  // them, when the IoU is above the threshold.
+  kSoftLinear,
+  // Scales the score of every overlapping box by exp(-IoU^2 / sigma).
+  kSoftGaussian,
+};
+
+// Options for `NonMaxSuppression()`.
+struct NmsOptions {
+  // The suppression method.
+  NmsMethod method = NmsMethod::kGreedy;
+  // Boxes that overlap a kept box by more than this intersection-over-union
+  // are suppressed (ignored by `kSoftGaussian`).
+  float iou_threshold = 0.5f;
+  // If true, boxes suppress each other regardless of their class id.
+  // Otherwise only boxes with the same id do.
+  bool class_agnostic = false;
+  // The Gaussian width for `kSoftGaussian`.
+  float sigma = 0.5f;
+  // Soft-NMS drops boxes whose score decays below this value.
+  float score_threshold = 0.001f;
+};
+
+// A box in the fixed-point format that `NonMaxSuppression()` compares
+// normalized boxes in. Only used as scratch memory.
+struct NmsBox {
+  int32_t ymin, xmin, ymax, xmax;
+  int64_t area;
+};
+
 // Formats the detection outputs into a string.
 //
 // @param object A vector with all the objects in an object detection
@@ -54,6 +91,18 @@ struct Object {
 // @return A description of all detected objects.
 std::string FormatDetectionOutput(const std::vector<Object>& objects);
 
+// Formats the detection outputs into a caller-provided buffer, without
+// allocating memory.
+//
+// @param objects The objects in an object detection output.
+// @param count The number of objects.
+// @param buffer The buffer to write the NUL-terminated text to.
+// @param size The size of `buffer` in bytes. Text that doesn't fit is
+//   truncated.
+// @return The length of the text written to `buffer`.
+size_t FormatDetectionOutput(const Object* objects, size_t count, char* buffer,
+                             size_t size);
+
 // Converts detection output tensors into a vector of Objects.
 //
 // @param bboxes The output tensor for all detected bounding boxes in
@@ -86,6 +135,95 @@ std::vector<Object> GetDetectionResults(
     float threshold = -std::numeric_limits<float>::infinity(),
     size_t top_k = std::numeric_limits<size_t>::max());
 
+// Converts detection output tensors into Objects, written to caller-provided
+// storage without allocating memory.
+//
+// @param bboxes The output tensor for all detected bounding boxes in
+//  box-corner encoding, for example:
+//  (ymin1,xmin1,ymax1,xmax1,ymin2,xmin2,...).
+// @param ids The output tensor for all label IDs.
+// @param scores The output tensor for all scores.
+// @param count The number of detected objects (all tensors defined above
+//   have valid data for this number of objects).
+// @param threshold The score threshold for results. All returned results have
+//   a score greater-than-or-equal-to this value.
+// @param results The storage for the results, ordered by score (first element
+//   has the highest score).
+// @param max_results The capacity of `results`, which is also the maximum
+//   number of predictions to return.
+// @returns The number of results written.
+size_t GetDetectionResults(const float* bboxes, const float* ids,
+                           const float* scores, size_t count, float threshold,
+                           Object* results, size_t max_results);
+
+// Gets results from a detection model as Objects, written to caller-provided
+// storage without allocating memory.
+//
+// @param interpreter The already-invoked interpreter for your detection model.
+// @param threshold The score threshold for results. All returned results have
+//   a score greater-than-or-equal-to this value.
+// @param results The storage for the results, ordered by score (first element
+//   has the highest score).
+// @param max_results The capacity of `results`, which is also the maximum
+//   number of predictions to return.
+// @returns The number of results written.
+size_t GetDetectionResults(tflite::MicroInterpreter* interpreter,
+                           float threshold, Object* results,
+                           size_t max_results);
+
+// Gets results from a detection model as Objects, written to a fixed-size
+// array without allocating memory. For example:
+//
+// ```
+// std::array<tensorflow::Object, 3> results;
+// auto count = tensorflow::GetDetectionResults(&interpreter, &results, 0.6);
+// ```
+//
+// @param interpreter The already-invoked interpreter for your detection model.
+// @param results The storage for the top N results, ordered by score (first
+//   element has the highest score).
+// @param threshold The score threshold for results. All returned results have
+//   a score greater-than-or-equal-to this value.
+// @returns The number of results written.
+template <size_t N>
+size_t GetDetectionResults(
+    tflite::MicroInterpreter* interpreter, std::array<Object, N>* results,
+    float threshold = -std::numeric_limits<float>::infinity()) {
+  return GetDetectionResults(interpreter, threshold, results->data(), N);
+}
+
+// Removes overlapping detections with non-maximum suppression, in place.
+//
+// Boxes in normalized coordinates (0 to 1.0) are compared with integer
+// arithmetic; other boxes use floats. For example, to drop overlapping boxes
+// before taking the top 3:
+//
+// ```
+// auto results = tensorflow::GetDetectionResults(&interpreter, 0.3);
+// tensorflow::NonMaxSuppression(&results);
+// if (results.size() > 3) results.resize(3);
+// ```
+//
+// @param objects The detected objects, in any order. The kept objects are
+//   moved to the front, ordered by score (first element has the highest
+//   score). Soft-NMS methods also update their scores.
+// @param count The number of objects.
+// @param options The suppression options.
+// @param scratch Optional memory for `count` boxes, which speeds up
+//   `kGreedy` on normalized boxes. No memory is allocated either way.
+// @returns The number of kept objects.
+size_t NonMaxSuppression(Object* objects, size_t count,
+                         const NmsOptions& options = {},
+                         NmsBox* scratch = nullptr);
+
+// Removes overlapping detections with non-maximum suppression.
+//
+// @param objects The detected objects, in any order. Replaced with the kept
+//   objects, ordered by score (first element has the highest score).
+// @param options The suppression options.
+void NonMaxSuppression(std::vector<Object>* objects,
+                       const NmsOptions& options = {});
+
 }  // namespace coralmicro::tensorflow
 
 #endif  // LIBS_TENSORFLOW_DETECTION_H_
@@ -19,6 +19,20 @@
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_interpreter.h"
 
 namespace coralmicro::tensorflow {
+namespace {
+void MakePose(const float* keypoints, const float* keypoints_scores,
+              const float* pose_scores, int i, Pose* pose) {
+  pose->score = pose_scores[i];
+  const float* pose_keypoints = keypoints + (i * kKeypoints * 2);
+  const float* keypoint_scores = keypoints_scores + (i * kKeypoints);
+  for (int j = 0; j < kKeypoints; ++j) {
+    const float* point = pose_keypoints + (j * 2);
+    pose->keypoints[j].x = point[1];
+    pose->keypoints[j].y = point[0];
+    pose->keypoints[j].score = keypoint_scores[j];
+  }
+}
+}  // namespace
 
 std::string FormatPosenetOutput(const std::vector<Pose>& poses) {
   std::string out;
@@ -39,6 +53,45 @@ std::string FormatPosenetOutput(const std::vector<Pose>& poses) {
   return out;
 }
 
+size_t FormatPosenetOutput(const Pose* poses, size_t count, char* buffer,
+                           size_t size) {
+  if (size == 0) return 0;
+  buffer[0] = '\0';
+  size_t length =
+      AppendFormat(buffer, size, 0, "Num Poses: %u\r\n",
+                   static_cast<unsigned int>(count));
+  for (size_t i = 0; i < count; ++i) {
+    length = AppendFormat(buffer, size, length, "Pose %u -- score: %f\r\n",
+                          static_cast<unsigned int>(i),
+                          static_cast<double>(poses[i].score));
+    for (int j = 0; j < kKeypoints; ++j) {
+      const auto& keypoint = poses[i].keypoints[j];
+      length = AppendFormat(buffer, size, length,
+                            "Keypoint %s -- x=%f,y=%f,score=%f\r\n",
+                            KeypointTypes[j], static_cast<double>(keypoint.x),
+                            static_cast<double>(keypoint.y),
+                            static_cast<double>(keypoint.score));
+    }
+  }
+  return length;
+}
+
+size_t GetPosenetOutput(tflite::MicroInterpreter* interpreter, float threshold,
+                        Pose* poses, size_t max_poses) {
+  auto* keypoints = tflite::GetTensorData<float>(interpreter->output(0));
+  auto* keypoints_scores = tflite::GetTensorData<float>(interpreter->output(1));
+  auto* pose_scores = tflite::GetTensorData<float>(interpreter->output(2));
+  auto* num_poses = tflite::GetTensorData<float>(interpreter->output(3));
+  int pose_count = static_cast<int>(num_poses[0]);
+  size_t count = 0;
+  for (int i = 0; i < pose_count && count < max_poses; ++i) {
+    if (pose_scores[i] < threshold)
+      continue;  // Skip poses that are less than the threshold.
+    MakePose(keypoints, keypoints_scores, pose_scores, i, &poses[count++]);
+  }
+  return count;
+}
+
 std::vector<Pose> GetPosenetOutput(tflite::MicroInterpreter* interpreter,
                                    float threshold) {
   auto* keypoints = tflite::GetTensorData<float>(interpreter->output(0));
@@ -52,15 +105,7 @@ std::vector<Pose> GetPosenetOutput(tflite::MicroInterpreter* interpreter,
     if (pose_scores[i] < threshold)
       continue;  // Skip poses that are less than the threshold.
     Pose pose{};
-    pose.score = pose_scores[i];
-    float* pose_keypoints = keypoints + (i * kKeypoints * 2);
-    float* keypoint_scores = keypoints_scores + (i * kKeypoints);
-    for (int j = 0; j < kKeypoints; ++j) {
-      float* point = pose_keypoints + (j * 2);
-      pose.keypoints[j].x = point[1];
-      pose.keypoints[j].y = point[0];
-      pose.keypoints[j].score = keypoint_scores[j];
-    }
+    MakePose(keypoints, keypoints_scores, pose_scores, i, &pose);
     poses.push_back(pose);
   }
   return poses;
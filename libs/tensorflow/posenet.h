@@ -17,6 +17,8 @@
 #ifndef LIBS_POSENET_POSENET_H_
 #define LIBS_POSENET_POSENET_H_
 
+#include <array>
+
 #include "libs/tensorflow/posenet_decoder_op.h"
 #include "libs/tensorflow/utils.h"
 #include "third_party/tflite-micro/tensorflow/lite/c/common.h"
@@ -61,6 +63,18 @@ struct Pose {
 // @return A string showing the posenet's output.
 std::string FormatPosenetOutput(const std::vector<Pose>& poses);
 
+// Formats PoseNet output into a caller-provided buffer, without allocating
+// memory.
+//
+// @param poses The poses in a posenet output.
+// @param count The number of poses.
+// @param buffer The buffer to write the NUL-terminated text to.
+// @param size The size of `buffer` in bytes. Text that doesn't fit is
+//   truncated.
+// @return The length of the text written to `buffer`.
+size_t FormatPosenetOutput(const Pose* poses, size_t count, char* buffer,
+                           size_t size);
+
 // Gets the results from a PoseNet model in the form of a vector of poses.
 //
 // After you invoke the interpreter, pass it to this function to get structured
@@ -74,6 +88,32 @@ std::vector<Pose> GetPosenetOutput(
     tflite::MicroInterpreter* interpreter,
     float threshold = -std::numeric_limits<float>::infinity());
 
+// Gets the results from a PoseNet model, written to caller-provided storage
+// without allocating memory.
+//
+// @param interpreter The already-invoked interpreter for your PoseNet model.
+// @param threshold The overall pose score threshold for results.
+// @param poses The storage for the poses, in model output order.
+// @param max_poses The capacity of `poses`. Poses past this number are
+//   dropped.
+// @return The number of poses written.
+size_t GetPosenetOutput(tflite::MicroInterpreter* interpreter, float threshold,
+                        Pose* poses, size_t max_poses);
+
+// Gets the results from a PoseNet model, written to a fixed-size array
+// without allocating memory.
+//
+// @param interpreter The already-invoked interpreter for your PoseNet model.
+// @param poses The storage for up to N poses, in model output order.
+// @param threshold The overall pose score threshold for results.
+// @return The number of poses written.
+template <size_t N>
+size_t GetPosenetOutput(
+    tflite::MicroInterpreter* interpreter, std::array<Pose, N>* poses,
+    float threshold = -std::numeric_limits<float>::infinity()) {
+  return GetPosenetOutput(interpreter, threshold, poses->data(), N);
+}
+
 }  // namespace coralmicro::tensorflow
 
 #endif  // LIBS_POSENET_POSENET_H_
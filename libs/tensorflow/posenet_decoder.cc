@@ -19,16 +19,25 @@
 #include <algorithm>
 #include <array>
 #include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <iterator>
+#include <limits>
 #include <numeric>
+#include <utility>
 #include <vector>
 
 namespace coralmicro {
 
+using posenet_decoder_op::DecoderScratch;
+using posenet_decoder_op::InstanceMaskOptions;
+using posenet_decoder_op::kNumEdges;
 using posenet_decoder_op::kNumKeypoints;
 using posenet_decoder_op::Point;
+using posenet_decoder_op::PoseBox;
 using posenet_decoder_op::PoseKeypoints;
 using posenet_decoder_op::PoseKeypointScores;
+using posenet_decoder_op::QuantizedTensor;
 
 enum KeypointType {
   kNose,
@@ -129,7 +138,7 @@ void BuildLinearInterpolation(const float x, const int n, int* x_floor,
                               int* x_ceil, float* x_lerp) {
   const float x_proj = clamp(x, 0.0f, n - 1.0f);
   *x_floor = static_cast<int>(floorf(x_proj));
-  *x_ceil = static_cast<int>(ceilf(x_proj));
+  *x_ceil = *x_floor + (x_proj > *x_floor);
   *x_lerp = x - (*x_floor);
 }
 
@@ -161,7 +170,8 @@ void BuildBilinearInterpolation(const float y, const float x, const int height,
 // sample its value at tensor(y, x, c), for c in the channels specified. This
 // is faster than calling the single channel interpolation function multiple
 // times because the computation of the positions needs to be done only once.
-void SampleTensorAtMultipleChannels(const float* tensor, const int height,
+template <typename Tensor>
+void SampleTensorAtMultipleChannels(const Tensor& tensor, const int height,
                                     const int width, const int num_channels,
                                     const float y, const float x,
                                     const int* result_channels,
@@ -188,7 +198,8 @@ void SampleTensorAtMultipleChannels(const float* tensor, const int height,
 // Sample the input tensor values at position (x, y) and at a single channel.
 // The input tensor has shape [height, width, num_channels]. We bilinearly
 // sample its value at tensor(y, x, channel).
-float SampleTensorAtSingleChannel(const float* tensor, const int height,
+template <typename Tensor>
+float SampleTensorAtSingleChannel(const Tensor& tensor, const int height,
                                   const int width, const int num_channels,
                                   const Point& point, const int c) {
   float result;
@@ -199,8 +210,9 @@ float SampleTensorAtSingleChannel(const float* tensor, const int height,
 
 // Follows the mid-range offsets, and then refines the position by the short-
 // range offsets for a fixed number of steps.
-Point FindDisplacedPosition(const float* short_offsets,
-                            const float* mid_offsets, const int height,
+template <typename Tensor>
+Point FindDisplacedPosition(const Tensor& short_offsets,
+                            const Tensor& mid_offsets, const int height,
                             const int width, const int num_keypoints,
                             const int num_edges, const Point& source,
                             const int edge_id, const int target_id,
@@ -241,8 +253,9 @@ AdjacencyList BuildAdjacencyList() {
   return adjacency_list;
 }
 
-void BacktrackDecodePose(const float* scores, const float* short_offsets,
-                         const float* mid_offsets, const int height,
+template <typename Tensor>
+void BacktrackDecodePose(const Tensor& scores, const Tensor& short_offsets,
+                         const Tensor& mid_offsets, const int height,
                          const int width, const int num_keypoints,
                          const int num_edges, const KeypointWithScore& root,
                          const AdjacencyList& adjacency_list,
@@ -254,17 +267,20 @@ void BacktrackDecodePose(const float* scores, const float* short_offsets,
 
   // Used in order to put candidate keypoints in a priority queue w.r.t. their
   // score. Keypoints with higher score have higher priority and will be
-  // decoded/processed first.
-  DecreasingScoreKeypointPriorityQueue decode_queue;
-  decode_queue.push(KeypointWithScore(root.point, root.id, root_score));
+  // decoded/processed first. Every keypoint is pushed at most once per edge
+  // that leads to it, plus once for the root, so the queue lives on the stack.
+  std::array<KeypointWithScore, kEdgeList.size() + 1> decode_queue;
+  auto queue_end = decode_queue.begin();
+  const KeypointWithScoreComparator comparator;
+  *queue_end++ = KeypointWithScore(root.point, root.id, root_score);
 
   // Keeps track of the keypoints whose position has already been decoded.
-  std::vector<bool> keypoint_decoded(num_keypoints, false);
+  std::array<bool, kNumKeypoints> keypoint_decoded{};
 
-  while (!decode_queue.empty()) {
+  while (queue_end != decode_queue.begin()) {
     // The top element in the queue is the next keypoint to be processed.
-    const KeypointWithScore current_keypoint = decode_queue.top();
-    decode_queue.pop();
+    std::pop_heap(decode_queue.begin(), queue_end, comparator);
+    const KeypointWithScore current_keypoint = *--queue_end;
 
     if (keypoint_decoded[current_keypoint.id]) continue;
 
@@ -300,51 +316,83 @@ void BacktrackDecodePose(const float* scores, const float* short_offsets,
       const float child_score = SampleTensorAtSingleChannel(
           scores, height, width, num_keypoints, child_point, child_id);
 
-      decode_queue.emplace(child_point, child_id, child_score);
+      *queue_end++ = KeypointWithScore(child_point, child_id, child_score);
+      std::push_heap(decode_queue.begin(), queue_end, comparator);
     }
   }
 }
 
-void BuildKeypointWithScoreQueue(const float* scores,
-                                 const float* short_offsets, const int height,
+namespace {
+// Raw tensor values, which compare the same way as the values they stand for.
+const float* RawData(const float* tensor) { return tensor; }
+const uint8_t* RawData(const QuantizedTensor& tensor) { return tensor.data(); }
+
+// The smallest raw value that stands for at least `threshold`.
+float RawThreshold(const float* /*tensor*/, const float threshold) {
+  return threshold;
+}
+int RawThreshold(const QuantizedTensor& tensor, const float threshold) {
+  int value = 0;
+  while (value <= UINT8_MAX && tensor.Dequantize(value) < threshold) ++value;
+  return value;
+}
+
+float Dequantize(const float* /*tensor*/, const float value) {
+  return value;
+}
+float Dequantize(const QuantizedTensor& tensor, const int value) {
+  return tensor.Dequantize(value);
+}
+}  // namespace
+
+template <typename Tensor>
+void BuildKeypointWithScoreQueue(const Tensor& scores,
+                                 const Tensor& short_offsets, const int height,
                                  const int width, const int num_keypoints,
                                  const float score_threshold,
                                  const int local_maximum_radius,
                                  DecreasingScoreKeypointPriorityQueue* queue) {
-  int score_index = 0;
+  // Compares raw values, so quantized scores are only dequantized for the
+  // local maxima.
+  const auto* raw_scores = RawData(scores);
+  const auto raw_threshold = RawThreshold(scores, score_threshold);
+  // Only a few percent of the scores pass the threshold, so it's cheaper to
+  // check the window of each of those than to max-filter the whole map.
+  const int row_stride = width * num_keypoints;
   for (int y = 0; y < height; ++y) {
+    const int y_start = std::max(y - local_maximum_radius, 0);
+    const int y_end = std::min(y + local_maximum_radius + 1, height);
     for (int x = 0; x < width; ++x) {
-      int offset_index = 2 * score_index;
+      const int x_start = std::max(x - local_maximum_radius, 0);
+      const int x_end = std::min(x + local_maximum_radius + 1, width);
+      const int score_index = y * row_stride + x * num_keypoints;
+      const auto* window =
+          raw_scores + y_start * row_stride + x_start * num_keypoints;
       for (int j = 0; j < num_keypoints; ++j) {
-        const float score = scores[score_index];
-        if (score >= score_threshold) {
-          // Only consider keypoints whose score is maximum in a local window.
-          bool local_maximum = true;
-          const int y_start = std::max(y - local_maximum_radius, 0);
-          const int y_end = std::min(y + local_maximum_radius + 1, height);
-          for (int y_current = y_start; y_current < y_end; ++y_current) {
-            const int x_start = std::max(x - local_maximum_radius, 0);
-            const int x_end = std::min(x + local_maximum_radius + 1, width);
-            for (int x_current = x_start; x_current < x_end; ++x_current) {
-              if (scores[y_current * width * num_keypoints +
-                         x_current * num_keypoints + j] > score) {
-                local_maximum = false;
-                break;
-              }
+        const auto score = raw_scores[score_index + j];
+        if (score < raw_threshold) continue;
+
+        // Only consider keypoints whose score is maximum in a local window.
+        bool local_maximum = true;
+        const auto* row = window + j;
+        for (int y_current = y_start; y_current < y_end && local_maximum;
+             ++y_current, row += row_stride) {
+          for (int i = 0; i < x_end - x_start; ++i) {
+            if (row[i * num_keypoints] > score) {
+              local_maximum = false;
+              break;
             }
-            if (!local_maximum) break;
-          }
-          if (local_maximum) {
-            const float dy = short_offsets[offset_index];
-            const float dx = short_offsets[offset_index + num_keypoints];
-            const float y_refined = clamp(y + dy, 0.0f, height - 1.0f);
-            const float x_refined = clamp(x + dx, 0.0f, width - 1.0f);
-            queue->emplace(Point{y_refined, x_refined}, j, score);
           }
         }
-
-        ++score_index;
-        ++offset_index;
+        if (!local_maximum) continue;
+
+        const int offset_index = 2 * score_index + j;
+        const float dy = short_offsets[offset_index];
+        const float dx = short_offsets[offset_index + num_keypoints];
+        const float y_refined = clamp(y + dy, 0.0f, height - 1.0f);
+        const float x_refined = clamp(x + dx, 0.0f, width - 1.0f);
+        queue->emplace(Point{y_refined, x_refined}, j,
+                       Dequantize(scores, score));
       }
     }
   }
@@ -428,8 +476,9 @@ float ComputeSumSquaredDistance(const std::vector<Point>& embedding,
 
 // Follows the long-range offsets, and then refines the position by the
 // long-range offsets for a fixed number of steps.
+template <typename Tensor>
 Point GetEmbedding(const int y_location, const int x_location,
-                   const float* long_offsets, const int keypoint_index,
+                   const Tensor& long_offsets, const int keypoint_index,
                    const int refinement_steps, const int height,
                    const int width, const int num_keypoints, const int stride) {
   float y = static_cast<float>(y_location);
@@ -449,47 +498,82 @@ Point GetEmbedding(const int y_location, const int x_location,
 
 // Matches the list of embeddings to a pose in a list of poses based off the
 // sum of the squared distance between the pose keypoints and the embeddings.
+template <typename Tensor>
 int MatchEmbeddingToInstance(const int y_location, const int x_location,
-                             const float* long_offsets, const int height,
+                             const Tensor& long_offsets, const int height,
                              const int width, PoseKeypoints* poses,
                              const size_t num_poses, const int num_keypoints,
                              const int refinement_steps, const int stride) {
-  std::vector<Point> embeddings;
-  embeddings.reserve(num_keypoints);
+  if (num_poses == 0) return -1;
+  std::array<Point, kNumKeypoints> embeddings;
   for (int i = 0; i < num_keypoints; i++) {
-    embeddings.push_back(GetEmbedding(y_location, x_location, long_offsets, i,
-                                      refinement_steps, height, width,
-                                      num_keypoints, stride));
+    embeddings[i] = GetEmbedding(y_location, x_location, long_offsets, i,
+                                 refinement_steps, height, width,
+                                 num_keypoints, stride);
   }
-  std::vector<float> dists;
-  dists.reserve(num_poses);
+  // The sums only grow, so stop adding up a pose once it can't beat the
+  // closest one so far. Ties go to the first pose.
+  int closest = 0;
+  float closest_distance = std::numeric_limits<float>::infinity();
   for (size_t k = 0; k < num_poses; k++) {
-    dists.push_back(ComputeSumSquaredDistance(embeddings, poses[k]));
+    float distance = 0;
+    for (int p = 0; p < num_keypoints && distance < closest_distance; p++) {
+      distance += ComputeSquaredDistance(embeddings[p], poses[k].keypoint[p]);
+    }
+    if (distance < closest_distance) {
+      closest = k;
+      closest_distance = distance;
+    }
   }
-  return std::distance(dists.begin(),
-                       std::min_element(dists.begin(), dists.end()));
+  return closest;
 }
 
-namespace posenet_decoder_op {
+namespace {
+// A queue of root candidates that borrows its storage from a
+// `DecoderScratch`, and gives it back empty, with its capacity, when done.
+class ScratchKeypointQueue : public DecreasingScoreKeypointPriorityQueue {
+ public:
+  explicit ScratchKeypointQueue(std::vector<KeypointWithScore>* storage)
+      : storage_(storage) {
+    storage_->clear();
+    c.swap(*storage_);
+  }
+  ~ScratchKeypointQueue() {
+    c.clear();
+    c.swap(*storage_);
+  }
+  ScratchKeypointQueue(const ScratchKeypointQueue&) = delete;
+  ScratchKeypointQueue& operator=(const ScratchKeypointQueue&) = delete;
 
-int DecodeAllPoses(const float* scores, const float* short_offsets,
-                   const float* mid_offsets, const int height, const int width,
-                   const int max_detections, const float score_threshold,
-                   const int mid_short_offset_refinement_steps,
-                   const float nms_radius, const int stride,
-                   PoseKeypoints* pose_keypoints,
-                   PoseKeypointScores* pose_keypoint_scores,
-                   float* pose_scores) {
+ private:
+  std::vector<KeypointWithScore>* storage_;
+};
+
+template <typename Tensor>
+int DecodePoses(const Tensor& scores, const Tensor& short_offsets,
+                const Tensor& mid_offsets, const int height, const int width,
+                const int max_detections, const float score_threshold,
+                const int mid_short_offset_refinement_steps,
+                const float nms_radius, const int stride,
+                PoseKeypoints* pose_keypoints,
+                PoseKeypointScores* pose_keypoint_scores, float* pose_scores,
+                DecoderScratch* scratch) {
   static const int kLocalMaximumRadius = 1;
 
   // score_threshold threshold as a logit, before sigmoid
   const float min_score_logit = Logodds(score_threshold);
 
-  DecreasingScoreKeypointPriorityQueue queue;
+  DecoderScratch local_scratch;
+  if (!scratch) scratch = &local_scratch;
+  // Reserve room for about one root candidate per cell, so the queue doesn't
+  // grow one reallocation at a time. It can grow past this, up to one
+  // candidate per cell and keypoint; see `DecoderScratch::Reserve()`.
+  scratch->candidates.reserve(height * width);
+  ScratchKeypointQueue queue(&scratch->candidates);
   BuildKeypointWithScoreQueue(scores, short_offsets, height, width,
                               kNumKeypoints, min_score_logit,
                               kLocalMaximumRadius, &queue);
-  AdjacencyList adjacency_list = BuildAdjacencyList();
+  static const AdjacencyList adjacency_list = BuildAdjacencyList();
 
   const int topk = kNumKeypoints;
   std::vector<int> indices(kNumKeypoints);
@@ -499,6 +583,7 @@ int DecodeAllPoses(const float* scores, const float* short_offsets,
   // Generate at most max_detections object instances per image in decreasing
   // root part score order.
   std::vector<float> all_instance_scores;
+  all_instance_scores.reserve(max_detections);
 
   std::vector<PoseKeypoints> scratch_poses(max_detections);
   std::vector<PoseKeypointScores> scratch_keypoint_scores(max_detections);
@@ -583,21 +668,213 @@ int DecodeAllPoses(const float* scores, const float* short_offsets,
   return pose_counter;
 }
 
-void DecodeInstanceMasks(const float* long_offsets, int height, int width,
-                         PoseKeypoints* poses, size_t num_poses,
-                         int refinement_steps, int stride,
-                         float* instance_masks) {
-  std::fill(instance_masks, instance_masks + height * width * num_poses, 0.0f);
-  for (int y = 0; y < height; y++) {
-    for (int x = 0; x < width; x++) {
-      int instance_index = MatchEmbeddingToInstance(
-          y, x, long_offsets, height, width, poses, num_poses, kNumKeypoints,
-          refinement_steps, stride);
-      if (instance_index >= 0) {
-        instance_masks[(instance_index * width + y) * height + x] = 1.0f;
+template <typename Tensor, typename Mask>
+void DecodeMasks(const Tensor& long_offsets, int height, int width,
+                 PoseKeypoints* poses, size_t num_poses, int refinement_steps,
+                 int stride, const InstanceMaskOptions& options,
+                 Mask* instance_masks, DecoderScratch* scratch) {
+  const int mask_size = height * width;
+  std::fill(instance_masks, instance_masks + mask_size * num_poses, Mask(0));
+  if (num_poses == 0) return;
+
+  DecoderScratch local_scratch;
+  if (!scratch) scratch = &local_scratch;
+  auto& boxes = scratch->boxes;
+  boxes.clear();
+  if (std::isfinite(options.max_box_distance)) {
+    const float margin = options.max_box_distance;
+    boxes.reserve(num_poses);
+    for (size_t k = 0; k < num_poses; ++k) {
+      const auto& keypoints = poses[k].keypoint;
+      const auto [ymin, ymax] = std::minmax_element(
+          std::begin(keypoints), std::end(keypoints),
+          [](const Point& a, const Point& b) { return a.y < b.y; });
+      const auto [xmin, xmax] = std::minmax_element(
+          std::begin(keypoints), std::end(keypoints),
+          [](const Point& a, const Point& b) { return a.x < b.x; });
+      boxes.push_back({ymin->y - margin, xmin->x - margin, ymax->y + margin,
+                       xmax->x + margin});
+    }
+  }
+
+  // Gets the pose a pixel belongs to, or -1 if it's too far from all of them.
+  auto match = [&](const int y, const int x) {
+    if (!boxes.empty() &&
+        std::none_of(boxes.begin(), boxes.end(), [&](const PoseBox& box) {
+          return box.Contains(y * stride, x * stride);
+        })) {
+      return -1;
+    }
+    return MatchEmbeddingToInstance(y, x, long_offsets, height, width, poses,
+                                    num_poses, kNumKeypoints,
+                                    refinement_steps, stride);
+  };
+  auto set = [&](const int y, const int x, const int instance_index) {
+    if (instance_index >= 0) {
+      instance_masks[(instance_index * height + y) * width + x] = Mask(1);
+    }
+  };
+
+  const int step = std::max(options.coarse_step, 1);
+  if (step == 1) {
+    for (int y = 0; y < height; y++) {
+      for (int x = 0; x < width; x++) set(y, x, match(y, x));
+    }
+    return;
+  }
+
+  // Labels the corners of each step x step cell, and only matches the pixels
+  // inside when the corners disagree.
+  constexpr int16_t kUnknown = -2;
+  auto& labels = scratch->labels;
+  labels.assign(mask_size, kUnknown);
+  auto label = [&](const int y, const int x) {
+    auto& l = labels[y * width + x];
+    if (l == kUnknown) l = match(y, x);
+    return l;
+  };
+  for (int y0 = 0; y0 < height; y0 += step) {
+    const int y1 = std::min(y0 + step, height - 1);
+    for (int x0 = 0; x0 < width; x0 += step) {
+      const int x1 = std::min(x0 + step, width - 1);
+      const int16_t corner = label(y0, x0);
+      const bool uniform = label(y0, x1) == corner &&
+                           label(y1, x0) == corner && label(y1, x1) == corner;
+      for (int y = y0; y <= y1; ++y) {
+        for (int x = x0; x <= x1; ++x) {
+          auto& l = labels[y * width + x];
+          if (l == kUnknown) l = uniform ? corner : match(y, x);
+        }
       }
     }
   }
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) set(y, x, labels[y * width + x]);
+  }
+}
+}  // namespace
+
+template void SampleTensorAtMultipleChannels(const float* const&, int, int,
+                                             int, float, float, const int*,
+                                             size_t, float*);
+template float SampleTensorAtSingleChannel(const float* const&, int, int, int,
+                                           const Point&, int);
+template Point FindDisplacedPosition(const float* const&, const float* const&,
+                                     int, int, int, int, const Point&, int,
+                                     int, int);
+template void BacktrackDecodePose(const float* const&, const float* const&,
+                                  const float* const&, int, int, int, int,
+                                  const KeypointWithScore&,
+                                  const AdjacencyList&, int, PoseKeypoints*,
+                                  PoseKeypointScores*);
+template void BuildKeypointWithScoreQueue(
+    const float* const&, const float* const&, int, int, int, float, int,
+    DecreasingScoreKeypointPriorityQueue*);
+template Point GetEmbedding(int, int, const float* const&, int, int, int, int,
+                            int, int);
+template int MatchEmbeddingToInstance(int, int, const float* const&, int, int,
+                                      PoseKeypoints*, size_t, int, int, int);
+
+namespace posenet_decoder_op {
+
+void DecoderScratch::Reserve(const int height, const int width,
+                             const int max_detections) {
+  candidates.reserve(height * width);
+  boxes.reserve(max_detections);
+  labels.reserve(height * width);
+}
+
+DequantizationTable MakeDequantizationTable(int zero_point, float scale,
+                                            float extra_scale) {
+  DequantizationTable table;
+  for (int value = 0; value <= UINT8_MAX; ++value) {
+    table[value] = (value - zero_point) * scale * extra_scale;
+  }
+  return table;
+}
+
+int DecodeAllPoses(const float* scores, const float* short_offsets,
+                   const float* mid_offsets, const int height, const int width,
+                   const int max_detections, const float score_threshold,
+                   const int mid_short_offset_refinement_steps,
+                   const float nms_radius, const int stride,
+                   PoseKeypoints* pose_keypoints,
+                   PoseKeypointScores* pose_keypoint_scores,
+                   float* pose_scores, DecoderScratch* scratch) {
+  return DecodePoses(scores, short_offsets, mid_offsets, height, width,
+                     max_detections, score_threshold,
+                     mid_short_offset_refinement_steps, nms_radius, stride,
+                     pose_keypoints, pose_keypoint_scores, pose_scores,
+                     scratch);
+}
+
+int DecodeAllPoses(const QuantizedTensor& scores,
+                   const QuantizedTensor& short_offsets,
+                   const QuantizedTensor& mid_offsets, const int height,
+                   const int width, const int max_detections,
+                   const float score_threshold,
+                   const int mid_short_offset_refinement_steps,
+                   const float nms_radius, const int stride,
+                   PoseKeypoints* pose_keypoints,
+                   PoseKeypointScores* pose_keypoint_scores,
+                   float* pose_scores, DecoderScratch* scratch) {
+  return DecodePoses(scores, short_offsets, mid_offsets, height, width,
+                     max_detections, score_threshold,
+                     mid_short_offset_refinement_steps, nms_radius, stride,
+                     pose_keypoints, pose_keypoint_scores, pose_scores,
+                     scratch);
+}
+
+void DecodeInstanceMasks(const float* long_offsets, int height, int width,
+                         PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         float* instance_masks, DecoderScratch* scratch) {
+  DecodeMasks(long_offsets, height, width, poses, num_poses, refinement_steps,
+              stride, InstanceMaskOptions(), instance_masks, scratch);
+}
+
+void DecodeInstanceMasks(const QuantizedTensor& long_offsets, int height,
+                         int width, PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         float* instance_masks, DecoderScratch* scratch) {
+  DecodeMasks(long_offsets, height, width, poses, num_poses, refinement_steps,
+              stride, InstanceMaskOptions(), instance_masks, scratch);
+}
+
+void DecodeInstanceMasks(const float* long_offsets, int height, int width,
+                         PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         float* instance_masks, DecoderScratch* scratch) {
+  DecodeMasks(long_offsets, height, width, poses, num_poses, refinement_steps,
+              stride, options, instance_masks, scratch);
+}
+
+void DecodeInstanceMasks(const QuantizedTensor& long_offsets, int height,
+                         int width, PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         float* instance_masks, DecoderScratch* scratch) {
+  DecodeMasks(long_offsets, height, width, poses, num_poses, refinement_steps,
+              stride, options, instance_masks, scratch);
+}
+
+void DecodeInstanceMasks(const float* long_offsets, int height, int width,
+                         PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         uint8_t* instance_masks, DecoderScratch* scratch) {
+  DecodeMasks(long_offsets, height, width, poses, num_poses, refinement_steps,
+              stride, options, instance_masks, scratch);
+}
+
+void DecodeInstanceMasks(const QuantizedTensor& long_offsets, int height,
+                         int width, PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         uint8_t* instance_masks, DecoderScratch* scratch) {
+  DecodeMasks(long_offsets, height, width, poses, num_poses, refinement_steps,
+              stride, options, instance_masks, scratch);
 }
 
 }  // namespace posenet_decoder_op
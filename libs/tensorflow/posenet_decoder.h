@@ -17,10 +17,14 @@
 #ifndef LIBS_POSENET_POSENET_DECODER_H_
 #define LIBS_POSENET_POSENET_DECODER_H_
 
+#include <array>
+#include <cstdint>
 #include <ostream>
 #include <queue>
 #include <vector>
 
+#include "posenet_decoder_op.h"
+
 namespace coralmicro {
 
 // An adjacency list representing the directed edges connecting keypoints.
@@ -62,6 +66,38 @@ struct PoseKeypointScores {
   float keypoint[posenet_decoder_op::kNumKeypoints];
 };
 
+// Working memory for the decoder. Defined below.
+struct DecoderScratch;
+
+// The dequantized value of each uint8 value, for `QuantizedTensor`.
+using DequantizationTable = std::array<float, UINT8_MAX + 1>;
+
+// Builds a table that dequantizes values as
+// (value - zero_point) * scale * extra_scale.
+DequantizationTable MakeDequantizationTable(int zero_point, float scale,
+                                            float extra_scale = 1.0f);
+
+// A uint8 decoder input that is dequantized as it's read, so only the values
+// the decoder samples are ever converted to float.
+class QuantizedTensor {
+ public:
+  // @param data The quantized values.
+  // @param table The dequantized value of each uint8 value. Must outlive this
+  //   object.
+  QuantizedTensor(const uint8_t* data, const DequantizationTable* table)
+      : data_(data), table_(table) {}
+
+  float operator[](int index) const { return Dequantize(data_[index]); }
+
+  float Dequantize(int value) const { return (*table_)[value]; }
+
+  const uint8_t* data() const { return data_; }
+
+ private:
+  const uint8_t* data_;
+  const DequantizationTable* table_;
+};
+
 // Decodes poses from the score map, the short and mid offsets.
 // "Block space" refers to the output y and z size of the network.
 // For example if the network that takes a (353,481) (y,x) input image will have
@@ -99,20 +135,73 @@ int DecodeAllPoses(
         pose_keypoint_scores,  // pointer to preallocated buffer
                                // of size
                                // [max_detections*sizeof(PoseKeypointScores)]
-    float* pose_scores         // pointer to preallocated buffer of size
+    float* pose_scores,        // pointer to preallocated buffer of size
                                // [max_detections*sizeof(float)]
+    DecoderScratch* scratch = nullptr  // working memory kept between calls,
+                                       // or null to allocate it
 );
 
+// Decodes poses the same way from uint8 tensors, without dequantizing them
+// first. Scores are compared in their quantized form and only the sampled
+// values are dequantized, which gives the same poses as dequantizing the
+// whole tensors. The heatmap scale must be positive.
+int DecodeAllPoses(const QuantizedTensor& scores,
+                   const QuantizedTensor& short_offsets,
+                   const QuantizedTensor& mid_offsets, int height, int width,
+                   int max_detections, float score_threshold,
+                   int mid_short_offset_refinement_steps, float nms_radius,
+                   int stride, PoseKeypoints* pose_keypoints,
+                   PoseKeypointScores* pose_keypoint_scores,
+                   float* pose_scores, DecoderScratch* scratch = nullptr);
+
 // Decodes person instance masks from decoded poses and long_offsets.
 //   long_offsets 33x33x2*kNumKeypoints (x and y per keypoint)
 void DecodeInstanceMasks(const float* long_offsets, int height, int width,
                          PoseKeypoints* poses, size_t num_poses,
                          int refinement_steps, int stride,
-                         float* instance_masks);
+                         float* instance_masks,
+                         DecoderScratch* scratch = nullptr);
+
+// Decodes person instance masks from uint8 long_offsets, without
+// dequantizing them first.
+void DecodeInstanceMasks(const QuantizedTensor& long_offsets, int height,
+                         int width, PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         float* instance_masks,
+                         DecoderScratch* scratch = nullptr);
+
+// Decodes person instance masks, optionally trading accuracy for speed.
+//   instance_masks num_poses x height x width, 1 for the pixels of each pose
+//   and 0 elsewhere
+void DecodeInstanceMasks(const float* long_offsets, int height, int width,
+                         PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         float* instance_masks,
+                         DecoderScratch* scratch = nullptr);
+void DecodeInstanceMasks(const QuantizedTensor& long_offsets, int height,
+                         int width, PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         float* instance_masks,
+                         DecoderScratch* scratch = nullptr);
+void DecodeInstanceMasks(const float* long_offsets, int height, int width,
+                         PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         uint8_t* instance_masks,
+                         DecoderScratch* scratch = nullptr);
+void DecodeInstanceMasks(const QuantizedTensor& long_offsets, int height,
+                         int width, PoseKeypoints* poses, size_t num_poses,
+                         int refinement_steps, int stride,
+                         const InstanceMaskOptions& options,
+                         uint8_t* instance_masks,
+                         DecoderScratch* scratch = nullptr);
 }  // namespace posenet_decoder_op
 
 // Defines a 2-D keypoint with (x, y) float coordinates and its type id.
 struct KeypointWithScore {
+  KeypointWithScore() = default;
   KeypointWithScore(const posenet_decoder_op::Point& _point, const int _id,
                     const float _score)
       : point(_point), id(_id), score(_score) {}
@@ -139,6 +228,41 @@ using DecreasingScoreKeypointPriorityQueue =
     std::priority_queue<KeypointWithScore, std::vector<KeypointWithScore>,
                         KeypointWithScoreComparator>;
 
+namespace posenet_decoder_op {
+
+// The bounding box of a pose, grown by a margin.
+struct PoseBox {
+  float ymin, xmin, ymax, xmax;
+
+  bool Contains(const float y, const float x) const {
+    return y >= ymin && y <= ymax && x >= xmin && x <= xmax;
+  }
+};
+
+// Working memory for `DecodeAllPoses()` and `DecodeInstanceMasks()`. Pass the
+// same one to every call: its buffers keep their capacity, so decoding doesn't
+// allocate once they have grown to fit.
+struct DecoderScratch {
+  // Reserves room for decoding outputs of `height` x `width` blocks into at
+  // most `max_detections` poses.
+  //
+  // This reserves one root candidate per block, which covers typical
+  // outputs. The queue can hold up to one candidate per block and keypoint
+  // (every local maximum above the score threshold); past the reserve it
+  // grows once and keeps that capacity for the next calls. Reserving the
+  // worst case would take `height * width * kNumKeypoints` candidates.
+  void Reserve(int height, int width, int max_detections);
+
+  // Storage for the queue of root keypoint candidates.
+  std::vector<KeypointWithScore> candidates;
+  // The box of each pose, for `InstanceMaskOptions::max_box_distance`.
+  std::vector<PoseBox> boxes;
+  // The pose of each block, for `InstanceMaskOptions::coarse_step`.
+  std::vector<int16_t> labels;
+};
+
+}  // namespace posenet_decoder_op
+
 void DecreasingArgSort(const float* scores, const size_t len,
                        std::vector<int>* indices);
 
@@ -161,37 +285,45 @@ void BuildBilinearInterpolation(const float y, const float x, const int height,
                                 int* bottom_right, float* y_lerp,
                                 float* x_lerp);
 
-void SampleTensorAtMultipleChannels(const float* tensor, const int height,
+// The helpers below that read tensors take either a `const float*` or a
+// `posenet_decoder_op::QuantizedTensor`.
+
+template <typename Tensor>
+void SampleTensorAtMultipleChannels(const Tensor& tensor, const int height,
                                     const int width, const int num_channels,
                                     const float y, const float x,
                                     const int* result_channels,
                                     const size_t n_result_channels,
                                     float* result);
 
-float SampleTensorAtSingleChannel(const float* tensor, const int height,
+template <typename Tensor>
+float SampleTensorAtSingleChannel(const Tensor& tensor, const int height,
                                   const int width, const int num_channels,
                                   const posenet_decoder_op::Point& point,
                                   const int c);
 
+template <typename Tensor>
 posenet_decoder_op::Point FindDisplacedPosition(
-    const float* short_offsets, const float* mid_offsets, const int height,
+    const Tensor& short_offsets, const Tensor& mid_offsets, const int height,
     const int width, const int num_keypoints, const int num_edges,
     const posenet_decoder_op::Point& source, const int edge_id,
     const int target_id, const int mid_short_offset_refinement_steps);
 
 AdjacencyList BuildAdjacencyList();
 
+template <typename Tensor>
 void BacktrackDecodePose(
-    const float* scores, const float* short_offsets, const float* mid_offsets,
-    const int height, const int width, const int num_keypoints,
-    const int num_edges, const KeypointWithScore& root,
+    const Tensor& scores, const Tensor& short_offsets,
+    const Tensor& mid_offsets, const int height, const int width,
+    const int num_keypoints, const int num_edges, const KeypointWithScore& root,
     const AdjacencyList& adjacency_list,
     const int mid_short_offset_refinement_steps,
     posenet_decoder_op::PoseKeypoints* pose_keypoints,
     posenet_decoder_op::PoseKeypointScores* keypoint_scores);
 
-void BuildKeypointWithScoreQueue(const float* scores,
-                                 const float* short_offsets, const int height,
+template <typename Tensor>
+void BuildKeypointWithScoreQueue(const Tensor& scores,
+                                 const Tensor& short_offsets, const int height,
                                  const int width, const int num_keypoints,
                                  const float score_threshold,
                                  const int local_maximum_radius,
@@ -217,13 +349,15 @@ float ComputeSumSquaredDistance(
     const std::vector<posenet_decoder_op::Point>& embedding,
     const posenet_decoder_op::PoseKeypoints& pose);
 
+template <typename Tensor>
 posenet_decoder_op::Point GetEmbedding(
-    const int y_location, const int x_location, const float* long_offsets,
+    const int y_location, const int x_location, const Tensor& long_offsets,
     const int keypoint_index, const int refinement_steps, const int height,
     const int width, const int num_keypoints, const int stride);
 
+template <typename Tensor>
 int MatchEmbeddingToInstance(const int y_location, const int x_location,
-                             const float* long_offsets, const int height,
+                             const Tensor& long_offsets, const int height,
                              const int width,
                              posenet_decoder_op::PoseKeypoints* poses,
                              const size_t num_poses, const int num_keypoints,
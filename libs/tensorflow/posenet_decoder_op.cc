@@ -33,6 +33,7 @@ using tflite::GetInput;
 using tflite::GetOutput;
 using tflite::GetTensorData;
 using tflite::NumDimensions;
+using tflite::NumElements;
 using tflite::NumInputs;
 using tflite::NumOutputs;
 
@@ -56,16 +57,23 @@ struct OpData {
   int stride;
   float nms_radius;
 
-  // Temporary tensors (e.g for dequantized values)
-  void* heatmaps_float_ptr;
-  void* shorts_float_ptr;
-  void* mids_float_ptr;
-  void* longs_float_ptr;
+  // Dequantizes the inputs as they're read, including the rescaling of the
+  // offsets from pixels to blocks.
+  DequantizationTable tables[kNumInputs];
 
-  int zero_point[kNumInputs];
-  float scale[kNumInputs];
+  // Decoder working memory, sized in `Prepare()` so `Eval()` doesn't
+  // allocate.
+  DecoderScratch scratch;
+
+  InstanceMaskOptions mask_options;
+  // The type of the instance mask output, or `kTfLiteNoType` to skip
+  // decoding masks.
+  TfLiteType mask_type;
 };
 
+// The instance mask options for the ops initialized next.
+InstanceMaskOptions g_mask_options;
+
 void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   auto* op_data = new OpData;
   const uint8_t* buffer_t = reinterpret_cast<const uint8_t*>(buffer);
@@ -75,6 +83,7 @@ void* Init(TfLiteContext* context, const char* buffer, size_t length) {
   op_data->score_threshold = m["score_threshold"].AsFloat();
   op_data->stride = m["stride"].AsInt32();
   op_data->nms_radius = m["nms_radius"].AsFloat();
+  op_data->mask_options = g_mask_options;
 
   return op_data;
 }
@@ -83,39 +92,13 @@ void Free(TfLiteContext* context, void* buffer) {
   delete reinterpret_cast<OpData*>(buffer);
 }
 
-TfLiteStatus PrepTempTensor(TfLiteContext* context, void** temp_tensor_ptr,
-                            const TfLiteIntArray* dims) {
-  int bytes = sizeof(float);
-  for (int i = 0; i < dims->size; ++i) {
-    bytes *= dims->data[i];
-  }
-  *temp_tensor_ptr = context->AllocatePersistentBuffer(context, bytes);
-  if (*temp_tensor_ptr) {
-    return kTfLiteOk;
-  } else {
-    return kTfLiteError;
-  }
-}
-
-void DequantizeTensor(const TfLiteEvalTensor* src, void* dst,
-                      const OpData* op_data, const int tensor_type,
-                      float extra_scale = 1.0) {
-  if (tensor_type >= kNumInputs || tensor_type < 0) {
-    assert(false);
-  }
-  if (src->type == kTfLiteUInt8) {
-    const int num_elements = tflite::micro::GetTensorShape(src).FlatSize();
-    const uint8_t* src_data = tflite::micro::GetTensorData<uint8_t>(src);
-    assert(src_data != nullptr);
-    float* dst_data = reinterpret_cast<float*>(dst);
-    assert(dst_data != nullptr);
-    for (int idx = 0; idx < num_elements; ++idx) {
-      dst_data[idx] = (src_data[idx] - op_data->zero_point[tensor_type]) *
-                      op_data->scale[tensor_type] * extra_scale;
-    }
-  } else {
-    assert(false);
-  }
+// Reads a uint8 input in place, dequantizing only the values the decoder
+// samples.
+QuantizedTensor GetQuantizedInput(const TfLiteEvalTensor* tensor,
+                                  const OpData* op_data,
+                                  const int tensor_type) {
+  return QuantizedTensor(tflite::micro::GetTensorData<uint8_t>(tensor),
+                         &op_data->tables[tensor_type]);
 }
 
 TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
@@ -138,12 +121,12 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
       micro_context->AllocateTempInputTensor(node, kInputTensorMidOffsets);
   TF_LITE_ENSURE(context, mids != nullptr);
 
-  TF_LITE_ENSURE(context, (heatmaps->type == kTfLiteUInt8 ||  //
-                           heatmaps->type == kTfLiteFloat32));
-  TF_LITE_ENSURE(context, (shorts->type == kTfLiteUInt8 ||  //
-                           shorts->type == kTfLiteFloat32));
-  TF_LITE_ENSURE(context, (mids->type == kTfLiteUInt8 ||  //
-                           mids->type == kTfLiteFloat32));
+  // The decoder reads the quantized outputs of the Edge TPU in place.
+  TF_LITE_ENSURE_TYPES_EQ(context, heatmaps->type, kTfLiteUInt8);
+  TF_LITE_ENSURE_TYPES_EQ(context, shorts->type, kTfLiteUInt8);
+  TF_LITE_ENSURE_TYPES_EQ(context, mids->type, kTfLiteUInt8);
+  // Scores are compared in their quantized form.
+  TF_LITE_ENSURE(context, heatmaps->params.scale > 0);
   TF_LITE_ENSURE_EQ(context, NumDimensions(heatmaps), 4);
   TF_LITE_ENSURE_EQ(context, NumDimensions(shorts), 4);
   TF_LITE_ENSURE_EQ(context, NumDimensions(mids), 4);
@@ -154,35 +137,43 @@ TfLiteStatus Prepare(TfLiteContext* context, TfLiteNode* node) {
   TF_LITE_ENSURE_EQ(context, shorts->dims->data[3], 2 * kNumKeypoints);
   TF_LITE_ENSURE_EQ(context, mids->dims->data[3], 2 * 2 * kNumEdges);
 
-  TF_LITE_ENSURE_OK(
-      context,
-      PrepTempTensor(context, &op_data->heatmaps_float_ptr, heatmaps->dims));
-  op_data->scale[kInputTensorHeatmaps] = heatmaps->params.scale;
-  op_data->zero_point[kInputTensorHeatmaps] = heatmaps->params.zero_point;
-  TF_LITE_ENSURE_OK(context, PrepTempTensor(context, &op_data->shorts_float_ptr,
-                                            shorts->dims));
-  op_data->scale[kInputTensorShortOffsets] = shorts->params.scale;
-  op_data->zero_point[kInputTensorShortOffsets] = shorts->params.zero_point;
-  TF_LITE_ENSURE_OK(
-      context, PrepTempTensor(context, &op_data->mids_float_ptr, mids->dims));
-  op_data->scale[kInputTensorMidOffsets] = mids->params.scale;
-  op_data->zero_point[kInputTensorMidOffsets] = mids->params.zero_point;
-
+  TF_LITE_ENSURE(context, op_data->stride > 0);
+  op_data->scratch.Reserve(/*height = */ heatmaps->dims->data[1],
+                           /*width = */ heatmaps->dims->data[2],
+                           op_data->max_detections);
+  op_data->tables[kInputTensorHeatmaps] = MakeDequantizationTable(
+      heatmaps->params.zero_point, heatmaps->params.scale);
+  op_data->tables[kInputTensorShortOffsets] =
+      MakeDequantizationTable(shorts->params.zero_point, shorts->params.scale,
+                              1.0 / op_data->stride);
+  op_data->tables[kInputTensorMidOffsets] =
+      MakeDequantizationTable(mids->params.zero_point, mids->params.scale,
+                              1.0 / op_data->stride);
+
+  op_data->mask_type = kTfLiteNoType;
   if (compute_masks) {
     TfLiteTensor* longs =
         micro_context->AllocateTempInputTensor(node, kInputTensorLongOffsets);
     TF_LITE_ENSURE(context, longs != nullptr);
-    TF_LITE_ENSURE(context, (longs->type == kTfLiteUInt8 ||  //
-                             longs->type == kTfLiteFloat32));
+    TF_LITE_ENSURE_TYPES_EQ(context, longs->type, kTfLiteUInt8);
     TF_LITE_ENSURE_EQ(context, NumDimensions(longs), 4);
     TF_LITE_ENSURE_EQ(context, longs->dims->data[0], 1);
     TF_LITE_ENSURE_EQ(context, longs->dims->data[3], 2 * kNumKeypoints);
-
-    TF_LITE_ENSURE_OK(
-        context,
-        PrepTempTensor(context, &op_data->longs_float_ptr, longs->dims));
-    op_data->scale[kInputTensorLongOffsets] = longs->params.scale;
-    op_data->zero_point[kInputTensorLongOffsets] = longs->params.zero_point;
+    op_data->tables[kInputTensorLongOffsets] =
+        MakeDequantizationTable(longs->params.zero_point, longs->params.scale,
+                                1.0 / op_data->stride);
+    // Some models (such as BodyPix) have a scalar in place of the masks, so
+    // masks are only decoded into an output with room for all of them.
+    TfLiteTensor* masks = micro_context->AllocateTempOutputTensor(
+        node, kOutputTensorInstanceMasks);
+    TF_LITE_ENSURE(context, masks != nullptr);
+    const int max_mask_size =
+        op_data->max_detections * longs->dims->data[1] * longs->dims->data[2];
+    if ((masks->type == kTfLiteFloat32 || masks->type == kTfLiteUInt8) &&
+        NumElements(masks) >= max_mask_size) {
+      op_data->mask_type = masks->type;
+    }
+    micro_context->DeallocateTempTfLiteTensor(masks);
     micro_context->DeallocateTempTfLiteTensor(longs);
   }
 
@@ -207,19 +198,13 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
       tflite::micro::GetEvalInput(context, node, kInputTensorMidOffsets);
   TF_LITE_ENSURE(context, mids != nullptr);
 
-  // Dequantize (and rescale) input tensors
-  DequantizeTensor(heatmaps, op_data->heatmaps_float_ptr, op_data,
-                   kInputTensorHeatmaps);
-  DequantizeTensor(shorts, op_data->shorts_float_ptr, op_data,
-                   kInputTensorShortOffsets, 1.0 / op_data->stride);
-  DequantizeTensor(mids, op_data->mids_float_ptr, op_data,
-                   kInputTensorMidOffsets, 1.0 / op_data->stride);
-
-  const float* heatmaps_data =
-      reinterpret_cast<float*>(op_data->heatmaps_float_ptr);
-  const float* shorts_data =
-      reinterpret_cast<float*>(op_data->shorts_float_ptr);
-  const float* mids_data = reinterpret_cast<float*>(op_data->mids_float_ptr);
+  // Offsets are rescaled from pixels to blocks as they're read.
+  const QuantizedTensor heatmaps_data =
+      GetQuantizedInput(heatmaps, op_data, kInputTensorHeatmaps);
+  const QuantizedTensor shorts_data =
+      GetQuantizedInput(shorts, op_data, kInputTensorShortOffsets);
+  const QuantizedTensor mids_data =
+      GetQuantizedInput(mids, op_data, kInputTensorMidOffsets);
 
   TfLiteEvalTensor* pose_keypoints =
       tflite::micro::GetEvalOutput(context, node, kOutputTensorPoseKeypoints);
@@ -250,28 +235,36 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
       /*mid_short_offset_refinement_steps = */ 5, nms_radius, op_data->stride,
       reinterpret_cast<PoseKeypoints*>(pose_keypoints_data),
       reinterpret_cast<PoseKeypointScores*>(pose_keypoint_scores_data),
-      pose_scores_data);
+      pose_scores_data, &op_data->scratch);
 
-  if (NumInputs(node) == 4) {
+  if (op_data->mask_type != kTfLiteNoType) {
     const TfLiteEvalTensor* longs =
         tflite::micro::GetEvalInput(context, node, kInputTensorLongOffsets);
     TF_LITE_ENSURE(context, longs != nullptr);
-    DequantizeTensor(longs, op_data->longs_float_ptr, op_data,
-                     kInputTensorLongOffsets, 1.0 / op_data->stride);
-    const float* longs_data =
-        reinterpret_cast<float*>(op_data->longs_float_ptr);
+    const QuantizedTensor longs_data =
+        GetQuantizedInput(longs, op_data, kInputTensorLongOffsets);
     TfLiteEvalTensor* instance_masks =
         tflite::micro::GetEvalOutput(context, node, kOutputTensorInstanceMasks);
     TF_LITE_ENSURE(context, instance_masks != nullptr);
-    float* instance_masks_data =
-        tflite::micro::GetTensorData<float>(instance_masks);
-
-    DecodeInstanceMasks(longs_data, /*height = */ longs->dims->data[1],
-                        /*width = */ longs->dims->data[2],
-                        reinterpret_cast<PoseKeypoints*>(pose_keypoints_data),
-                        /*num_poses = */ pose_count_data[0],
-                        /*refinement_steps = */ 2, op_data->stride,
-                        instance_masks_data);
+    auto* poses = reinterpret_cast<PoseKeypoints*>(pose_keypoints_data);
+
+    if (op_data->mask_type == kTfLiteUInt8) {
+      DecodeInstanceMasks(
+          longs_data, /*height = */ longs->dims->data[1],
+          /*width = */ longs->dims->data[2], poses,
+          /*num_poses = */ pose_count_data[0], /*refinement_steps = */ 2,
+          op_data->stride, op_data->mask_options,
+          tflite::micro::GetTensorData<uint8_t>(instance_masks),
+          &op_data->scratch);
+    } else {
+      DecodeInstanceMasks(
+          longs_data, /*height = */ longs->dims->data[1],
+          /*width = */ longs->dims->data[2], poses,
+          /*num_poses = */ pose_count_data[0], /*refinement_steps = */ 2,
+          op_data->stride, op_data->mask_options,
+          tflite::micro::GetTensorData<float>(instance_masks),
+          &op_data->scratch);
+    }
   }
 
   return kTfLiteOk;
@@ -280,6 +273,12 @@ TfLiteStatus Eval(TfLiteContext* context, TfLiteNode* node) {
 }  // namespace posenet_decoder_op
 
 TfLiteRegistration* RegisterPosenetDecoderOp() {
+  return RegisterPosenetDecoderOp(posenet_decoder_op::InstanceMaskOptions());
+}
+
+TfLiteRegistration* RegisterPosenetDecoderOp(
+    const posenet_decoder_op::InstanceMaskOptions& options) {
+  posenet_decoder_op::g_mask_options = options;
   static TfLiteRegistration r = {
       posenet_decoder_op::Init, posenet_decoder_op::Free,
       posenet_decoder_op::Prepare, posenet_decoder_op::Eval};
@@ -17,9 +17,26 @@
 #ifndef LIBS_POSENET_POSENET_DECODER_OP_H_
 #define LIBS_POSENET_POSENET_DECODER_OP_H_
 
+#include <limits>
+
 #include "tensorflow/lite/c/common.h"
 
 namespace coralmicro {
+namespace posenet_decoder_op {
+
+// Options for decoding instance masks faster, at some cost in accuracy.
+struct InstanceMaskOptions {
+  // Pixels farther than this from the bounding box of every pose, in pixels,
+  // are left out of all masks. By default every pixel goes to the closest
+  // pose.
+  float max_box_distance = std::numeric_limits<float>::infinity();
+  // Matches every `coarse_step`-th pixel in each direction first, and fills
+  // each cell whose corners go to the same pose without matching the pixels
+  // inside. 1 matches every pixel.
+  int coarse_step = 1;
+};
+
+}  // namespace posenet_decoder_op
 
 // PoseNet custom op name. Pass this to
 // `tflite::MicroMutableOpResolver::AddCustom()`.
@@ -30,6 +47,17 @@ inline constexpr char kPosenetDecoderOp[] = "PosenetDecoderOp";
 // `tflite::MicroMutableOpResolver::AddCustom()`.
 TfLiteRegistration* RegisterPosenetDecoderOp();
 
+// Like `RegisterPosenetDecoderOp()`, but decodes instance masks with the given
+// options. Ops initialized after this call use them.
+//
+// The op only decodes instance masks for models with long offsets whose fifth
+// output is a float32 or uint8 tensor with room for `max_detections` masks;
+// for other models the mask output is left untouched.
+//
+// @param options The instance mask options.
+TfLiteRegistration* RegisterPosenetDecoderOp(
+    const posenet_decoder_op::InstanceMaskOptions& options);
+
 }  // namespace coralmicro
 
 #endif  // LIBS_POSENET_POSENET_DECODER_OP_H_
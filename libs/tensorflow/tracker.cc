@@ -0,0 +1,158 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/tensorflow/tracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace coralmicro::tensorflow {
+namespace {
+float IntersectionOverUnion(const BBox<float>& a, const BBox<float>& b) {
+  const float h = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
+  const float w = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
+  if (h <= 0 || w <= 0) return 0;
+  const float intersection = h * w;
+  const float area_a = (a.ymax - a.ymin) * (a.xmax - a.xmin);
+  const float area_b = (b.ymax - b.ymin) * (b.xmax - b.xmin);
+  return intersection / (area_a + area_b - intersection);
+}
+
+// Moves a filtered value towards a measurement and updates its rate.
+void CorrectValue(float measurement, float alpha, float beta, float* value,
+                  float* rate) {
+  const float residual = measurement - *value;
+  *value += alpha * residual;
+  *rate += beta * residual;
+}
+
+// Converts a filtered box center and size, and their rates, to the box
+// corners and their velocity.
+void StateToBox(const float state[4], const float rate[4],
+                TrackedObject* result) {
+  const float cy = state[0];
+  const float cx = state[1];
+  const float h = std::max(state[2], 0.0f);
+  const float w = std::max(state[3], 0.0f);
+  result->object.bbox = {cy - h / 2, cx - w / 2, cy + h / 2, cx + w / 2};
+  result->velocity = {rate[0] - rate[2] / 2, rate[1] - rate[3] / 2,
+                      rate[0] + rate[2] / 2, rate[1] + rate[3] / 2};
+}
+
+// Mean distance between the keypoints both poses are confident about, or
+// infinity if there are none.
+float KeypointDistance(const Pose& a, const Pose& b, float threshold) {
+  float sum = 0;
+  int count = 0;
+  for (int i = 0; i < kKeypoints; ++i) {
+    const auto& ka = a.keypoints[i];
+    const auto& kb = b.keypoints[i];
+    if (ka.score < threshold || kb.score < threshold) continue;
+    sum += std::hypot(ka.x - kb.x, ka.y - kb.y);
+    ++count;
+  }
+  if (count == 0) return std::numeric_limits<float>::infinity();
+  return sum / count;
+}
+}  // namespace
+
+ObjectTrackTraits::Track ObjectTrackTraits::Start(const Object& object) {
+  const auto& bbox = object.bbox;
+  Track track{};
+  track.result.object = object;
+  track.state[0] = (bbox.ymin + bbox.ymax) / 2;
+  track.state[1] = (bbox.xmin + bbox.xmax) / 2;
+  track.state[2] = bbox.ymax - bbox.ymin;
+  track.state[3] = bbox.xmax - bbox.xmin;
+  return track;
+}
+
+void ObjectTrackTraits::Advance(Track* track) {
+  for (int i = 0; i < 4; ++i) track->state[i] += track->rate[i];
+  StateToBox(track->state, track->rate, &track->result);
+}
+
+bool ObjectTrackTraits::Cost(const TrackerOptions& options, const Track& track,
+                             const Object& object, float* cost) {
+  const auto& tracked = track.result.object;
+  if (object.id != tracked.id) return false;
+  const float iou = IntersectionOverUnion(tracked.bbox, object.bbox);
+  if (iou < options.min_iou) return false;
+  *cost = -iou;
+  return true;
+}
+
+void ObjectTrackTraits::Correct(const TrackerOptions& options,
+                                const Object& object, Track* track) {
+  const auto& bbox = object.bbox;
+  const float measurement[4] = {(bbox.ymin + bbox.ymax) / 2,
+                                (bbox.xmin + bbox.xmax) / 2,
+                                bbox.ymax - bbox.ymin, bbox.xmax - bbox.xmin};
+  for (int i = 0; i < 4; ++i)
+    CorrectValue(measurement[i], options.alpha, options.beta,
+                 &track->state[i], &track->rate[i]);
+  StateToBox(track->state, track->rate, &track->result);
+  track->result.object.score = object.score;
+}
+
+PoseTrackTraits::Track PoseTrackTraits::Start(const Pose& pose) {
+  Track track{};
+  track.result.pose = pose;
+  return track;
+}
+
+void PoseTrackTraits::Advance(Track* track) {
+  for (int i = 0; i < kKeypoints; ++i) {
+    auto& keypoint = track->result.pose.keypoints[i];
+    keypoint.x += track->rate[i][0];
+    keypoint.y += track->rate[i][1];
+  }
+}
+
+bool PoseTrackTraits::Cost(const TrackerOptions& options, const Track& track,
+                           const Pose& pose, float* cost) {
+  const float distance =
+      KeypointDistance(track.result.pose, pose, options.keypoint_threshold);
+  if (distance > options.max_keypoint_distance) return false;
+  *cost = distance;
+  return true;
+}
+
+void PoseTrackTraits::Correct(const TrackerOptions& options, const Pose& pose,
+                              Track* track) {
+  auto& tracked = track->result.pose;
+  for (int i = 0; i < kKeypoints; ++i) {
+    auto& keypoint = tracked.keypoints[i];
+    const auto& detected = pose.keypoints[i];
+    if (detected.score >= options.keypoint_threshold) {
+      if (keypoint.score < options.keypoint_threshold) {
+        // First sighting of this keypoint, nothing to filter yet.
+        keypoint.x = detected.x;
+        keypoint.y = detected.y;
+      } else {
+        CorrectValue(detected.x, options.alpha, options.beta, &keypoint.x,
+                     &track->rate[i][0]);
+        CorrectValue(detected.y, options.alpha, options.beta, &keypoint.y,
+                     &track->rate[i][1]);
+      }
+    }
+    keypoint.score = detected.score;
+  }
+  tracked.score = pose.score;
+}
+
+}  // namespace coralmicro::tensorflow
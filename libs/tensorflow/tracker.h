@@ -0,0 +1,322 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_TENSORFLOW_TRACKER_H_
+#define LIBS_TENSORFLOW_TRACKER_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "libs/tensorflow/detection.h"
+#include "libs/tensorflow/posenet.h"
+
+namespace coralmicro::tensorflow {
+
+// Options for `ObjectTracker` and `PoseTracker`.
+struct TrackerOptions {
+  // The maximum number of tracks kept at once. New detections are ignored
+  // while all tracks are in use.
+  size_t max_tracks = 16;
+  // The maximum number of detections per frame. The rest are ignored, so pass
+  // detections ordered by score.
+  size_t max_detections = 32;
+  // The minimum intersection-over-union between a predicted box and a
+  // detected box for `ObjectTracker` to match them.
+  float min_iou = 0.3f;
+  // The maximum mean distance between predicted and detected keypoints, in
+  // normalized image coordinates, for `PoseTracker` to match them.
+  float max_keypoint_distance = 0.1f;
+  // Keypoints with a lower score are ignored for matching and filtering.
+  float keypoint_threshold = 0.2f;
+  // The alpha-beta filter position gain (0 to 1.0). Higher values follow
+  // detections more closely; lower values smooth out jitter.
+  float alpha = 0.85f;
+  // The alpha-beta filter velocity gain (0 to 1.0). Higher values react
+  // faster to changes in motion.
+  float beta = 0.05f;
+  // The number of matched frames before a track is reported.
+  int min_hits = 2;
+  // The number of consecutive unmatched frames before a track is dropped.
+  // Tracks that aren't reported yet are dropped on their first miss.
+  int max_misses = 5;
+};
+
+// An object tracked across frames.
+struct TrackedObject {
+  // A unique id that stays the same while the object is tracked.
+  int track_id;
+  // The filtered detection. The bounding box is predicted on frames without
+  // a detection.
+  Object object;
+  // The box motion per frame, as (ymin,xmin,ymax,xmax) deltas.
+  BBox<float> velocity;
+  // The number of frames matched to a detection.
+  int hits;
+  // The number of consecutive updates without a matching detection.
+  int misses;
+};
+
+// A pose tracked across frames.
+struct TrackedPose {
+  // A unique id that stays the same while the pose is tracked.
+  int track_id;
+  // The filtered pose. Keypoints are predicted on frames without a detection.
+  Pose pose;
+  // The number of frames matched to a detection.
+  int hits;
+  // The number of consecutive updates without a matching detection.
+  int misses;
+};
+
+// Object tracking for `Tracker`. Matches boxes by IoU within a class id and
+// follows each box center and size with an alpha-beta filter.
+struct ObjectTrackTraits {
+  using Detection = Object;
+  using Result = TrackedObject;
+  struct Track {
+    TrackedObject result;
+    // Filtered box center and size.
+    float state[4];
+    // Change of `state` per frame.
+    float rate[4];
+  };
+
+  // Starts a track at a detection.
+  static Track Start(const Object& object);
+  // Moves a track one frame ahead.
+  static void Advance(Track* track);
+  // Gets the cost of matching a track to a detection, lower is better.
+  // Returns false if they can't match.
+  static bool Cost(const TrackerOptions& options, const Track& track,
+                   const Object& object, float* cost);
+  // Corrects a track with its matched detection.
+  static void Correct(const TrackerOptions& options, const Object& object,
+                      Track* track);
+};
+
+// Pose tracking for `Tracker`. Matches poses by the mean distance between
+// keypoints and follows each keypoint with an alpha-beta filter.
+struct PoseTrackTraits {
+  using Detection = Pose;
+  using Result = TrackedPose;
+  struct Track {
+    TrackedPose result;
+    // Change of each keypoint's (x,y) per frame.
+    float rate[kKeypoints][2];
+  };
+
+  // Starts a track at a detection.
+  static Track Start(const Pose& pose);
+  // Moves a track one frame ahead.
+  static void Advance(Track* track);
+  // Gets the cost of matching a track to a detection, lower is better.
+  // Returns false if they can't match.
+  static bool Cost(const TrackerOptions& options, const Track& track,
+                   const Pose& pose, float* cost);
+  // Corrects a track with its matched detection.
+  static void Correct(const TrackerOptions& options, const Pose& pose,
+                      Track* track);
+};
+
+// Tracks detections from frame to frame and assigns each a stable id.
+//
+// Tracks and detections are matched greedily, cheapest pair first, using the
+// cost from `Traits`. `Traits` also filters each track. Use `ObjectTracker`
+// or `PoseTracker`. All memory is allocated by the constructor.
+template <typename Traits>
+class Tracker {
+ public:
+  using Detection = typename Traits::Detection;
+  using Result = typename Traits::Result;
+
+  // @param options The tracker options.
+  explicit Tracker(const TrackerOptions& options = {}) : options_(options) {
+    tracks_.reserve(options_.max_tracks);
+    candidates_.reserve(options_.max_tracks * options_.max_detections);
+    costs_.resize(options_.max_tracks * options_.max_detections);
+    track_matched_.resize(options_.max_tracks);
+    detection_matched_.resize(options_.max_detections);
+  }
+
+  // Advances all tracks by one frame and matches them to new detections.
+  // Unmatched detections start new tracks.
+  //
+  // @param detections The detections, ordered by score.
+  // @param count The number of detections.
+  void Update(const Detection* detections, size_t count);
+
+  // Advances all tracks by one frame and matches them to new detections.
+  //
+  // @param detections The detections, ordered by score.
+  void Update(const std::vector<Detection>& detections) {
+    Update(detections.data(), detections.size());
+  }
+
+  // Advances all tracks by one frame without detections, for frames that
+  // skip inference. This doesn't count as a miss.
+  void Predict() {
+    for (auto& track : tracks_) Traits::Advance(&track);
+  }
+
+  // Gets the tracks with at least `TrackerOptions::min_hits` hits.
+  //
+  // @param tracks The storage for the tracks, ordered by track id.
+  // @param max_tracks The capacity of `tracks`.
+  // @return The number of tracks written.
+  size_t GetTracks(Result* tracks, size_t max_tracks) const {
+    size_t count = 0;
+    for (const auto& track : tracks_) {
+      if (count == max_tracks) break;
+      if (track.result.hits >= options_.min_hits)
+        tracks[count++] = track.result;
+    }
+    return count;
+  }
+
+  // Drops all tracks. Track ids keep increasing.
+  void Reset() { tracks_.clear(); }
+
+ private:
+  using Track = typename Traits::Track;
+
+  // Matches tracks to detections, cheapest pair first, and corrects the
+  // matched tracks.
+  void Match(const Detection* detections);
+  // Drops tracks that missed too many frames, or that missed a frame before
+  // they were reported. Keeps the rest in track id order.
+  void DropLostTracks();
+
+  TrackerOptions options_;
+  std::vector<Track> tracks_;
+  // Indices `t * max_detections + d` of the track and detection pairs that
+  // may match, and their costs.
+  std::vector<uint32_t> candidates_;
+  std::vector<float> costs_;
+  std::vector<bool> track_matched_;
+  std::vector<bool> detection_matched_;
+  int next_id_ = 1;
+};
+
+template <typename Traits>
+void Tracker<Traits>::Update(const Detection* detections, size_t count) {
+  Predict();
+
+  const size_t stride = options_.max_detections;
+  count = std::min(count, stride);
+  candidates_.clear();
+  for (size_t t = 0; t < tracks_.size(); ++t) {
+    for (size_t d = 0; d < count; ++d) {
+      if (!Traits::Cost(options_, tracks_[t], detections[d],
+                        &costs_[t * stride + d]))
+        continue;
+      candidates_.push_back(t * stride + d);
+    }
+  }
+
+  std::fill(track_matched_.begin(), track_matched_.end(), false);
+  std::fill(detection_matched_.begin(), detection_matched_.end(), false);
+  Match(detections);
+  for (size_t t = 0; t < tracks_.size(); ++t) {
+    if (track_matched_[t]) continue;
+    ++tracks_[t].result.misses;
+  }
+  DropLostTracks();
+
+  for (size_t d = 0; d < count; ++d) {
+    if (detection_matched_[d]) continue;
+    if (tracks_.size() == options_.max_tracks) break;
+    Track track = Traits::Start(detections[d]);
+    track.result.track_id = next_id_++;
+    track.result.hits = 1;
+    track.result.misses = 0;
+    tracks_.push_back(track);
+  }
+}
+
+template <typename Traits>
+void Tracker<Traits>::Match(const Detection* detections) {
+  const auto& costs = costs_;
+  std::sort(candidates_.begin(), candidates_.end(),
+            [&costs](uint32_t lhs, uint32_t rhs) {
+              if (costs[lhs] != costs[rhs]) return costs[lhs] < costs[rhs];
+              return lhs < rhs;
+            });
+  const size_t stride = options_.max_detections;
+  for (uint32_t candidate : candidates_) {
+    const size_t t = candidate / stride;
+    const size_t d = candidate % stride;
+    if (track_matched_[t] || detection_matched_[d]) continue;
+    track_matched_[t] = true;
+    detection_matched_[d] = true;
+    auto& track = tracks_[t];
+    Traits::Correct(options_, detections[d], &track);
+    ++track.result.hits;
+    track.result.misses = 0;
+  }
+}
+
+template <typename Traits>
+void Tracker<Traits>::DropLostTracks() {
+  tracks_.erase(std::remove_if(tracks_.begin(), tracks_.end(),
+                               [this](const Track& track) {
+                                 const auto& result = track.result;
+                                 if (result.misses > options_.max_misses)
+                                   return true;
+                                 return result.misses > 0 &&
+                                        result.hits < options_.min_hits;
+                               }),
+                tracks_.end());
+}
+
+// Tracks detected objects from frame to frame and assigns each a stable id.
+//
+// Each track follows its box with an alpha-beta (constant velocity) filter.
+// Call `Update()` with the detections of every frame you run inference on,
+// and `Predict()` for frames you skip, for example to run the detection
+// model only on alternate frames:
+//
+// ```
+// tensorflow::ObjectTracker tracker;
+// std::array<tensorflow::TrackedObject, 16> tracks;
+// for (int frame = 0;; ++frame) {
+//   if (frame % 2 == 0) {
+//     // ... Run inference ...
+//     std::array<tensorflow::Object, 16> results;
+//     auto count =
+//         tensorflow::GetDetectionResults(interpreter, &results, 0.5);
+//     tracker.Update(results.data(), count);
+//   } else {
+//     tracker.Predict();
+//   }
+//   auto num_tracks = tracker.GetTracks(tracks.data(), tracks.size());
+// }
+// ```
+//
+// Detections are only matched to tracks with the same class id.
+using ObjectTracker = Tracker<ObjectTrackTraits>;
+
+// Tracks PoseNet poses from frame to frame and assigns each a stable id.
+//
+// Each keypoint is followed with an alpha-beta (constant velocity) filter,
+// and poses are matched by the mean distance between keypoints. Use it the
+// same way as `ObjectTracker`.
+using PoseTracker = Tracker<PoseTrackTraits>;
+
+}  // namespace coralmicro::tensorflow
+
+#endif  // LIBS_TENSORFLOW_TRACKER_H_
@@ -16,6 +16,9 @@
 
 #include "libs/tensorflow/utils.h"
 
+#include <cstdarg>
+#include <cstdio>
+
 #include "third_party/tflite-micro/tensorflow/lite/micro/kernels/kernel_runner.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_interpreter.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/test_helpers.h"
@@ -93,4 +96,16 @@ bool ResizeImage(const ImageDims& in_dims, const uint8_t* uin,
   return true;
 }
 
+size_t AppendFormat(char* buffer, size_t size, size_t length,
+                    const char* format, ...) {
+  if (length + 1 >= size) return length;
+  va_list args;
+  va_start(args, format);
+  const int written =
+      vsnprintf(buffer + length, size - length, format, args);
+  va_end(args);
+  if (written < 0) return length;
+  return std::min(length + written, size - 1);
+}
+
 }  // namespace coralmicro::tensorflow
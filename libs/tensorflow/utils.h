@@ -126,6 +126,30 @@ std::vector<T> DequantizeTensor(TfLiteTensor* tensor) {
 
   return result;
 }
+
+// @cond
+// Inserts a value into `top`, which holds `count` values ordered so that
+// `greater(top[i], top[i + 1])`, while keeping at most `k` values.
+// Returns the new count.
+template <typename T, typename Greater>
+size_t InsertTopK(T* top, size_t count, size_t k, const T& value,
+                  Greater greater) {
+  if (count == k) {
+    if (k == 0 || !greater(value, top[k - 1])) return count;
+    --count;
+  }
+  size_t i = count;
+  for (; i > 0 && greater(value, top[i - 1]); --i) top[i] = top[i - 1];
+  top[i] = value;
+  return count + 1;
+}
+
+// Appends printf-style text at `length` in a buffer of `size` bytes, keeping
+// it NUL-terminated and truncating what doesn't fit. Returns the new length.
+size_t AppendFormat(char* buffer, size_t size, size_t length,
+                    const char* format, ...)
+    __attribute__((format(printf, 4, 5)));
+// @endcond
 }  // namespace coralmicro::tensorflow
 
 #endif  // LIBS_TENSORFLOW_UTILS_H_
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_TESTLIB_CAMERA_REFERENCE_H_
+#define LIBS_TESTLIB_CAMERA_REFERENCE_H_
+
+#include <cstdint>
+
+#include "libs/camera/camera.h"
+
+// Reference camera conversions for checking `CameraTask::ConvertFrame()`.
+//
+// These are the whole-image passes `CameraTask::GetFrame()` used before it
+// demosaiced, rotated and resized each output pixel in a single pass: a
+// native-size RGB image is demosaiced and rotated first, and then resized.
+// They are slow and allocate nothing themselves, so only use them in tests.
+namespace coralmicro::testlib {
+
+// Demosaics and rotates a raw frame into a native-size RGB image.
+//
+// @param raw The raw Bayer image, `CameraTask::kWidth * CameraTask::kHeight`
+// bytes.
+// @param filter The demosaic method.
+// @param rotation The rotation.
+// @param rgb The output, `CameraTask::kWidth * CameraTask::kHeight * 3` bytes.
+void ReferenceBayerToRgb(const uint8_t* raw, CameraFilterMethod filter,
+                         CameraRotation rotation, uint8_t* rgb);
+
+// White balances an RGB image in place, with gains estimated from the whole
+// image.
+//
+// @param rgb The image, `width * height * 3` bytes.
+// @param width The image width.
+// @param height The image height.
+void ReferenceAutoWhiteBalance(uint8_t* rgb, int width, int height);
+
+// Converts an RGB image to grayscale with single-precision float math.
+//
+// @param rgb The image, `width * height * 3` bytes.
+// @param gray The output, `width * height` bytes.
+// @param width The image width.
+// @param height The image height.
+void ReferenceRgbToGrayscale(const uint8_t* rgb, uint8_t* gray, int width,
+                             int height);
+
+// Resizes the `fmt.crop` region of a native-size RGB image to the size of
+// `fmt`, following its `preserve_ratio` and `resize` fields.
+//
+// @param rgb The image from `ReferenceBayerToRgb()`.
+// @param fmt The output format. Its `fmt`, `buffer` and `white_balance` are
+// ignored.
+// @param dst The output, `fmt.width * fmt.height * 3` bytes.
+void ReferenceResize(const uint8_t* rgb, const CameraFrameFormat& fmt,
+                     uint8_t* dst);
+
+}  // namespace coralmicro::testlib
+
+#endif  // LIBS_TESTLIB_CAMERA_REFERENCE_H_
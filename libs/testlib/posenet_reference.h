@@ -0,0 +1,76 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_TESTLIB_POSENET_REFERENCE_H_
+#define LIBS_TESTLIB_POSENET_REFERENCE_H_
+
+// Reference PoseNet decoder for checking `posenet_decoder_op`.
+//
+// This is the decoder the PoseNet custom op used before it read the
+// quantized tensors in place: it decodes from fully dequantized float
+// tensors, keeps its root candidates in a `std::priority_queue` and matches
+// every pixel of the instance masks. It allocates on every call, so only use
+// it in tests.
+namespace coralmicro::testlib {
+
+// Decodes poses from the score map, the short and mid offsets.
+//
+// @param scores The keypoint heatmaps as logits, `height * width * 17`.
+// @param short_offsets The short-range offsets in blocks,
+// `height * width * 34`.
+// @param mid_offsets The mid-range offsets in blocks, `height * width * 64`.
+// @param height The output height in blocks.
+// @param width The output width in blocks.
+// @param max_detections The maximum number of poses to decode.
+// @param score_threshold The minimum pose score, between 0 and 1.
+// @param mid_short_offset_refinement_steps The number of times each keypoint
+// is refined by the short-range offsets.
+// @param nms_radius The exclusion radius between keypoints of the same kind,
+// in blocks.
+// @param stride The network stride, for scaling keypoints to pixels.
+// @param keypoints The (y, x) pixel coordinates of each keypoint,
+// `max_detections * 17 * 2` floats.
+// @param keypoint_scores The score of each keypoint, `max_detections * 17`
+// floats.
+// @param pose_scores The score of each pose, `max_detections` floats.
+// @return The number of poses decoded.
+int ReferenceDecodePoses(const float* scores, const float* short_offsets,
+                         const float* mid_offsets, int height, int width,
+                         int max_detections, float score_threshold,
+                         int mid_short_offset_refinement_steps,
+                         float nms_radius, int stride, float* keypoints,
+                         float* keypoint_scores, float* pose_scores);
+
+// Decodes person instance masks from decoded poses and the long-range offsets.
+//
+// @param long_offsets The long-range offsets in blocks,
+// `height * width * 34`.
+// @param height The output height in blocks.
+// @param width The output width in blocks.
+// @param keypoints The poses from `ReferenceDecodePoses()`.
+// @param num_poses The number of poses.
+// @param refinement_steps The number of times each embedding is refined.
+// @param stride The network stride.
+// @param instance_masks The output, `num_poses * height * width` floats, 1 for
+// the pixels of each pose and 0 elsewhere.
+void ReferenceDecodeInstanceMasks(const float* long_offsets, int height,
+                                  int width, const float* keypoints,
+                                  int num_poses, int refinement_steps,
+                                  int stride, float* instance_masks);
+
+}  // namespace coralmicro::testlib
+
+#endif  // LIBS_TESTLIB_POSENET_REFERENCE_H_
@@ -16,11 +16,21 @@
 
 #include "libs/testlib/test_lib.h"
 
+#include <algorithm>
 #include <array>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
 #include <map>
+#include <memory>
+#include <random>
+#include <tuple>
 
 #include "libs/a71ch/a71ch.h"
+#include "libs/audio/audio_convert.h"
 #include "libs/audio/audio_driver.h"
+#include "libs/audio/audio_service.h"
 #include "libs/base/filesystem.h"
 #include "libs/base/ipc_m7.h"
 #include "libs/base/strings.h"
@@ -29,14 +39,23 @@
 #include "libs/base/utils.h"
 #include "libs/base/wifi.h"
 #include "libs/camera/camera.h"
+#include "libs/camera/motion_detector.h"
 #include "libs/rpc/rpc_utils.h"
 #include "libs/tensorflow/classification.h"
 #include "libs/tensorflow/detection.h"
+#include "libs/tensorflow/posenet_decoder.h"
 #include "libs/tensorflow/posenet_decoder_op.h"
+#include "libs/tensorflow/tracker.h"
 #include "libs/tensorflow/utils.h"
+#include "libs/testlib/camera_reference.h"
+#include "libs/testlib/posenet_reference.h"
 #include "libs/tpu/edgetpu_manager.h"
+#include "libs/tpu/edgetpu_parameter_cache.h"
+#include "libs/tpu/edgetpu_sign_conversion.h"
 #include "libs/tpu/edgetpu_task.h"
+#include "third_party/flatbuffers/include/flatbuffers/flexbuffers.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/tflite-micro/tensorflow/lite/micro/kernels/kernel_util.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_error_reporter.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_interpreter.h"
 #include "third_party/tflite-micro/tensorflow/lite/micro/micro_mutable_op_resolver.h"
@@ -98,6 +117,624 @@ auto WiFiSafeConnect = [](void* wifi_network_params, uint32_t retries) {
   delete params;
 };
 }  // namespace pended_functions
+
+// Results of `CompareCameraConversions()`.
+struct CameraConversionStats {
+  int cases = 0;
+  // The largest difference of `CameraPrecision::kFixedPoint` from `kFloat`.
+  int max_fixed_point_diff = 0;
+  // The largest difference from white balancing the native-size image before
+  // resizing, as `GetFrame()` did before it estimated the gains from its
+  // output. Only the formats `GetFrame()` supported then are compared.
+  int max_white_balance_diff = 0;
+};
+
+int MaxDiff(const uint8_t* a, const uint8_t* b, size_t size) {
+  int max_diff = 0;
+  for (size_t i = 0; i < size; ++i) {
+    max_diff = std::max(max_diff, std::abs(a[i] - b[i]));
+  }
+  return max_diff;
+}
+
+// Converts `raw` with `CameraTask::ConvertFrame()` into each combination of
+// filter, size and resize method for one rotation, and compares the results
+// with the reference conversions:
+//
+// - RGB without white balance and Y8 with `kFloat` must match exactly.
+// - Y8 with `kFixedPoint` must be within 1 of `kFloat`.
+// - White balanced RGB must match the reference white balance of the
+//   resized image. At native size, this is the same as before.
+//
+// @param raw The raw frame.
+// @param rotation The rotation to check.
+// @param stats The counters, updated as cases pass.
+// @param error Set to the first failing case.
+// @return True if every case passes.
+bool CompareCameraConversions(const uint8_t* raw, CameraRotation rotation,
+                              CameraConversionStats* stats,
+                              std::string* error) {
+  constexpr int kNativeSize = CameraTask::kWidth * CameraTask::kHeight;
+  struct Geometry {
+    int width;
+    int height;
+    bool preserve_ratio;
+    CameraCropRect crop;
+  };
+  const Geometry kGeometries[] = {
+      {CameraTask::kWidth, CameraTask::kHeight, false, {}},
+      {96, 96, false, {}},
+      {224, 224, false, {}},
+      {160, 120, false, {}},
+      {160, 120, true, {}},
+      {400, 300, true, {}},
+      {96, 96, false, {50, 30, 200, 120}},
+  };
+  constexpr int kMaxSize = 400 * 300;
+  constexpr CameraFilterMethod kFilters[] = {
+      CameraFilterMethod::kBilinear, CameraFilterMethod::kNearestNeighbor};
+  constexpr CameraResizeMethod kResizeMethods[] = {
+      CameraResizeMethod::kNearestNeighbor, CameraResizeMethod::kBilinear,
+      CameraResizeMethod::kArea};
+
+  std::vector<uint8_t> native(kNativeSize * 3);
+  std::vector<uint8_t> native_balanced(kNativeSize * 3);
+  std::vector<uint8_t> expected(kMaxSize * 3);
+  std::vector<uint8_t> expected_gray(kMaxSize);
+  std::vector<uint8_t> actual(kMaxSize * 3);
+  auto scratch = std::make_unique<CameraFrameScratch>();
+  auto* camera = CameraTask::GetSingleton();
+
+  for (CameraFilterMethod filter : kFilters) {
+    ReferenceBayerToRgb(raw, filter, rotation, native.data());
+    native_balanced = native;
+    ReferenceAutoWhiteBalance(native_balanced.data(), CameraTask::kWidth,
+                              CameraTask::kHeight);
+    for (const Geometry& geometry : kGeometries) {
+      for (CameraResizeMethod resize : kResizeMethods) {
+        CameraFrameFormat fmt{
+            /*fmt=*/CameraFormat::kRgb,
+            /*filter=*/filter,
+            /*rotation=*/rotation,
+            /*width=*/geometry.width,
+            /*height=*/geometry.height,
+            /*preserve_ratio=*/geometry.preserve_ratio,
+            /*buffer=*/actual.data(),
+            /*white_balance=*/false,
+            /*precision=*/CameraPrecision::kFloat,
+            /*resize=*/resize,
+            /*crop=*/geometry.crop};
+        const int size = fmt.width * fmt.height;
+        auto fail = [&](const char* what) {
+          StrAppend(error, "%s mismatch: filter %d, %dx%d, preserve_ratio %d",
+                    what, static_cast<int>(filter), fmt.width, fmt.height,
+                    fmt.preserve_ratio);
+          StrAppend(error, ", crop %dx%d at (%d, %d), resize %d",
+                    fmt.crop.width, fmt.crop.height, fmt.crop.x, fmt.crop.y,
+                    static_cast<int>(resize));
+          return false;
+        };
+
+        ReferenceResize(native.data(), fmt, expected.data());
+        if (!camera->ConvertFrame(raw, &fmt, 1, scratch.get()) ||
+            MaxDiff(actual.data(), expected.data(), size * 3) != 0) {
+          return fail("RGB");
+        }
+
+        ReferenceRgbToGrayscale(expected.data(), expected_gray.data(),
+                                fmt.width, fmt.height);
+        fmt.fmt = CameraFormat::kY8;
+        if (!camera->ConvertFrame(raw, &fmt, 1, scratch.get()) ||
+            MaxDiff(actual.data(), expected_gray.data(), size) != 0) {
+          return fail("Y8");
+        }
+
+        fmt.precision = CameraPrecision::kFixedPoint;
+        if (!camera->ConvertFrame(raw, &fmt, 1, scratch.get())) {
+          return fail("Fixed-point Y8");
+        }
+        const int fixed_point_diff =
+            MaxDiff(actual.data(), expected_gray.data(), size);
+        if (fixed_point_diff > 1) return fail("Fixed-point Y8");
+        stats->max_fixed_point_diff =
+            std::max(stats->max_fixed_point_diff, fixed_point_diff);
+
+        fmt.fmt = CameraFormat::kRgb;
+        fmt.precision = CameraPrecision::kFloat;
+        fmt.white_balance = true;
+        ReferenceAutoWhiteBalance(expected.data(), fmt.width, fmt.height);
+        if (!camera->ConvertFrame(raw, &fmt, 1, scratch.get()) ||
+            MaxDiff(actual.data(), expected.data(), size * 3) != 0) {
+          return fail("White balanced RGB");
+        }
+        // Before, only uncropped nearest-neighbor resizes were available.
+        if (resize == CameraResizeMethod::kNearestNeighbor &&
+            geometry.crop.width == 0) {
+          ReferenceResize(native_balanced.data(), fmt, expected.data());
+          stats->max_white_balance_diff =
+              std::max(stats->max_white_balance_diff,
+                       MaxDiff(actual.data(), expected.data(), size * 3));
+        }
+        stats->cases += 4;
+      }
+    }
+  }
+  return true;
+}
+
+// Captures one raw frame from the camera, after letting the exposure settle.
+bool CaptureRawFrame(std::vector<uint8_t>* raw) {
+  auto* camera = CameraTask::GetSingleton();
+  if (!camera->SetPower(true)) {
+    camera->SetPower(false);
+    return false;
+  }
+  camera->SetTestPattern(CameraTestPattern::kNone);
+  camera->Enable(CameraMode::kStreaming);
+  camera->DiscardFrames(30);
+  bool success = false;
+  {
+    auto frame = camera->LeaseFrame();
+    if (frame.Ok()) {
+      raw->assign(frame.Data(),
+                  frame.Data() + CameraTask::kWidth * CameraTask::kHeight);
+      success = true;
+    }
+  }
+  camera->Disable();
+  camera->SetPower(false);
+  return success;
+}
+
+// Values per detection in the "run_tracker" data: the class id, score and
+// box of an object, or the score and (x, y, score) keypoints of a pose.
+constexpr int kTrackerObjectValues = 6;
+constexpr int kTrackerPoseValues = 1 + 3 * tensorflow::kKeypoints;
+
+tensorflow::Object ParseTrackerObject(const float* values) {
+  return {static_cast<int>(values[0]),
+          values[1],
+          {values[2], values[3], values[4], values[5]}};
+}
+
+tensorflow::Pose ParseTrackerPose(const float* values) {
+  tensorflow::Pose pose;
+  pose.score = values[0];
+  for (int i = 0; i < tensorflow::kKeypoints; ++i) {
+    pose.keypoints[i] = {values[1 + 3 * i], values[2 + 3 * i],
+                         values[3 + 3 * i]};
+  }
+  return pose;
+}
+
+constexpr float kNoTrack = std::numeric_limits<float>::infinity();
+
+// How far a reported object is from the true one, or infinity if it doesn't
+// overlap it enough to be its track.
+float TrackedObjectDistance(const tensorflow::TrackedObject& track,
+                            const tensorflow::Object& truth) {
+  const auto& a = track.object.bbox;
+  const auto& b = truth.bbox;
+  const float h = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
+  const float w = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
+  if (track.object.id != truth.id || h <= 0 || w <= 0) return kNoTrack;
+  const float intersection = h * w;
+  const float iou =
+      intersection / ((a.ymax - a.ymin) * (a.xmax - a.xmin) +
+                      (b.ymax - b.ymin) * (b.xmax - b.xmin) - intersection);
+  return iou < 0.3f ? kNoTrack : 1 - iou;
+}
+
+// The mean keypoint distance between a reported pose and the true one, or
+// infinity if it is too far to be its track.
+float TrackedPoseDistance(const tensorflow::TrackedPose& track,
+                          const tensorflow::Pose& truth) {
+  float sum = 0;
+  for (int i = 0; i < tensorflow::kKeypoints; ++i) {
+    sum += std::hypot(track.pose.keypoints[i].x - truth.keypoints[i].x,
+                      track.pose.keypoints[i].y - truth.keypoints[i].y);
+  }
+  const float distance = sum / tensorflow::kKeypoints;
+  return distance > 0.1f ? kNoTrack : distance;
+}
+
+// Runs a tracker over `num_frames` frames of `num_detections` true
+// detections, calling `Update()` every `inference_interval` frames and
+// `Predict()` on the rest. Detections with a negative score are left out of
+// `Update()`, as if the model missed them. Appends, for each frame and true
+// detection, the id of the closest reported track, or 0 if none is close.
+template <typename Tracker, typename Parse, typename Distance>
+void TrackDetections(const float* data, int num_values, int num_frames,
+                int num_detections, int inference_interval, Parse parse,
+                Distance distance, std::vector<int32_t>* track_ids) {
+  Tracker tracker;
+  std::vector<typename Tracker::Detection> truth(num_detections);
+  std::vector<typename Tracker::Detection> detections;
+  detections.reserve(num_detections);
+  std::vector<typename Tracker::Result> tracks(
+      tensorflow::TrackerOptions().max_tracks);
+  for (int frame = 0; frame < num_frames; ++frame) {
+    detections.clear();
+    for (int d = 0; d < num_detections; ++d) {
+      const float* values = data + (frame * num_detections + d) * num_values;
+      truth[d] = parse(values);
+      if (truth[d].score >= 0) detections.push_back(truth[d]);
+    }
+    if (frame % inference_interval == 0) {
+      tracker.Update(detections);
+    } else {
+      tracker.Predict();
+    }
+    const size_t count = tracker.GetTracks(tracks.data(), tracks.size());
+    for (const auto& detection : truth) {
+      int32_t track_id = 0;
+      float best = kNoTrack;
+      for (size_t t = 0; t < count; ++t) {
+        const float d = distance(tracks[t], detection);
+        if (d < best) {
+          best = d;
+          track_id = tracks[t].track_id;
+        }
+      }
+      track_ids->push_back(track_id);
+    }
+  }
+}
+
+// What the PoseNet decoder op read and wrote in its last invoke, recorded by
+// the wrapper from `CapturePosenetDecoderOp()`.
+struct PosenetDecoderCapture {
+  // One uint8 input, with its quantization.
+  struct Input {
+    std::vector<uint8_t> data;
+    int zero_point;
+    float scale;
+    int height;
+    int width;
+  };
+
+  // The wrapped op.
+  const TfLiteRegistration* op;
+  int max_detections;
+  float score_threshold;
+  int stride;
+  float nms_radius;
+  std::vector<Input> inputs;
+  // The pose outputs.
+  int pose_count;
+  std::vector<float> keypoints;
+  std::vector<float> keypoint_scores;
+  std::vector<float> pose_scores;
+};
+PosenetDecoderCapture g_posenet_capture;
+
+void* CapturePosenetDecoderInit(TfLiteContext* context, const char* buffer,
+                                size_t length) {
+  const flexbuffers::Map& m =
+      flexbuffers::GetRoot(reinterpret_cast<const uint8_t*>(buffer), length)
+          .AsMap();
+  g_posenet_capture.max_detections = m["max_detections"].AsInt32();
+  g_posenet_capture.score_threshold = m["score_threshold"].AsFloat();
+  g_posenet_capture.stride = m["stride"].AsInt32();
+  g_posenet_capture.nms_radius = m["nms_radius"].AsFloat();
+  return g_posenet_capture.op->init(context, buffer, length);
+}
+
+// Records the quantization of the inputs, which is only available here.
+TfLiteStatus CapturePosenetDecoderPrepare(TfLiteContext* context,
+                                          TfLiteNode* node) {
+  tflite::MicroContext* micro_context = tflite::GetMicroContext(context);
+  g_posenet_capture.inputs.resize(node->inputs->size);
+  for (int i = 0; i < node->inputs->size; ++i) {
+    TfLiteTensor* input = micro_context->AllocateTempInputTensor(node, i);
+    TF_LITE_ENSURE(context, input != nullptr);
+    TF_LITE_ENSURE_EQ(context, input->dims->size, 4);
+    auto& capture = g_posenet_capture.inputs[i];
+    capture.zero_point = input->params.zero_point;
+    capture.scale = input->params.scale;
+    capture.height = input->dims->data[1];
+    capture.width = input->dims->data[2];
+    micro_context->DeallocateTempTfLiteTensor(input);
+  }
+  return g_posenet_capture.op->prepare(context, node);
+}
+
+void CopyEvalOutput(TfLiteContext* context, TfLiteNode* node, int index,
+                    std::vector<float>* values) {
+  const TfLiteEvalTensor* output =
+      tflite::micro::GetEvalOutput(context, node, index);
+  const float* data = tflite::micro::GetTensorData<float>(output);
+  values->assign(data, data + tflite::micro::GetTensorShape(output).FlatSize());
+}
+
+// Runs the op and records its inputs and pose outputs.
+TfLiteStatus CapturePosenetDecoderEval(TfLiteContext* context,
+                                       TfLiteNode* node) {
+  TF_LITE_ENSURE_OK(context, g_posenet_capture.op->invoke(context, node));
+  for (int i = 0; i < node->inputs->size; ++i) {
+    const TfLiteEvalTensor* input =
+        tflite::micro::GetEvalInput(context, node, i);
+    const uint8_t* values = tflite::micro::GetTensorData<uint8_t>(input);
+    g_posenet_capture.inputs[i].data.assign(
+        values, values + tflite::micro::GetTensorShape(input).FlatSize());
+  }
+  std::vector<float> pose_count;
+  CopyEvalOutput(context, node, 3, &pose_count);
+  g_posenet_capture.pose_count = static_cast<int>(pose_count[0]);
+  CopyEvalOutput(context, node, 0, &g_posenet_capture.keypoints);
+  CopyEvalOutput(context, node, 1, &g_posenet_capture.keypoint_scores);
+  CopyEvalOutput(context, node, 2, &g_posenet_capture.pose_scores);
+  return kTfLiteOk;
+}
+
+// Returns the PoseNet decoder op with the given mask options, wrapped to
+// record each invoke in `g_posenet_capture`.
+TfLiteRegistration* CapturePosenetDecoderOp(
+    const posenet_decoder_op::InstanceMaskOptions& options) {
+  g_posenet_capture.op = RegisterPosenetDecoderOp(options);
+  static TfLiteRegistration registration = [] {
+    TfLiteRegistration r = *g_posenet_capture.op;
+    r.init = CapturePosenetDecoderInit;
+    r.prepare = CapturePosenetDecoderPrepare;
+    r.invoke = CapturePosenetDecoderEval;
+    return r;
+  }();
+  return &registration;
+}
+
+// Dequantizes a captured input the way the decoder op did before it read
+// the quantized values in place.
+std::vector<float> DequantizePosenetInput(
+    const PosenetDecoderCapture::Input& input, float extra_scale = 1.0) {
+  std::vector<float> values(input.data.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    values[i] = (input.data[i] - input.zero_point) * input.scale * extra_scale;
+  }
+  return values;
+}
+
+// Decoded poses, laid out like the decoder op outputs.
+struct DecodedPoses {
+  explicit DecodedPoses(int max_detections)
+      : keypoints(max_detections * posenet_decoder_op::kNumKeypoints * 2),
+        keypoint_scores(max_detections * posenet_decoder_op::kNumKeypoints),
+        pose_scores(max_detections) {}
+
+  // Whether the first `count` poses of both are bit-identical.
+  bool Equals(const DecodedPoses& other) const {
+    const size_t keypoints_per_pose = posenet_decoder_op::kNumKeypoints;
+    return count == other.count &&
+           std::memcmp(keypoints.data(), other.keypoints.data(),
+                       count * keypoints_per_pose * 2 * sizeof(float)) == 0 &&
+           std::memcmp(keypoint_scores.data(), other.keypoint_scores.data(),
+                       count * keypoints_per_pose * sizeof(float)) == 0 &&
+           std::memcmp(pose_scores.data(), other.pose_scores.data(),
+                       count * sizeof(float)) == 0;
+  }
+
+  int count = 0;
+  std::vector<float> keypoints;
+  std::vector<float> keypoint_scores;
+  std::vector<float> pose_scores;
+};
+
+// Flips the most significant bit of each little-endian element one byte at a
+// time, the way `OutputLayer::TransformSignedDataType()` did before
+// `CopyFlipSignBits()`.
+void ReferenceFlipSignBits(uint8_t* buffer, size_t size, int element_bytes) {
+  for (size_t i = element_bytes - 1; i < size; i += element_bytes) {
+    buffer[i] ^= 0x80;
+  }
+}
+
+// Whether `view` holds the stream positions `view.start` onwards, as written
+// by `CheckSampleRing()`, which appends each sample's position as its value.
+bool ViewHoldsPositions(const SampleView& view) {
+  uint32_t position = view.start;
+  for (size_t i = 0; i < view.first_size; ++i, ++position) {
+    if (view.first[i] != static_cast<int32_t>(position)) return false;
+  }
+  for (size_t i = 0; i < view.second_size; ++i, ++position) {
+    if (view.second[i] != static_cast<int32_t>(position)) return false;
+  }
+  return true;
+}
+
+// The driver samples `CheckAudioWindows()` records, in stream order.
+struct RecordedAudio {
+  std::vector<int32_t> samples;
+  size_t size = 0;
+  // The number of samples recorded from the latest buffer.
+  size_t last_size = 0;
+};
+
+void ConvertAudio(const int32_t* in, int32_t* out, size_t num_samples) {
+  std::memcpy(out, in, num_samples * sizeof(in[0]));
+}
+
+void ConvertAudio(const int32_t* in, int16_t* out, size_t num_samples) {
+  AudioToInt16(in, out, num_samples);
+}
+
+void ConvertAudio(const int32_t* in, float* out, size_t num_samples) {
+  AudioToFloat(in, out, num_samples);
+}
+
+// Checks each window given to an `AudioService` window callback against the
+// recorded driver samples. The first window must end in the latest buffer,
+// and each later one must end `hop` samples after the one before.
+template <typename T>
+struct AudioWindowCheck {
+  AudioWindowCheck(const RecordedAudio* audio, size_t window, size_t hop)
+      : audio(audio), window(window), hop(hop), expected(window) {}
+
+  // Whether the recorded samples ending at `end` convert to `samples`.
+  bool Matches(const T* samples, size_t end) {
+    T last;
+    ConvertAudio(audio->samples.data() + end - 1, &last, 1);
+    if (std::memcmp(&last, samples + window - 1, sizeof(T)) != 0) return false;
+    ConvertAudio(audio->samples.data() + end - window, expected.data(),
+                 window);
+    return std::memcmp(samples, expected.data(), window * sizeof(T)) == 0;
+  }
+
+  static bool Callback(void* ctx, const T* samples, size_t num_samples) {
+    auto* check = static_cast<AudioWindowCheck*>(ctx);
+    if (!check->error.empty()) return true;
+    const size_t recorded = check->audio->size;
+    if (num_samples != check->window) {
+      StrAppend(&check->error, "window %d has %d samples", check->count,
+                static_cast<int>(num_samples));
+      return true;
+    }
+
+    if (check->count == 0) {
+      // Microphone noise makes it unlikely that a window repeats within one
+      // buffer.
+      const size_t first = std::max(check->window,
+                                    recorded - check->audio->last_size + 1);
+      size_t end = recorded;
+      while (end >= first && !check->Matches(samples, end)) --end;
+      if (end < first) {
+        StrAppend(&check->error, "first window isn't in the latest buffer");
+        return true;
+      }
+      check->end = end;
+    } else {
+      check->end += check->hop;
+      if (check->end <= recorded && !check->Matches(samples, check->end)) {
+        StrAppend(&check->error, "window %d doesn't follow by %d samples",
+                  check->count, static_cast<int>(check->hop));
+        return true;
+      }
+    }
+    ++check->count;
+    return true;
+  }
+
+  const RecordedAudio* audio;
+  size_t window;
+  size_t hop;
+  std::vector<T> expected;
+  size_t end = 0;
+  int count = 0;
+  std::string error;
+};
+
+// Converts a float sample with `scale` the way `AudioToInt16()` and
+// `AudioToInt32()` must: truncate toward zero and saturate, in double so
+// that every float is exact.
+template <typename T>
+T ReferenceSaturate(float value, double scale) {
+  const double scaled = std::trunc(static_cast<double>(value) * scale);
+  if (scaled <= std::numeric_limits<T>::min())
+    return std::numeric_limits<T>::min();
+  if (scaled >= std::numeric_limits<T>::max())
+    return std::numeric_limits<T>::max();
+  return static_cast<T>(scaled);
+}
+
+// Runs `convert` on the first `size` samples of `in` and checks the output
+// against `reference`, and that the sample after the output is left alone.
+template <typename In, typename Out, typename Reference>
+bool CheckAudioConversion(void (*convert)(const In*, Out*, size_t),
+                          const std::vector<In>& in, size_t size,
+                          Reference reference) {
+  const Out guard = static_cast<Out>(0x5a5a);
+  std::vector<Out> out(size + 1, guard);
+  convert(in.data(), out.data(), size);
+  for (size_t i = 0; i < size; ++i) {
+    const Out expected = reference(in[i]);
+    if (std::memcmp(&out[i], &expected, sizeof(Out)) != 0) return false;
+  }
+  return std::memcmp(&out[size], &guard, sizeof(Out)) == 0;
+}
+
+// Generates `count` boxes in clusters with corners on a 1/64 grid, times
+// `scale`. On the grid, IoUs are exact in both the fixed point and the float
+// comparisons of `tensorflow::NonMaxSuppression()`. Scores are random rather
+// than round, so that decayed scores don't tie.
+std::vector<tensorflow::Object> GenerateNmsBoxes(int count, float scale) {
+  constexpr int kGrid = 64;
+  std::mt19937 rng(count);
+  std::uniform_int_distribution<int> cluster(0, 3);
+  std::uniform_int_distribution<int> jitter(0, 2);
+  std::uniform_int_distribution<int> size(8, 12);
+  std::uniform_int_distribution<int> id(0, 2);
+  std::uniform_real_distribution<float> score(0.01f, 1.0f);
+
+  std::vector<tensorflow::Object> objects(count);
+  for (int i = 0; i < count; ++i) {
+    const int ymin = cluster(rng) * 12 + jitter(rng);
+    const int xmin = cluster(rng) * 12 + jitter(rng);
+    const int ymax = std::min(kGrid, ymin + size(rng));
+    const int xmax = std::min(kGrid, xmin + size(rng));
+    objects[i].id = id(rng);
+    objects[i].score = score(rng);
+    objects[i].bbox = {ymin * scale / kGrid, xmin * scale / kGrid,
+                       ymax * scale / kGrid, xmax * scale / kGrid};
+  }
+  return objects;
+}
+
+float ReferenceIou(const tensorflow::BBox<float>& a,
+                   const tensorflow::BBox<float>& b) {
+  const float h = std::min(a.ymax, b.ymax) - std::max(a.ymin, b.ymin);
+  const float w = std::min(a.xmax, b.xmax) - std::max(a.xmin, b.xmin);
+  if (h <= 0 || w <= 0) return 0.0f;
+  const float area_a = (a.ymax - a.ymin) * (a.xmax - a.xmin);
+  const float area_b = (b.ymax - b.ymin) * (b.xmax - b.xmin);
+  return h * w / (area_a + area_b - h * w);
+}
+
+// Suppresses boxes the way `NmsOptions` describes it: repeatedly keep the
+// highest remaining score, then drop (greedy) or decay (soft) the boxes it
+// overlaps, with no sorting by class or fixed point.
+std::vector<tensorflow::Object> ReferenceNms(
+    std::vector<tensorflow::Object> remaining,
+    const tensorflow::NmsOptions& options) {
+  std::vector<tensorflow::Object> kept;
+  while (!remaining.empty()) {
+    auto best = std::max_element(remaining.begin(), remaining.end(),
+                                 [](const auto& lhs, const auto& rhs) {
+                                   return std::tie(lhs.score, lhs.id) <
+                                          std::tie(rhs.score, rhs.id);
+                                 });
+    kept.push_back(*best);
+    remaining.erase(best);
+    const auto& last = kept.back();
+    for (auto it = remaining.begin(); it != remaining.end();) {
+      if (!options.class_agnostic && it->id != last.id) {
+        ++it;
+        continue;
+      }
+      const float iou = ReferenceIou(last.bbox, it->bbox);
+      bool drop;
+      if (options.method == tensorflow::NmsMethod::kGreedy) {
+        drop = iou > options.iou_threshold;
+      } else {
+        if (options.method == tensorflow::NmsMethod::kSoftGaussian)
+          it->score *= std::exp(-iou * iou / options.sigma);
+        else if (iou > options.iou_threshold)
+          it->score *= 1.0f - iou;
+        drop = it->score < options.score_threshold;
+      }
+      it = drop ? remaining.erase(it) : it + 1;
+    }
+  }
+  return kept;
+}
+
+bool SameObjects(const tensorflow::Object* a, size_t size,
+                 const std::vector<tensorflow::Object>& b) {
+  if (size != b.size()) return false;
+  for (size_t i = 0; i < size; ++i) {
+    if (a[i].id != b[i].id || a[i].score != b[i].score ||
+        std::memcmp(&a[i].bbox, &b[i].bbox, sizeof(a[i].bbox)) != 0)
+      return false;
+  }
+  return true;
+}
 }  // namespace
 
 // Implementation of "get_serial_number" RPC.
@@ -699,9 +1336,574 @@ void CaptureTestPattern(struct jsonrpc_request* request) {
   } else {
     jsonrpc_return_error(request, -1, "camera test pattern mismatch", nullptr);
   }
+  // Later conversions only white balance real images.
+  coralmicro::CameraTask::GetSingleton()->SetTestPattern(
+      coralmicro::CameraTestPattern::kNone);
   coralmicro::CameraTask::GetSingleton()->SetPower(false);
 }
 
+// Implements the "check_camera_conversion" RPC.
+// Converts a raw frame into many formats with `CameraTask::ConvertFrame()`
+// and compares them with the reference conversions in camera_reference.h.
+// Params: "raw_resource_name", an uploaded raw frame, or "" to capture one
+// from the camera; "rotation", the rotation to check in 90-degree steps.
+// Returns success with "cases", the number of conversions checked,
+// "max_fixed_point_diff" and "max_white_balance_diff" (see
+// `CameraConversionStats`), or failure naming the first mismatch.
+void CheckCameraConversion(struct jsonrpc_request* request) {
+  std::string raw_resource_name;
+  if (!JsonRpcGetStringParam(request, "raw_resource_name",
+                             &raw_resource_name)) {
+    return;
+  }
+  int rotation;
+  if (!JsonRpcGetIntegerParam(request, "rotation", &rotation)) return;
+  if (rotation < 0 || rotation > 3) {
+    JsonRpcReturnBadParam(request, "rotation must be from 0 to 3", "rotation");
+    return;
+  }
+
+  std::vector<uint8_t> raw;
+  if (raw_resource_name.empty()) {
+    if (!CaptureRawFrame(&raw)) {
+      jsonrpc_return_error(request, -1, "unable to capture a frame", nullptr);
+      return;
+    }
+  } else {
+    const auto* resource = GetResource(raw_resource_name);
+    if (!resource ||
+        resource->size() != CameraTask::kWidth * CameraTask::kHeight) {
+      jsonrpc_return_error(request, -1, "missing raw frame resource",
+                           nullptr);
+      return;
+    }
+    raw = *resource;
+  }
+
+  CameraConversionStats stats;
+  std::string error;
+  if (!CompareCameraConversions(raw.data(),
+                                static_cast<CameraRotation>(rotation), &stats,
+                                &error)) {
+    jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+    return;
+  }
+  jsonrpc_return_success(request, "{%Q: %d, %Q: %d, %Q: %d}", "cases",
+                         stats.cases, "max_fixed_point_diff",
+                         stats.max_fixed_point_diff, "max_white_balance_diff",
+                         stats.max_white_balance_diff);
+}
+
+// Implements the "run_tracker" RPC.
+// Runs `ObjectTracker` or `PoseTracker` over recorded detections.
+// Params: "kind", "objects" or "poses"; "resource_name", an uploaded
+// resource with `num_frames` * `num_detections` detections as float32 values
+// (see `TrackDetections()`); "num_frames"; "num_detections";
+// "inference_interval", the number of frames per `Update()`.
+// Returns success with "track_ids", the closest track id for each frame and
+// detection as base64 int32 values, or failure.
+void RunTracker(struct jsonrpc_request* request) {
+  std::string kind;
+  if (!JsonRpcGetStringParam(request, "kind", &kind)) return;
+  int num_values;
+  if (kind == "objects") {
+    num_values = kTrackerObjectValues;
+  } else if (kind == "poses") {
+    num_values = kTrackerPoseValues;
+  } else {
+    JsonRpcReturnBadParam(request, "kind must be objects or poses", "kind");
+    return;
+  }
+
+  std::string resource_name;
+  if (!JsonRpcGetStringParam(request, "resource_name", &resource_name)) return;
+  int num_frames;
+  if (!JsonRpcGetIntegerParam(request, "num_frames", &num_frames)) return;
+  int num_detections;
+  if (!JsonRpcGetIntegerParam(request, "num_detections", &num_detections))
+    return;
+  int inference_interval;
+  if (!JsonRpcGetIntegerParam(request, "inference_interval",
+                              &inference_interval))
+    return;
+  if (num_frames < 1 || num_detections < 1 || inference_interval < 1) {
+    JsonRpcReturnBadParam(request, "counts must be positive", "num_frames");
+    return;
+  }
+
+  const auto* resource = GetResource(resource_name);
+  if (!resource || resource->size() != static_cast<size_t>(num_frames) *
+                                           num_detections * num_values *
+                                           sizeof(float)) {
+    jsonrpc_return_error(request, -1, "missing or wrong-sized detections",
+                         nullptr);
+    return;
+  }
+  std::vector<float> data(resource->size() / sizeof(float));
+  std::memcpy(data.data(), resource->data(), resource->size());
+
+  std::vector<int32_t> track_ids;
+  track_ids.reserve(num_frames * num_detections);
+  if (kind == "objects") {
+    TrackDetections<tensorflow::ObjectTracker>(
+        data.data(), num_values, num_frames, num_detections,
+        inference_interval, ParseTrackerObject, TrackedObjectDistance,
+        &track_ids);
+  } else {
+    TrackDetections<tensorflow::PoseTracker>(
+        data.data(), num_values, num_frames, num_detections,
+        inference_interval, ParseTrackerPose, TrackedPoseDistance,
+        &track_ids);
+  }
+  jsonrpc_return_success(request, "{%Q: %V}", "track_ids",
+                         track_ids.size() * sizeof(track_ids[0]),
+                         track_ids.data());
+}
+
+// Implements the "detect_motion" RPC.
+// Runs `MotionDetector` over a sequence of uploaded raw frames.
+// Params: "resource_name", an uploaded resource with `num_frames` raw frames
+// of `CameraTask::kWidth` x `CameraTask::kHeight` pixels; "num_frames";
+// "block_size"; "threshold"; "rotation", the box rotation in 90-degree steps.
+// Returns success with "results", base64 int32 values holding for each frame
+// whether any block changed, the number of boxes, and
+// `MotionDetector::kMaxBoxes` boxes as (x, y, width, height), or failure.
+void DetectMotion(struct jsonrpc_request* request) {
+  std::string resource_name;
+  if (!JsonRpcGetStringParam(request, "resource_name", &resource_name)) return;
+  int num_frames;
+  if (!JsonRpcGetIntegerParam(request, "num_frames", &num_frames)) return;
+  if (num_frames < 1) {
+    JsonRpcReturnBadParam(request, "num_frames must be positive",
+                          "num_frames");
+    return;
+  }
+
+  MotionDetectorConfig config;
+  if (!JsonRpcGetIntegerParam(request, "block_size", &config.block_size))
+    return;
+  if (config.block_size % 2 != 0 ||
+      config.block_size < MotionDetector::kMinBlockSize ||
+      config.block_size > static_cast<int>(CameraTask::kWidth)) {
+    JsonRpcReturnBadParam(request, "invalid block size", "block_size");
+    return;
+  }
+  if (!JsonRpcGetIntegerParam(request, "threshold", &config.threshold)) return;
+  int rotation;
+  if (!JsonRpcGetIntegerParam(request, "rotation", &rotation)) return;
+  if (rotation < 0 || rotation > 3) {
+    JsonRpcReturnBadParam(request, "rotation must be from 0 to 3", "rotation");
+    return;
+  }
+  config.rotation = static_cast<CameraRotation>(rotation);
+
+  constexpr size_t kFrameSize = CameraTask::kWidth * CameraTask::kHeight;
+  const auto* resource = GetResource(resource_name);
+  if (!resource || resource->size() != num_frames * kFrameSize) {
+    jsonrpc_return_error(request, -1, "missing or wrong-sized frames",
+                         nullptr);
+    return;
+  }
+
+  // About 29 KB, too big for the RPC task's stack.
+  auto detector = std::make_unique<MotionDetector>(config);
+  constexpr int kValuesPerFrame = 2 + 4 * MotionDetector::kMaxBoxes;
+  std::vector<int32_t> results(num_frames * kValuesPerFrame);
+  for (int frame = 0; frame < num_frames; ++frame) {
+    int32_t* values = results.data() + frame * kValuesPerFrame;
+    values[0] = detector->Update(resource->data() + frame * kFrameSize);
+    values[1] = detector->NumBoxes();
+    for (int i = 0; i < detector->NumBoxes(); ++i) {
+      const auto& box = detector->Box(i);
+      values[2 + 4 * i] = box.x;
+      values[3 + 4 * i] = box.y;
+      values[4 + 4 * i] = box.width;
+      values[5 + 4 * i] = box.height;
+    }
+  }
+  jsonrpc_return_success(request, "{%Q: %V}", "results",
+                         results.size() * sizeof(results[0]), results.data());
+}
+
+// Implements the "check_parameter_cache" RPC.
+// Runs a script of operations on an `EdgeTpuParameterCache`. The script is a
+// space-separated list of "A<key>,<token>,<bytes>" (`Acquire()`), "R<key>"
+// (`Remove()`), "I" (`Invalidate()`), "N<uploaded>" (`CountInvoke()`) and
+// "B<bytes>" (`AddUploadedBytes()`).
+// Params: "capacity_bytes"; "script".
+// Returns success with "acquired", a "U" for each `Acquire()` that asked for
+// an upload and a "C" for each that found the parameters cached,
+// "used_bytes", "hits", "misses", "evictions" and "bytes_uploaded", or
+// failure.
+void CheckParameterCache(struct jsonrpc_request* request) {
+  int capacity_bytes;
+  if (!JsonRpcGetIntegerParam(request, "capacity_bytes", &capacity_bytes))
+    return;
+  std::string script;
+  if (!JsonRpcGetStringParam(request, "script", &script)) return;
+
+  EdgeTpuParameterCache cache(capacity_bytes);
+  // Small integer keys stand in for packages; they are only compared.
+  auto to_key = [](unsigned key) {
+    return reinterpret_cast<const void*>(static_cast<uintptr_t>(key));
+  };
+  std::string acquired;
+  const char* op = script.c_str();
+  while (*op != '\0') {
+    unsigned key, token, bytes, uploaded;
+    int length = 0;
+    if (*op == ' ') {
+      ++op;
+      continue;
+    }
+    if (sscanf(op, "A%u,%u,%u%n", &key, &token, &bytes, &length) == 3) {
+      acquired += cache.Acquire(to_key(key), token, bytes) ? 'U' : 'C';
+    } else if (sscanf(op, "R%u%n", &key, &length) == 1) {
+      cache.Remove(to_key(key));
+    } else if (sscanf(op, "N%u%n", &uploaded, &length) == 1) {
+      cache.CountInvoke(uploaded != 0);
+    } else if (sscanf(op, "B%u%n", &bytes, &length) == 1) {
+      cache.AddUploadedBytes(bytes);
+    } else if (*op == 'I') {
+      cache.Invalidate();
+      length = 1;
+    }
+    if (length == 0) {
+      JsonRpcReturnBadParam(request, "invalid operation", "script");
+      return;
+    }
+    op += length;
+  }
+
+  const auto& stats = cache.stats();
+  jsonrpc_return_success(
+      request, "{%Q: %Q, %Q: %d, %Q: %d, %Q: %d, %Q: %d, %Q: %d}", "acquired",
+      acquired.c_str(), "used_bytes", static_cast<int>(cache.used_bytes()),
+      "hits", static_cast<int>(stats.hits), "misses",
+      static_cast<int>(stats.misses), "evictions",
+      static_cast<int>(stats.evictions), "bytes_uploaded",
+      static_cast<int>(stats.bytes_uploaded));
+}
+
+// Implements the "check_posenet_decoder" RPC.
+// Runs a PoseNet model on a test input and decodes the decoder op inputs
+// it captures with the current float decoder and with the old one in
+// posenet_reference.h. The poses of both, and the ones the op decoded from
+// the quantized inputs, must be bit-identical. For models with long offsets,
+// the exact float and uint8 instance masks of those poses must match the old
+// decoder's masks too.
+// Params: "model_resource_name", an uploaded PoseNet model with the decoder
+// op; "image_resource_name", an uploaded raw input for it, such as
+// models/posenet_test_input.bin.
+// Returns success with "poses", the number of poses decoded, "mask_pixels",
+// the number of pixels in all masks, and "coarse_mask_diffs", the number of
+// mask pixels that `InstanceMaskOptions::coarse_step` 2 gets wrong, or
+// failure naming the first mismatch.
+void CheckPosenetDecoder(struct jsonrpc_request* request) {
+  std::string model_resource_name, image_resource_name;
+  if (!JsonRpcGetStringParam(request, "model_resource_name",
+                             &model_resource_name))
+    return;
+  if (!JsonRpcGetStringParam(request, "image_resource_name",
+                             &image_resource_name))
+    return;
+
+  const auto* model_resource = GetResource(model_resource_name);
+  if (!model_resource) {
+    jsonrpc_return_error(request, -1, "missing model resource", nullptr);
+    return;
+  }
+  const auto* image_resource = GetResource(image_resource_name);
+  if (!image_resource) {
+    jsonrpc_return_error(request, -1, "missing image resource", nullptr);
+    return;
+  }
+
+  auto tpu_context =
+      EdgeTpuManager::GetSingleton()->OpenDevice(PerformanceMode::kMax);
+  if (!tpu_context) {
+    jsonrpc_return_error(request, -1, "failed to open edgetpu", nullptr);
+    return;
+  }
+  tflite::MicroMutableOpResolver<2> resolver;
+  resolver.AddCustom(kCustomOp, RegisterCustomOp());
+  const posenet_decoder_op::InstanceMaskOptions mask_options;
+  resolver.AddCustom(kPosenetDecoderOp, CapturePosenetDecoderOp(mask_options));
+  tflite::MicroErrorReporter error_reporter;
+  tflite::MicroInterpreter interpreter(tflite::GetModel(model_resource->data()),
+                                       resolver, tensor_arena,
+                                       kTensorArenaSize, &error_reporter);
+  if (interpreter.AllocateTensors() != kTfLiteOk) {
+    jsonrpc_return_error(request, -1, "failed to allocate tensors", nullptr);
+    return;
+  }
+  auto* input = interpreter.input(0);
+  if (input->bytes != image_resource->size()) {
+    jsonrpc_return_error(request, -1, "image size mismatch", nullptr);
+    return;
+  }
+  std::memcpy(tflite::GetTensorData<uint8_t>(input), image_resource->data(),
+              image_resource->size());
+  if (interpreter.Invoke() != kTfLiteOk) {
+    jsonrpc_return_error(request, -1, "failed to invoke interpreter", nullptr);
+    return;
+  }
+
+  // Dequantized the way the op did before it read the values in place.
+  const auto& capture = g_posenet_capture;
+  const auto scores = DequantizePosenetInput(capture.inputs[0]);
+  const auto short_offsets =
+      DequantizePosenetInput(capture.inputs[1], 1.0 / capture.stride);
+  const auto mid_offsets =
+      DequantizePosenetInput(capture.inputs[2], 1.0 / capture.stride);
+  const int height = capture.inputs[0].height;
+  const int width = capture.inputs[0].width;
+  const float nms_radius = capture.nms_radius / capture.stride;
+
+  DecodedPoses reference(capture.max_detections);
+  reference.count = ReferenceDecodePoses(
+      scores.data(), short_offsets.data(), mid_offsets.data(), height, width,
+      capture.max_detections, capture.score_threshold,
+      /*mid_short_offset_refinement_steps=*/5, nms_radius, capture.stride,
+      reference.keypoints.data(), reference.keypoint_scores.data(),
+      reference.pose_scores.data());
+
+  DecodedPoses decoded(capture.max_detections);
+  decoded.count = posenet_decoder_op::DecodeAllPoses(
+      scores.data(), short_offsets.data(), mid_offsets.data(), height, width,
+      capture.max_detections, capture.score_threshold,
+      /*mid_short_offset_refinement_steps=*/5, nms_radius, capture.stride,
+      reinterpret_cast<posenet_decoder_op::PoseKeypoints*>(
+          decoded.keypoints.data()),
+      reinterpret_cast<posenet_decoder_op::PoseKeypointScores*>(
+          decoded.keypoint_scores.data()),
+      decoded.pose_scores.data());
+  if (!decoded.Equals(reference)) {
+    jsonrpc_return_error(request, -1, "float decoder poses differ", nullptr);
+    return;
+  }
+
+  DecodedPoses op_output(capture.max_detections);
+  op_output.count = capture.pose_count;
+  op_output.keypoints = capture.keypoints;
+  op_output.keypoint_scores = capture.keypoint_scores;
+  op_output.pose_scores = capture.pose_scores;
+  if (!op_output.Equals(reference)) {
+    jsonrpc_return_error(request, -1, "quantized decoder poses differ",
+                         nullptr);
+    return;
+  }
+
+  int mask_pixels = 0;
+  int coarse_mask_diffs = 0;
+  if (capture.inputs.size() > 3) {
+    const auto& longs = capture.inputs[3];
+    const auto long_offsets =
+        DequantizePosenetInput(longs, 1.0 / capture.stride);
+    const size_t mask_size = reference.count * longs.height * longs.width;
+    std::vector<float> reference_masks(mask_size);
+    ReferenceDecodeInstanceMasks(long_offsets.data(), longs.height,
+                                 longs.width, reference.keypoints.data(),
+                                 reference.count, /*refinement_steps=*/2,
+                                 capture.stride, reference_masks.data());
+
+    auto* poses = reinterpret_cast<posenet_decoder_op::PoseKeypoints*>(
+        reference.keypoints.data());
+    std::vector<float> float_masks(mask_size);
+    posenet_decoder_op::DecodeInstanceMasks(
+        long_offsets.data(), longs.height, longs.width, poses, reference.count,
+        /*refinement_steps=*/2, capture.stride, float_masks.data());
+    if (float_masks != reference_masks) {
+      jsonrpc_return_error(request, -1, "float decoder masks differ", nullptr);
+      return;
+    }
+
+    // Decoded from the quantized values, like the op does.
+    const auto table = posenet_decoder_op::MakeDequantizationTable(
+        longs.zero_point, longs.scale, 1.0 / capture.stride);
+    const posenet_decoder_op::QuantizedTensor quantized_offsets(
+        longs.data.data(), &table);
+    std::vector<uint8_t> masks(mask_size);
+    posenet_decoder_op::InstanceMaskOptions options;
+    posenet_decoder_op::DecodeInstanceMasks(
+        quantized_offsets, longs.height, longs.width, poses, reference.count,
+        /*refinement_steps=*/2, capture.stride, options, masks.data());
+    if (!std::equal(masks.begin(), masks.end(), reference_masks.begin())) {
+      jsonrpc_return_error(request, -1, "quantized decoder masks differ",
+                           nullptr);
+      return;
+    }
+    mask_pixels = static_cast<int>(std::count(masks.begin(), masks.end(), 1));
+
+    std::vector<uint8_t> coarse_masks(mask_size);
+    options.coarse_step = 2;
+    posenet_decoder_op::DecodeInstanceMasks(
+        quantized_offsets, longs.height, longs.width, poses, reference.count,
+        /*refinement_steps=*/2, capture.stride, options, coarse_masks.data());
+    for (size_t i = 0; i < mask_size; ++i) {
+      if (coarse_masks[i] != masks[i]) ++coarse_mask_diffs;
+    }
+  }
+
+  jsonrpc_return_success(request, "{%Q: %d, %Q: %d, %Q: %d}", "poses",
+                         reference.count, "mask_pixels", mask_pixels,
+                         "coarse_mask_diffs", coarse_mask_diffs);
+}
+
+// Implements the "check_sign_conversion" RPC.
+// Compares `CopyFlipSignBits()` and `FlipSignBits()` with a byte loop over
+// random data, for 1, 2 and 4-byte elements, every size up to
+// "max_elements" elements and every source and destination alignment within
+// a word. Bytes around the destination must be left untouched.
+// Params: "max_elements", at most 1024.
+// Returns success with "cases", the number of conversions checked, or
+// failure naming the first mismatch.
+void CheckSignConversion(struct jsonrpc_request* request) {
+  int max_elements;
+  if (!JsonRpcGetIntegerParam(request, "max_elements", &max_elements))
+    return;
+  if (max_elements < 0 || max_elements > 1024) {
+    JsonRpcReturnBadParam(request, "max_elements must be from 0 to 1024",
+                          "max_elements");
+    return;
+  }
+
+  constexpr int kWordBytes = sizeof(uint32_t);
+  constexpr uint8_t kGuard = 0x5a;
+  const size_t max_size = sizeof(uint32_t) * max_elements;
+  std::vector<uint8_t> src(max_size + kWordBytes);
+  std::vector<uint8_t> dest(max_size + 2 * kWordBytes);
+  std::vector<uint8_t> expected(max_size);
+  std::minstd_rand generator;
+  int cases = 0;
+  std::string error;
+  for (int element_bytes : {1, 2, 4}) {
+    for (int elements = 0; elements <= max_elements; ++elements) {
+      const size_t size = elements * element_bytes;
+      for (int src_offset = 0; src_offset < kWordBytes; ++src_offset) {
+        for (auto& value : src) value = generator();
+        uint8_t* source = src.data() + src_offset;
+        std::memcpy(expected.data(), source, size);
+        ReferenceFlipSignBits(expected.data(), size, element_bytes);
+
+        for (int dest_offset = 0; dest_offset < kWordBytes; ++dest_offset) {
+          std::fill(dest.begin(), dest.end(), kGuard);
+          uint8_t* target = dest.data() + dest_offset;
+          CopyFlipSignBits(target, source, size, element_bytes);
+          const bool guards_intact =
+              std::all_of(dest.begin(), dest.begin() + dest_offset,
+                          [](uint8_t b) { return b == kGuard; }) &&
+              std::all_of(dest.begin() + dest_offset + size, dest.end(),
+                          [](uint8_t b) { return b == kGuard; });
+          if (std::memcmp(target, expected.data(), size) != 0 ||
+              !guards_intact) {
+            StrAppend(&error,
+                      "copy mismatch: element_bytes %d, size %d, src offset "
+                      "%d, dest offset %d",
+                      element_bytes, static_cast<int>(size), src_offset,
+                      dest_offset);
+            jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+            return;
+          }
+          ++cases;
+        }
+
+        FlipSignBits(source, size, element_bytes);
+        if (std::memcmp(source, expected.data(), size) != 0) {
+          StrAppend(&error,
+                    "in place mismatch: element_bytes %d, size %d, offset %d",
+                    element_bytes, static_cast<int>(size), src_offset);
+          jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+          return;
+        }
+        ++cases;
+      }
+    }
+  }
+  jsonrpc_return_success(request, "{%Q: %d}", "cases", cases);
+}
+
+// Implements the "check_sample_ring" RPC.
+// Appends a ramp to a `SampleRing` in chunks of random sizes, some of them
+// larger than the ring. After each chunk, the latest views must hold the
+// latest samples, and a view taken before the chunk must be reported invalid
+// exactly when the chunk wrapped into it.
+// Params: "num_samples", the view size, from 1 to 4096.
+// Returns success with "capacity", the ring capacity, and "cases", the
+// number of views checked, or failure naming the first mismatch.
+void CheckSampleRing(struct jsonrpc_request* request) {
+  int num_samples;
+  if (!JsonRpcGetIntegerParam(request, "num_samples", &num_samples)) return;
+  if (num_samples < 1 || num_samples > 4096) {
+    JsonRpcReturnBadParam(request, "num_samples must be from 1 to 4096",
+                          "num_samples");
+    return;
+  }
+
+  SampleRing ring(num_samples);
+  const size_t capacity = ring.Capacity();
+  if (capacity < 2 * ring.NumSamples() || (capacity & (capacity - 1)) != 0) {
+    jsonrpc_return_error(
+        request, -1,
+        "capacity must be a power of two of at least twice the view size",
+        nullptr);
+    return;
+  }
+  if (ring.View().Size() != 0) {
+    jsonrpc_return_error(request, -1, "empty ring has samples", nullptr);
+    return;
+  }
+
+  constexpr int kNumChunks = 200;
+  std::mt19937 rng(num_samples);
+  std::uniform_int_distribution<size_t> small_chunk(1, num_samples);
+  std::uniform_int_distribution<size_t> large_chunk(1, 2 * capacity);
+  std::uniform_int_distribution<size_t> view_size(0, num_samples);
+  std::vector<int32_t> chunk(2 * capacity);
+
+  std::string error;
+  uint32_t end = 0;
+  SampleView previous;
+  int cases = 0;
+  for (int i = 0; i < kNumChunks; ++i) {
+    const size_t size = i % 8 == 7 ? large_chunk(rng) : small_chunk(rng);
+    for (size_t j = 0; j < size; ++j) chunk[j] = static_cast<int32_t>(end + j);
+    ring.Append(chunk.data(), size);
+    end += size;
+
+    const bool intact = end - previous.start <= capacity;
+    if (ring.IsValid(previous) != intact) {
+      StrAppend(&error, "chunk %d: stale view reported %s", i,
+                intact ? "invalid" : "valid");
+      jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+      return;
+    }
+    if (intact && !ViewHoldsPositions(previous)) {
+      StrAppend(&error, "chunk %d: valid view was overwritten", i);
+      jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+      return;
+    }
+    ++cases;
+
+    const size_t requested = view_size(rng);
+    for (size_t n : {static_cast<size_t>(num_samples), requested}) {
+      const auto view = ring.View(n);
+      const size_t expected_size = std::min<size_t>(n, end);
+      if (view.Size() != expected_size || view.start != end - expected_size ||
+          !ViewHoldsPositions(view) || !ring.IsValid(view)) {
+        StrAppend(&error, "chunk %d: view of %d samples is wrong", i,
+                  static_cast<int>(n));
+        jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+        return;
+      }
+      ++cases;
+    }
+    previous = ring.View();
+  }
+  jsonrpc_return_success(request, "{%Q: %d, %Q: %d}", "capacity",
+                         static_cast<int>(capacity), "cases", cases);
+}
+
 // Implements the "capture_audio" RPC.
 // Attempts to capture 1 second of audio.
 // Returns success, with a parameter "data" containing the captured audio in
@@ -777,6 +1979,284 @@ void CaptureAudio(struct jsonrpc_request* request) {
                          samples.size() * sizeof(samples[0]), samples.data());
 }
 
+void DecimateAudio(struct jsonrpc_request* request) {
+  constexpr int kInputRateHz = 48000;
+  int frequency_hz;
+  if (!JsonRpcGetIntegerParam(request, "frequency_hz", &frequency_hz)) return;
+  if (frequency_hz < 0 || frequency_hz > kInputRateHz / 2) {
+    JsonRpcReturnBadParam(request, "frequency must be from 0 to 24000 Hz",
+                          "frequency_hz");
+    return;
+  }
+
+  int num_samples;
+  if (!JsonRpcGetIntegerParam(request, "num_samples", &num_samples)) return;
+  if (num_samples < 1 || num_samples > kInputRateHz) {
+    JsonRpcReturnBadParam(request, "invalid number of samples",
+                          "num_samples");
+    return;
+  }
+
+  int chunk_size;
+  if (!JsonRpcGetIntegerParam(request, "chunk_size", &chunk_size)) return;
+  if (chunk_size < 1) {
+    JsonRpcReturnBadParam(request, "invalid chunk size", "chunk_size");
+    return;
+  }
+
+  // A half-scale tone in the audio driver's format.
+  std::vector<int32_t> samples(num_samples);
+  for (int i = 0; i < num_samples; ++i) {
+    const double phase = 2 * M_PI * frequency_hz * i / kInputRateHz;
+    samples[i] = static_cast<int32_t>(std::lround(0.5 * std::sin(phase) *
+                                                  2147483648.0));
+  }
+
+  AudioDecimator decimator;
+  std::vector<float> output(AudioDecimator::MaxOutputSize(num_samples));
+  size_t output_size = 0;
+  for (int i = 0; i < num_samples; i += chunk_size) {
+    output_size += decimator.Process(samples.data() + i,
+                                     std::min(chunk_size, num_samples - i),
+                                     output.data() + output_size);
+  }
+
+  jsonrpc_return_success(request, "{%Q: %V}", "data",
+                         output_size * sizeof(output[0]), output.data());
+}
+
+// Implements the "check_audio_windows" RPC.
+// Captures 16 kHz audio with an `AudioService` that has a plain callback,
+// which records the driver samples, and int32, int16 and float window
+// callbacks of the given window and hop sizes. Every window must hold the
+// converted recorded samples, and consecutive windows must be the hop size
+// apart.
+// Params: "window_samples", from 16 to 16000, so that a window is unlikely
+// to repeat; "hop_samples", from 1 to 16000;
+// "duration_ms", from 1 to 2000.
+// Returns success with "samples", the number of samples recorded, and
+// "windows", the number of windows of each format, or failure naming the
+// first mismatch.
+void CheckAudioWindows(struct jsonrpc_request* request) {
+  constexpr int kSampleRateHz = 16000;
+  int window_samples;
+  if (!JsonRpcGetIntegerParam(request, "window_samples", &window_samples))
+    return;
+  if (window_samples < 16 || window_samples > kSampleRateHz) {
+    JsonRpcReturnBadParam(request, "window_samples must be from 16 to 16000",
+                          "window_samples");
+    return;
+  }
+
+  int hop_samples;
+  if (!JsonRpcGetIntegerParam(request, "hop_samples", &hop_samples)) return;
+  if (hop_samples < 1 || hop_samples > kSampleRateHz) {
+    JsonRpcReturnBadParam(request, "hop_samples must be from 1 to 16000",
+                          "hop_samples");
+    return;
+  }
+
+  int duration_ms;
+  if (!JsonRpcGetIntegerParam(request, "duration_ms", &duration_ms)) return;
+  if (duration_ms < 1 || duration_ms > 2000) {
+    JsonRpcReturnBadParam(request, "duration must be from 1 to 2000 ms",
+                          "duration_ms");
+    return;
+  }
+
+  const AudioDriverConfig config{AudioSampleRate::k16000_Hz,
+                                 /*num_dma_buffers=*/4,
+                                 /*dma_buffer_size_ms=*/30};
+  if (!g_audio_buffers.CanHandle(config)) {
+    jsonrpc_return_error(request, -1,
+                         "not enough static memory for DMA buffers", nullptr);
+    return;
+  }
+
+  RecordedAudio audio;
+  // Leave room for the buffers captured while the callbacks are removed.
+  audio.samples.resize(MsToSamples(config.sample_rate, duration_ms) +
+                       4 * config.dma_buffer_size_samples());
+  AudioWindowCheck<int32_t> int32_check(&audio, window_samples, hop_samples);
+  AudioWindowCheck<int16_t> int16_check(&audio, window_samples, hop_samples);
+  AudioWindowCheck<float> float_check(&audio, window_samples, hop_samples);
+
+  {
+    AudioService service(&g_audio_driver, config, /*task_priority=*/4,
+                         /*drop_first_samples_ms=*/150);
+    // Added first, so it records each buffer before the windows are checked.
+    const int record_id = service.AddCallback(
+        &audio, +[](void* ctx, const int32_t* samples, size_t num_samples) {
+          auto* audio = static_cast<RecordedAudio*>(ctx);
+          num_samples =
+              std::min(num_samples, audio->samples.size() - audio->size);
+          std::memcpy(audio->samples.data() + audio->size, samples,
+                      num_samples * sizeof(samples[0]));
+          audio->size += num_samples;
+          audio->last_size = num_samples;
+          return true;
+        });
+    const int ids[] = {
+        service.AddWindowCallback(&int32_check,
+                                  &AudioWindowCheck<int32_t>::Callback,
+                                  window_samples, hop_samples),
+        service.AddWindowCallback(&int16_check,
+                                  &AudioWindowCheck<int16_t>::Callback,
+                                  window_samples, hop_samples),
+        service.AddWindowCallback(&float_check,
+                                  &AudioWindowCheck<float>::Callback,
+                                  window_samples, hop_samples),
+    };
+    vTaskDelay(pdMS_TO_TICKS(duration_ms));
+    for (int id : ids) service.RemoveCallback(id);
+    service.RemoveCallback(record_id);
+  }
+
+  for (const std::string* error :
+       {&int32_check.error, &int16_check.error, &float_check.error}) {
+    if (!error->empty()) {
+      jsonrpc_return_error(request, -1, error->c_str(), nullptr);
+      return;
+    }
+  }
+  jsonrpc_return_success(request, "{%Q: %d, %Q: [%d, %d, %d]}", "samples",
+                         static_cast<int>(audio.size), "windows",
+                         int32_check.count, int16_check.count,
+                         float_check.count);
+}
+
+// Implements the "check_audio_conversion" RPC.
+// Checks the audio_convert.h conversions against scalar references for
+// every size up to "max_samples", so that both paired and single sample
+// paths run. The inputs start with the limits of each format and values
+// out of range, followed by random values.
+// Params: "max_samples", at most 1024.
+// Returns success with "cases", the number of conversions checked, or
+// failure naming the first mismatch.
+void CheckAudioConversion(struct jsonrpc_request* request) {
+  int max_samples;
+  if (!JsonRpcGetIntegerParam(request, "max_samples", &max_samples)) return;
+  if (max_samples < 0 || max_samples > 1024) {
+    JsonRpcReturnBadParam(request, "max_samples must be from 0 to 1024",
+                          "max_samples");
+    return;
+  }
+
+  std::vector<int32_t> int32_in = {
+      std::numeric_limits<int32_t>::min(),
+      std::numeric_limits<int32_t>::max(),
+      0, -1, 1, 0xffff, 0x10000, -0x10000, -0x10001, 0x7fff0000,
+  };
+  std::vector<float> float_in = {
+      -1.0f, 1.0f, 0.0f, -0.0f, 0.5f, -0.5f, 1.5f, -1.5f,
+      std::nextafter(1.0f, 0.0f), std::nextafter(-1.0f, 0.0f),
+      -1.0f / 32768, 1.0f / 32768, 1e30f, -1e30f,
+  };
+  std::mt19937 rng(max_samples);
+  std::uniform_int_distribution<int32_t> int32_dist(
+      std::numeric_limits<int32_t>::min(),
+      std::numeric_limits<int32_t>::max());
+  std::uniform_real_distribution<float> float_dist(-1.25f, 1.25f);
+  while (int32_in.size() < static_cast<size_t>(max_samples))
+    int32_in.push_back(int32_dist(rng));
+  while (float_in.size() < static_cast<size_t>(max_samples))
+    float_in.push_back(float_dist(rng));
+
+  std::string error;
+  int cases = 0;
+  for (int size = 0; size <= max_samples; ++size) {
+    const char* failed = nullptr;
+    if (!CheckAudioConversion<int32_t, int16_t>(
+            AudioToInt16, int32_in, size,
+            [](int32_t x) { return static_cast<int16_t>(x >> 16); })) {
+      failed = "int32 to int16";
+    } else if (!CheckAudioConversion<int32_t, float>(
+                   AudioToFloat, int32_in, size, [](int32_t x) {
+                     return static_cast<float>(x) / 2147483648.0f;
+                   })) {
+      failed = "int32 to float";
+    } else if (!CheckAudioConversion<float, int16_t>(
+                   AudioToInt16, float_in, size, [](float x) {
+                     return ReferenceSaturate<int16_t>(x, 32768.0);
+                   })) {
+      failed = "float to int16";
+    } else if (!CheckAudioConversion<float, int32_t>(
+                   AudioToInt32, float_in, size, [](float x) {
+                     return ReferenceSaturate<int32_t>(x, 2147483648.0);
+                   })) {
+      failed = "float to int32";
+    }
+    if (failed) {
+      StrAppend(&error, "%s mismatch for %d samples", failed, size);
+      jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+      return;
+    }
+    cases += 4;
+  }
+  jsonrpc_return_success(request, "{%Q: %d}", "cases", cases);
+}
+
+// Implements the "check_nms" RPC.
+// Runs every `tensorflow::NonMaxSuppression()` method, per class and class
+// agnostic, on clustered boxes, and compares the kept boxes with a direct
+// implementation of each method. Boxes are checked both normalized, where
+// greedy suppression runs in fixed point with and without scratch memory,
+// and scaled out of the normalized range, where it runs in float.
+// Params: "count", the number of boxes, at most 1000.
+// Returns success with "cases", the number of runs checked, and "kept", the
+// total number of boxes they kept, or failure naming the first mismatch.
+void CheckNms(struct jsonrpc_request* request) {
+  int count;
+  if (!JsonRpcGetIntegerParam(request, "count", &count)) return;
+  if (count < 0 || count > 1000) {
+    JsonRpcReturnBadParam(request, "count must be from 0 to 1000", "count");
+    return;
+  }
+
+  constexpr tensorflow::NmsMethod kMethods[] = {
+      tensorflow::NmsMethod::kGreedy, tensorflow::NmsMethod::kSoftLinear,
+      tensorflow::NmsMethod::kSoftGaussian};
+  std::vector<tensorflow::NmsBox> scratch(count);
+  std::vector<tensorflow::Object> objects;
+  std::string error;
+  int cases = 0;
+  int kept = 0;
+  for (float scale : {1.0f, 64.0f}) {
+    const auto boxes = GenerateNmsBoxes(count, scale);
+    for (bool class_agnostic : {false, true}) {
+      for (auto method : kMethods) {
+        tensorflow::NmsOptions options;
+        options.method = method;
+        options.class_agnostic = class_agnostic;
+        const auto expected = ReferenceNms(boxes, options);
+        for (bool use_scratch : {false, true}) {
+          if (use_scratch && method != tensorflow::NmsMethod::kGreedy)
+            continue;
+          objects = boxes;
+          const size_t size = tensorflow::NonMaxSuppression(
+              objects.data(), objects.size(), options,
+              use_scratch ? scratch.data() : nullptr);
+          if (!SameObjects(objects.data(), size, expected)) {
+            StrAppend(&error,
+                      "method %d, scale %d, class_agnostic %d, scratch %d: "
+                      "kept %d boxes, expected %d",
+                      static_cast<int>(method), static_cast<int>(scale),
+                      class_agnostic, use_scratch,
+                      static_cast<int>(size),
+                      static_cast<int>(expected.size()));
+            jsonrpc_return_error(request, -1, error.c_str(), nullptr);
+            return;
+          }
+          ++cases;
+          kept += size;
+        }
+      }
+    }
+  }
+  jsonrpc_return_success(request, "{%Q: %d, %Q: %d}", "cases", cases, "kept",
+                         kept);
+}
+
 void WiFiScan(struct jsonrpc_request* request) {
   auto results = coralmicro::WiFiScan();
   if (results.empty()) {
@@ -40,6 +40,22 @@ inline constexpr char kMethodStartM4[] = "start_m4";
 inline constexpr char kMethodCaptureTestPattern[] = "capture_test_pattern";
 inline constexpr char kMethodGetTemperature[] = "get_temperature";
 inline constexpr char kMethodCaptureAudio[] = "capture_audio";
+inline constexpr char kMethodCheckCameraConversion[] =
+    "check_camera_conversion";
+inline constexpr char kMethodDecimateAudio[] = "decimate_audio";
+inline constexpr char kMethodRunTracker[] = "run_tracker";
+inline constexpr char kMethodDetectMotion[] = "detect_motion";
+inline constexpr char kMethodCheckParameterCache[] =
+    "check_parameter_cache";
+inline constexpr char kMethodCheckPosenetDecoder[] =
+    "check_posenet_decoder";
+inline constexpr char kMethodCheckSignConversion[] =
+    "check_sign_conversion";
+inline constexpr char kMethodCheckSampleRing[] = "check_sample_ring";
+inline constexpr char kMethodCheckAudioWindows[] = "check_audio_windows";
+inline constexpr char kMethodCheckAudioConversion[] =
+    "check_audio_conversion";
+inline constexpr char kMethodCheckNms[] = "check_nms";
 inline constexpr char kMethodWiFiSetAntenna[] = "wifi_set_antenna";
 inline constexpr char kMethodWiFiScan[] = "wifi_scan";
 inline constexpr char kMethodWiFiConnect[] = "wifi_connect";
@@ -71,6 +87,19 @@ void StartM4(struct jsonrpc_request* request);
 void GetTemperature(struct jsonrpc_request* request);
 void CaptureTestPattern(struct jsonrpc_request* request);
 void CaptureAudio(struct jsonrpc_request* request);
+void CheckCameraConversion(struct jsonrpc_request* request);
+// Downsamples a 48 kHz half-scale tone to 16 kHz with `AudioDecimator`, fed
+// in chunks of the given size, and returns the float output.
+void DecimateAudio(struct jsonrpc_request* request);
+void RunTracker(struct jsonrpc_request* request);
+void DetectMotion(struct jsonrpc_request* request);
+void CheckParameterCache(struct jsonrpc_request* request);
+void CheckPosenetDecoder(struct jsonrpc_request* request);
+void CheckSignConversion(struct jsonrpc_request* request);
+void CheckSampleRing(struct jsonrpc_request* request);
+void CheckAudioWindows(struct jsonrpc_request* request);
+void CheckAudioConversion(struct jsonrpc_request* request);
+void CheckNms(struct jsonrpc_request* request);
 void WiFiSetAntenna(struct jsonrpc_request* request);
 void WiFiScan(struct jsonrpc_request* request);
 void WiFiConnect(struct jsonrpc_request* request);
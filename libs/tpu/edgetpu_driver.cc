@@ -22,6 +22,7 @@
 #include "libs/tpu/darwinn/driver/config/beagle/beagle_chip_config.h"
 #include "libs/tpu/darwinn/driver/config/beagle_csr_helper.h"
 #include "libs/tpu/darwinn/driver/config/common_csr_helper.h"
+#include "libs/tpu/edgetpu_sign_conversion.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
 #include "third_party/freertos_kernel/include/semphr.h"
 #include "third_party/nxp/rt1176-sdk/components/osa/fsl_os_abstraction.h"
@@ -33,23 +34,58 @@ constexpr uint8_t kSingleBulkOutEndpoint = 1;
 constexpr uint8_t kEventInEndpoint = 2;
 constexpr uint8_t kInterruptInEndpoint = 3;
 constexpr uint32_t kMaxBulkBufferSize = 32 * 1024;
-uint8_t BulkTransferBuffer[kMaxBulkBufferSize];
-
-struct UsbTransferMetadata {
-  SemaphoreHandle_t sema;
-  usb_status_t status;
-  size_t bytes_transferred;
-};
+// The USB stack cleans and invalidates the data cache over bulk transfer
+// buffers, so buffers received into must not share a cache line with
+// anything else. Buffers sent from only need to be word aligned.
+constexpr uintptr_t kCacheLineSize = 32;
+constexpr uintptr_t kBulkOutAlignment = 4;
+
+// Staging buffers for data that can't be transferred in place. One is
+// copied to or from while the other one is in flight.
+__attribute__((aligned(kCacheLineSize)))
+uint8_t BulkTransferBuffers[2][kMaxBulkBufferSize];
+
+// Checks if the USB controller can transfer to or from `data` directly.
+// DTCM, OCRAM and SDRAM are reachable by its DMA, but flash and ITCM aren't.
+bool IsDmaCapable(const void *data, uintptr_t alignment) {
+  struct MemoryRange {
+    uintptr_t start;
+    uintptr_t end;
+  };
+  constexpr MemoryRange kDmaRanges[] = {
+      {0x20000000, 0x20080000},  // DTCM
+      {0x20240000, 0x20340000},  // OCRAM1 and OCRAM2
+      {0x80000000, 0x90000000},  // SDRAM
+  };
+  const auto address = reinterpret_cast<uintptr_t>(data);
+  if (address % alignment != 0) return false;
+  for (const auto &range : kDmaRanges) {
+    if (address >= range.start && address < range.end) return true;
+  }
+  return false;
+}
 }  // namespace
 
 namespace registers = platforms::darwinn::driver::config::registers;
 
+TpuDriver::~TpuDriver() {
+  if (bulk_transfer_.sema != nullptr) {
+    vSemaphoreDelete(bulk_transfer_.sema);
+  }
+}
+
 bool TpuDriver::Initialize(usb_host_edgetpu_instance_t *usb_instance,
                            PerformanceMode mode) {
   if (usb_instance == nullptr) {
     return false;
   }
   usb_instance_ = usb_instance;
+  if (bulk_transfer_.sema == nullptr) {
+    bulk_transfer_.sema = xSemaphoreCreateBinary();
+    if (bulk_transfer_.sema == nullptr) {
+      return false;
+    }
+  }
 
   // Check chip id and test write
   uint32_t omc0_00_reg;
@@ -260,13 +296,13 @@ exit:
 }
 
 bool TpuDriver::SendData(DescriptorTag tag, const uint8_t *data,
-                         uint32_t length) const {
+                         uint32_t length, int sign_element_bytes) const {
   if (!WriteHeader(tag, length)) {
     printf("WriteHeader failed\r\n");
     return false;
   }
 
-  if (!BulkOutTransfer(data, length)) {
+  if (!BulkOutTransfer(data, length, sign_element_bytes)) {
     printf("BulkOutTransfer failed\r\n");
     return false;
   }
@@ -277,8 +313,10 @@ bool TpuDriver::SendParameters(const uint8_t *data, uint32_t length) const {
   return SendData(DescriptorTag::kParameters, data, length);
 }
 
-bool TpuDriver::SendInputs(const uint8_t *data, uint32_t length) const {
-  return SendData(DescriptorTag::kInputActivations, data, length);
+bool TpuDriver::SendInputs(const uint8_t *data, uint32_t length,
+                           int sign_element_bytes) const {
+  return SendData(DescriptorTag::kInputActivations, data, length,
+                  sign_element_bytes);
 }
 
 bool TpuDriver::SendInstructions(const uint8_t *data, uint32_t length) const {
@@ -305,118 +343,170 @@ bool TpuDriver::Write64(uint64_t reg, uint64_t val) {
   return CSRTransfer(reg, &val, false, RegisterSize::kRegSize64);
 }
 
-ssize_t TpuDriver::BulkOutTransferInternal(uint8_t endpoint,
-                                           const uint8_t *data,
-                                           uint32_t data_length) const {
-  UsbTransferMetadata meta;
-  meta.sema = xSemaphoreCreateBinary();
-  meta.status = kStatus_USB_Error;
+bool TpuDriver::StartBulkOut(const uint8_t *data,
+                             uint32_t data_length) const {
+  // Drop a completion left over from a transfer that timed out.
+  xSemaphoreTake(bulk_transfer_.sema, 0);
+  bulk_transfer_.status = kStatus_USB_Error;
+  bulk_transfer_.bytes_transferred = 0;
 
   usb_status_t bulk_status = USB_HostEdgeTpuBulkOutSend(
-      usb_instance_, endpoint, (uint8_t *)data, data_length,
+      usb_instance_, kSingleBulkOutEndpoint, const_cast<uint8_t *>(data),
+      data_length,
       [](void *param, uint8_t *data, uint32_t data_length,
          usb_status_t status) {
-        UsbTransferMetadata *meta = static_cast<UsbTransferMetadata *>(param);
-        meta->bytes_transferred = data_length;
-        meta->status = status;
-        xSemaphoreGive(meta->sema);
+        BulkTransfer *transfer = static_cast<BulkTransfer *>(param);
+        transfer->bytes_transferred = data_length;
+        transfer->status = status;
+        xSemaphoreGive(transfer->sema);
       },
-      &meta);
-
+      &bulk_transfer_);
   if (bulk_status != kStatus_USB_Success) {
     printf("USB_HostEdgeTpuBulkOutSend failed\r\n");
-    goto exit;
-  }
-
-  if (xSemaphoreTake(meta.sema, pdMS_TO_TICKS(200)) == pdFALSE) {
-    printf("%s didn't get semaphore\r\n", __func__);
-  };
-
-exit:
-  vSemaphoreDelete(meta.sema);
-
-  if (meta.status == kStatus_USB_Success) {
-    return meta.bytes_transferred;
-  } else {
-    return -meta.status;
-  }
-}
-
-bool TpuDriver::BulkOutTransfer(const uint8_t *data,
-                                uint32_t data_length) const {
-  uint8_t *current_chunk = const_cast<uint8_t *>(data);
-  uint32_t bytes_left = data_length;
-
-  while (bytes_left > 0) {
-    uint32_t chunk_size = std::min(kMaxBulkBufferSize, bytes_left);
-    memcpy(BulkTransferBuffer, current_chunk, chunk_size);
-    ssize_t bytes_sent = BulkOutTransferInternal(
-        kSingleBulkOutEndpoint, BulkTransferBuffer, chunk_size);
-    if (bytes_sent > 0) {
-      current_chunk += bytes_sent;
-      bytes_left -= bytes_sent;
-    } else {
-      printf("Bad BulkOutTransferInternal\r\n");
-      return false;
-    }
+    return false;
   }
-
   return true;
 }
 
-ssize_t TpuDriver::BulkInTransferInternal(uint8_t endpoint, uint8_t *data,
-                                          uint32_t data_length) const {
-  UsbTransferMetadata meta;
-  meta.sema = xSemaphoreCreateBinary();
-  meta.status = kStatus_USB_Error;
+bool TpuDriver::StartBulkIn(uint8_t *data, uint32_t data_length) const {
+  // Drop a completion left over from a transfer that timed out.
+  xSemaphoreTake(bulk_transfer_.sema, 0);
+  bulk_transfer_.status = kStatus_USB_Error;
+  bulk_transfer_.bytes_transferred = 0;
 
   usb_status_t bulk_status = USB_HostEdgeTpuBulkInRecv(
-      usb_instance_, endpoint, data, data_length,
+      usb_instance_, kSingleBulkOutEndpoint, data, data_length,
       [](void *param, uint8_t *data, uint32_t data_length,
          usb_status_t status) {
-        UsbTransferMetadata *meta = static_cast<UsbTransferMetadata *>(param);
-        meta->bytes_transferred = data_length;
-        meta->status = status;
-        xSemaphoreGive(meta->sema);
+        BulkTransfer *transfer = static_cast<BulkTransfer *>(param);
+        transfer->bytes_transferred = data_length;
+        transfer->status = status;
+        xSemaphoreGive(transfer->sema);
       },
-      &meta);
-
+      &bulk_transfer_);
   if (bulk_status != kStatus_USB_Success) {
     printf("USB_HostEdgeTpuBulkInRecv failed\r\n");
-    goto exit;
+    return false;
   }
+  return true;
+}
 
-  if (xSemaphoreTake(meta.sema, pdMS_TO_TICKS(200)) == pdFALSE) {
+ssize_t TpuDriver::WaitBulkTransfer() const {
+  if (xSemaphoreTake(bulk_transfer_.sema, pdMS_TO_TICKS(200)) == pdFALSE) {
     printf("%s didn't get semaphore\r\n", __func__);
+    return -kStatus_USB_Error;
+  }
+  if (bulk_transfer_.status != kStatus_USB_Success) {
+    return -bulk_transfer_.status;
+  }
+  return bulk_transfer_.bytes_transferred;
+}
+
+bool TpuDriver::BulkOutTransfer(const uint8_t *data, uint32_t data_length,
+                                int sign_element_bytes) const {
+  // Signed data is never sent in place: it is converted while staged.
+  auto stage = [sign_element_bytes](uint8_t *dest, const uint8_t *src,
+                                    uint32_t size) {
+    if (sign_element_bytes) {
+      CopyFlipSignBits(dest, src, size, sign_element_bytes);
+    } else {
+      memcpy(dest, src, size);
+    }
   };
 
-exit:
-  vSemaphoreDelete(meta.sema);
+  uint32_t bytes_left = data_length;
+  if (!sign_element_bytes && IsDmaCapable(data, kBulkOutAlignment)) {
+    while (bytes_left > 0) {
+      const uint32_t chunk_size = std::min(kMaxBulkBufferSize, bytes_left);
+      if (!StartBulkOut(data, chunk_size) ||
+          WaitBulkTransfer() != static_cast<ssize_t>(chunk_size)) {
+        printf("Bad bulk out transfer\r\n");
+        return false;
+      }
+      data += chunk_size;
+      bytes_left -= chunk_size;
+    }
+    return true;
+  }
+
+  int buffer = 0;
+  uint32_t chunk_size = std::min(kMaxBulkBufferSize, bytes_left);
+  stage(BulkTransferBuffers[buffer], data, chunk_size);
+  while (bytes_left > 0) {
+    if (!StartBulkOut(BulkTransferBuffers[buffer], chunk_size)) {
+      return false;
+    }
+    data += chunk_size;
+    bytes_left -= chunk_size;
+
+    // Stage the next chunk while this one is in flight.
+    const uint32_t next_chunk_size = std::min(kMaxBulkBufferSize, bytes_left);
+    stage(BulkTransferBuffers[buffer ^ 1], data, next_chunk_size);
 
-  if (meta.status == kStatus_USB_Success) {
-    return meta.bytes_transferred;
-  } else {
-    return -meta.status;
+    if (WaitBulkTransfer() != static_cast<ssize_t>(chunk_size)) {
+      printf("Bad bulk out transfer\r\n");
+      return false;
+    }
+    buffer ^= 1;
+    chunk_size = next_chunk_size;
   }
+  return true;
 }
 
 bool TpuDriver::BulkInTransfer(uint8_t *data, uint32_t data_length) const {
-  uint8_t *current_chunk = data;
   uint32_t bytes_left = data_length;
-  while (bytes_left > 0) {
-    uint32_t chunk_size = std::min(kMaxBulkBufferSize, bytes_left);
-    ssize_t bytes_received = BulkInTransferInternal(
-        kSingleBulkOutEndpoint, BulkTransferBuffer, chunk_size);
-    if (bytes_received > 0) {
-      memcpy(current_chunk, BulkTransferBuffer, chunk_size);
-      current_chunk += bytes_received;
+  if (IsDmaCapable(data, kCacheLineSize)) {
+    // Whole cache lines are received in place, the rest is staged.
+    while (bytes_left >= kCacheLineSize) {
+      const uint32_t chunk_size = std::min(
+          kMaxBulkBufferSize, bytes_left & ~(uint32_t)(kCacheLineSize - 1));
+      if (!StartBulkIn(data, chunk_size)) {
+        return false;
+      }
+      const ssize_t bytes_received = WaitBulkTransfer();
+      if (bytes_received <= 0) {
+        printf("Bad bulk in transfer\r\n");
+        return false;
+      }
+      data += bytes_received;
       bytes_left -= bytes_received;
-    } else {
-      printf("Bad BulkInTransferInternal\r\n");
+      if (bytes_received < static_cast<ssize_t>(chunk_size)) {
+        break;
+      }
+    }
+  }
+  if (bytes_left == 0) {
+    return true;
+  }
+
+  int buffer = 0;
+  if (!StartBulkIn(BulkTransferBuffers[buffer],
+                   std::min(kMaxBulkBufferSize, bytes_left))) {
+    return false;
+  }
+  while (true) {
+    const ssize_t bytes_received = WaitBulkTransfer();
+    if (bytes_received <= 0) {
+      printf("Bad bulk in transfer\r\n");
       return false;
     }
+    const uint8_t *received = BulkTransferBuffers[buffer];
+    bytes_left -= bytes_received;
+
+    // Receive the next chunk while this one is copied out.
+    if (bytes_left > 0) {
+      buffer ^= 1;
+      if (!StartBulkIn(BulkTransferBuffers[buffer],
+                       std::min(kMaxBulkBufferSize, bytes_left))) {
+        return false;
+      }
+    }
+    memcpy(data, received, bytes_received);
+    data += bytes_received;
+    if (bytes_left == 0) {
+      return true;
+    }
   }
-  return true;
 }
 
 std::vector<uint8_t> TpuDriver::PrepareHeader(DescriptorTag tag,
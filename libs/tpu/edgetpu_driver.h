@@ -23,6 +23,8 @@
 #include "libs/tpu/darwinn/driver/config/beagle/beagle_chip_config.h"
 #include "libs/tpu/darwinn/driver/hardware_structures.h"
 #include "libs/tpu/usb_host_edgetpu.h"
+#include "third_party/freertos_kernel/include/FreeRTOS.h"
+#include "third_party/freertos_kernel/include/semphr.h"
 
 namespace coralmicro {
 
@@ -48,12 +50,17 @@ enum class DescriptorTag {
 class TpuDriver {
  public:
   TpuDriver() = default;
+  ~TpuDriver();
   TpuDriver(const TpuDriver&) = delete;
   TpuDriver& operator=(const TpuDriver&) = delete;
   bool Initialize(usb_host_edgetpu_instance_t* usb_instance,
                   PerformanceMode mode);
   bool SendParameters(const uint8_t* data, uint32_t length) const;
-  bool SendInputs(const uint8_t* data, uint32_t length) const;
+  // Sends input activations. If `sign_element_bytes` isn't 0, flips the
+  // most significant bit of each element of that size while sending, to
+  // convert signed data for the Edge TPU.
+  bool SendInputs(const uint8_t* data, uint32_t length,
+                  int sign_element_bytes = 0) const;
   bool SendInstructions(const uint8_t* data, uint32_t length) const;
   bool GetOutputs(uint8_t* data, uint32_t length) const;
   bool ReadEvent() const;
@@ -65,14 +72,22 @@ class TpuDriver {
     kRegSize64,
   };
 
-  bool BulkOutTransfer(const uint8_t* data, uint32_t data_length) const;
-  ssize_t BulkOutTransferInternal(uint8_t endpoint, const uint8_t* data,
-                                  uint32_t data_length) const;
+  // The bulk transfer in flight. There is at most one at a time.
+  struct BulkTransfer {
+    SemaphoreHandle_t sema = nullptr;
+    usb_status_t status;
+    uint32_t bytes_transferred;
+  };
+
+  bool BulkOutTransfer(const uint8_t* data, uint32_t data_length,
+                       int sign_element_bytes = 0) const;
   bool BulkInTransfer(uint8_t* data, uint32_t data_length) const;
-  ssize_t BulkInTransferInternal(uint8_t endpoint, uint8_t* data,
-                                 uint32_t data_length) const;
+  bool StartBulkOut(const uint8_t* data, uint32_t data_length) const;
+  bool StartBulkIn(uint8_t* data, uint32_t data_length) const;
+  ssize_t WaitBulkTransfer() const;
 
-  bool SendData(DescriptorTag tag, const uint8_t* data, uint32_t length) const;
+  bool SendData(DescriptorTag tag, const uint8_t* data, uint32_t length,
+                int sign_element_bytes = 0) const;
   bool WriteHeader(DescriptorTag tag, uint32_t length) const;
   std::vector<uint8_t> PrepareHeader(DescriptorTag tag, uint32_t length) const;
 
@@ -85,6 +100,7 @@ class TpuDriver {
 
   platforms::darwinn::driver::config::BeagleChipConfig chip_config_;
   usb_host_edgetpu_instance_t* usb_instance_ = nullptr;
+  mutable BulkTransfer bulk_transfer_;
 };
 
 }  // namespace coralmicro
@@ -16,7 +16,9 @@
 
 #include "libs/tpu/edgetpu_executable.h"
 
+#include "libs/tpu/edgetpu_sign_conversion.h"
 #include "tensorflow/lite/micro/kernels/kernel_util.h"
+#include "tensorflow/lite/micro/memory_helpers.h"
 
 namespace {
 int TensorDataTypeSize(platforms::darwinn::DataType data_type) {
@@ -40,6 +42,37 @@ int TensorDataTypeSize(platforms::darwinn::DataType data_type) {
       return 0;
   }
 }
+
+// Copies runs of elements that are `stride` bytes apart in `src` and packed
+// in `dest`, flipping the sign bit of each `sign_element_bytes` value if it
+// is nonzero. A nonzero `kElementBytes` specializes the copy for elements of
+// that size, so the inner loop has no calls; such elements hold bytes.
+template <int kElementBytes, typename Span>
+void CopyStridedSpans(const std::vector<Span>& spans, int element_bytes,
+                      int stride, int sign_element_bytes, const uint8_t* src,
+                      uint8_t* dest) {
+  if (kElementBytes != 0) element_bytes = kElementBytes;
+  const uint8_t flip = sign_element_bytes ? 0x80 : 0;
+  for (const auto& span : spans) {
+    const uint8_t* source = src + span.src_offset;
+    uint8_t* target = dest + span.dst_offset;
+    uint8_t* const end = target + span.length;
+    for (; target != end; target += element_bytes, source += stride) {
+      if (kElementBytes == 1) {
+        *target = *source ^ flip;
+      } else if (kElementBytes == 3) {
+        *(target + 0) = *(source + 0) ^ flip;
+        *(target + 1) = *(source + 1) ^ flip;
+        *(target + 2) = *(source + 2) ^ flip;
+      } else if (sign_element_bytes) {
+        coralmicro::CopyFlipSignBits(target, source, element_bytes,
+                                     sign_element_bytes);
+      } else {
+        memcpy(target, source, element_bytes);
+      }
+    }
+  }
+}
 }  // namespace
 
 namespace coralmicro {
@@ -47,9 +80,31 @@ namespace coralmicro {
 EdgeTpuExecutable::EdgeTpuExecutable(const platforms::darwinn::Executable* exe)
     : executable_(exe) {
   if (executable_->output_layers()) {
-    for (const auto* output_layer : *(executable_->output_layers())) {
+    const auto* output_layers = executable_->output_layers();
+    for (int i = 0; i < static_cast<int>(output_layers->size()); ++i) {
+      const auto* output_layer = output_layers->Get(i);
       output_layers_[output_layer->name()->c_str()] =
-          new OutputLayer(output_layer);
+          new OutputLayer(output_layer, i);
+    }
+  }
+
+  // Inputs sent after the first output would have to be read from the node
+  // when the outputs are received.
+  bool seen_output = false;
+  for (const auto* hint : *executable_->dma_hints()->hints()) {
+    const auto* dma_hint = hint->any_hint_as_DmaDescriptorHint();
+    if (!dma_hint) {
+      continue;
+    }
+    switch (dma_hint->meta()->desc()) {
+      case platforms::darwinn::Description_BASE_ADDRESS_INPUT_ACTIVATION:
+        if (seen_output) can_submit_ = false;
+        break;
+      case platforms::darwinn::Description_BASE_ADDRESS_OUTPUT_ACTIVATION:
+        seen_output = true;
+        break;
+      default:
+        break;
     }
   }
 }
@@ -68,23 +123,47 @@ EdgeTpuExecutable::~EdgeTpuExecutable() {
     }                         \
   } while (0);
 
-TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
-                                       TfLiteContext* context,
-                                       TfLiteNode* node) {
+uint8_t* EdgeTpuExecutable::GetOutputDestination(TfLiteContext* context,
+                                                TfLiteNode* node,
+                                                OutputLayer* output_layer,
+                                                size_t size_bytes) {
+  if (!node || !output_layer->identity_layout()) {
+    return output_layer->output_buffer();
+  }
+  // Receive straight into the output tensor, there's nothing to relayout.
+  const TfLiteEvalTensor* output_tensor =
+      tflite::micro::GetEvalOutput(context, node, output_layer->index());
+  size_t tensor_bytes;
+  if (!output_tensor ||
+      tflite::TfLiteEvalTensorByteLength(output_tensor, &tensor_bytes) !=
+          kTfLiteOk ||
+      tensor_bytes < size_bytes) {
+    printf("Output tensor %d is too small\r\n", output_layer->index());
+    return nullptr;
+  }
+  return output_tensor->data.uint8;
+}
+
+TfLiteStatus EdgeTpuExecutable::RunDmaHints(const TpuDriver& tpu_driver,
+                                            TfLiteContext* context,
+                                            TfLiteNode* node,
+                                            bool stop_at_output) {
   const TfLiteEvalTensor* input_tensor =
-      tflite::micro::GetEvalInput(context, node, 0);
-  const int input_size = tflite::micro::GetTensorShape(input_tensor).FlatSize();
-  if (!input_tensor) {
+      node ? tflite::micro::GetEvalInput(context, node, 0) : nullptr;
+  if (node && !input_tensor) {
     return kTfLiteError;
   }
 
   const platforms::darwinn::DmaDescriptorHint* dma_hint;
   const char* name;
   uint8_t* output;
+  int sign_element_bytes;
   int32_t ins_idx;
   const flatbuffers::Vector<uint8_t>* bitstream;
 
-  for (const auto* hint : *(executable_->dma_hints()->hints())) {
+  const auto* hints = executable_->dma_hints()->hints();
+  for (; next_hint_ < static_cast<int>(hints->size()); ++next_hint_) {
+    const auto* hint = hints->Get(next_hint_);
     switch (hint->any_hint_type()) {
       case platforms::darwinn::AnyHint_DmaDescriptorHint:
         dma_hint = hint->any_hint_as_DmaDescriptorHint();
@@ -95,31 +174,42 @@ TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
                 dma_hint->size_in_bytes()));
             break;
           case platforms::darwinn::Description_BASE_ADDRESS_INPUT_ACTIVATION:
+            if (!input_tensor) {
+              printf("Input sent without a node\r\n");
+              return kTfLiteError;
+            }
             name = dma_hint->meta()->name()->c_str();
+            // Signed inputs are converted while they are sent, leaving the
+            // input tensor as it is.
+            sign_element_bytes = 0;
             if (executable_->input_layers()) {
               for (const auto* input_layer : *(executable_->input_layers())) {
-                if (!strcmp(input_layer->name()->c_str(), name)) {
-                  if (OutputLayer::SignedDataType(input_layer->data_type())) {
-                    OutputLayer::TransformSignedDataType(
-                        input_tensor->data.uint8, input_size,
-                        TensorDataTypeSize(input_layer->data_type()),
-                        input_layer->x_dim(), input_layer->y_dim(),
-                        input_layer->z_dim());
-                  }
+                if (!strcmp(input_layer->name()->c_str(), name) &&
+                    OutputLayer::SignedDataType(input_layer->data_type())) {
+                  sign_element_bytes =
+                      TensorDataTypeSize(input_layer->data_type());
                 }
               }
             }
             RETURN_IF_ERROR(tpu_driver.SendInputs(
                 input_tensor->data.uint8 + dma_hint->offset_in_bytes(),
-                dma_hint->size_in_bytes()));
+                dma_hint->size_in_bytes(), sign_element_bytes));
             break;
           case platforms::darwinn::Description_BASE_ADDRESS_OUTPUT_ACTIVATION:
+            if (stop_at_output) {
+              return kTfLiteOk;
+            }
             name = dma_hint->meta()->name()->c_str();
             if (output_layers_.find(name) == output_layers_.end()) {
               printf("Executable does not have output layer %s\r\n", name);
               break;
             }
-            output = output_layers_.at(name)->output_buffer();
+            output = GetOutputDestination(context, node,
+                                          output_layers_.at(name),
+                                          dma_hint->size_in_bytes());
+            if (!output) {
+              return kTfLiteError;
+            }
             RETURN_IF_ERROR(
                 tpu_driver.GetOutputs(output, dma_hint->size_in_bytes()));
             break;
@@ -139,9 +229,57 @@ TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
         break;
     }
   }
+  return kTfLiteOk;
+}
+
+TfLiteStatus EdgeTpuExecutable::Submit(const TpuDriver& tpu_driver,
+                                       TfLiteContext* context,
+                                       TfLiteNode* node) {
+  // The inference overwrites the output layer buffers.
+  received_node_ = nullptr;
+  next_hint_ = 0;
+  if (RunDmaHints(tpu_driver, context, node, /*stop_at_output=*/true) !=
+      kTfLiteOk) {
+    next_hint_ = 0;
+    return kTfLiteError;
+  }
+  return kTfLiteOk;
+}
+
+TfLiteStatus EdgeTpuExecutable::Wait(const TpuDriver& tpu_driver,
+                                     TfLiteContext* context, TfLiteNode* node) {
+  const TfLiteStatus status =
+      RunDmaHints(tpu_driver, context, node, /*stop_at_output=*/false);
+  next_hint_ = 0;
+  if (status != kTfLiteOk) {
+    return status;
+  }
 
   tpu_driver.ReadEvent();
+  return WriteOutputs(context, node, /*received=*/false);
+}
+
+TfLiteStatus EdgeTpuExecutable::Receive(const TpuDriver& tpu_driver,
+                                        const TfLiteNode* node) {
+  const TfLiteStatus status =
+      RunDmaHints(tpu_driver, nullptr, nullptr, /*stop_at_output=*/false);
+  next_hint_ = 0;
+  if (status != kTfLiteOk) {
+    return status;
+  }
+
+  tpu_driver.ReadEvent();
+  received_node_ = node;
+  return kTfLiteOk;
+}
+
+TfLiteStatus EdgeTpuExecutable::WriteReceivedOutputs(TfLiteContext* context,
+                                                     TfLiteNode* node) {
+  return WriteOutputs(context, node, /*received=*/true);
+}
 
+TfLiteStatus EdgeTpuExecutable::WriteOutputs(TfLiteContext* context,
+                                             TfLiteNode* node, bool received) {
   if (!output_layers_.empty()) {
     for (int i = 0; i < node->outputs->size; ++i) {
       const TfLiteEvalTensor* output_tensor =
@@ -151,22 +289,36 @@ TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
       if (!output_tensor) {
         return kTfLiteError;
       }
-      name = executable_->output_layers()->Get(i)->name()->c_str();
+      const char* name = executable_->output_layers()->Get(i)->name()->c_str();
       if (output_layers_.find(name) == output_layers_.end()) {
         printf("Executable does not have buffer for %s\r\n", name);
         return kTfLiteError;
       }
       OutputLayer* output_layer = output_layers_[name];
 
-      output_layer->Relayout(output_tensor->data.uint8);
-      output_layer->TransformSignedDataType(output_tensor->data.uint8,
-                                            output_size);
+      // Relayout() converts signed data as it copies, outputs received in
+      // place are converted in place.
+      if (received || !output_layer->identity_layout()) {
+        output_layer->Relayout(output_tensor->data.uint8);
+      } else {
+        output_layer->TransformSignedDataType(output_tensor->data.uint8,
+                                              output_size);
+      }
     }
   }
 
   return kTfLiteOk;
 }
 
+TfLiteStatus EdgeTpuExecutable::Invoke(const TpuDriver& tpu_driver,
+                                       TfLiteContext* context,
+                                       TfLiteNode* node) {
+  if (Submit(tpu_driver, context, node) != kTfLiteOk) {
+    return kTfLiteError;
+  }
+  return Wait(tpu_driver, context, node);
+}
+
 int OutputLayer::DataTypeSize() const {
   return TensorDataTypeSize(output_layer_->data_type());
 }
@@ -197,130 +349,143 @@ bool OutputLayer::SignedDataType(platforms::darwinn::DataType type) {
   return false;
 }
 
-void OutputLayer::Relayout(uint8_t* dest) const {
-  uint8_t* src = output_buffer_.get();
+OutputLayer::OutputLayer(const platforms::darwinn::Layer* layer, int index)
+    : output_layer_(layer),
+      index_(index),
+      sign_element_bytes_(SignedDataType() ? DataTypeSize() : 0) {
+  CompileRelayout();
+  identity_layout_ = spans_.empty() ||
+                     (spans_.size() == 1 && spans_[0].src_offset == 0 &&
+                      spans_[0].dst_offset == 0 &&
+                      element_bytes_ == element_stride_ &&
+                      static_cast<int>(spans_[0].length) == PaddedSizeBytes());
+  if (!identity_layout_) {
+    output_buffer_ = std::make_unique<uint8_t[]>(layer->size_bytes());
+  }
+}
+
+uint8_t* OutputLayer::output_buffer() {
+  if (!output_buffer_) {
+    // The identity span copies the whole padded output.
+    output_buffer_ = std::make_unique<uint8_t[]>(PaddedSizeBytes());
+  }
+  return output_buffer_.get();
+}
+
+void OutputLayer::AddCopySpan(uint32_t src_offset, uint32_t dst_offset,
+                              uint32_t length) {
+  if (!spans_.empty() && element_bytes_ == element_stride_) {
+    // Merge with the previous span if both are contiguous.
+    auto& last = spans_.back();
+    if (last.src_offset + last.length == src_offset &&
+        last.dst_offset + last.length == dst_offset) {
+      last.length += length;
+      return;
+    }
+  }
+  spans_.push_back({src_offset, dst_offset, length});
+}
+
+void OutputLayer::CompileRelayout() {
   const auto data_type_size = DataTypeSize();
   const int z_bytes = z_dim() * data_type_size;
 
   if (y_dim() == 1 && x_dim() == 1) {
     // One dimensional output (only z-dimension).
-    if (src != dest) {
-      const int padded_size_bytes = PaddedSizeBytes();
-      const int actual_size_bytes = ActualSizeBytes();
-      const int executions = execution_count_per_inference();
-      if (executions == 1 || padded_size_bytes == actual_size_bytes) {
-        memcpy(dest, src, z_bytes * executions);
-      } else {
-        // Remove padding values at the end of each execution.
-        const int padded_size_per_execution =
-            (padded_size_bytes - actual_size_bytes) / executions;
-        for (int i = 0; i < executions; ++i) {
-          memcpy(dest, src, z_bytes);
-          dest += z_bytes;
-          src += z_bytes + padded_size_per_execution;
-        }
+    const int padded_size_bytes = PaddedSizeBytes();
+    const int actual_size_bytes = ActualSizeBytes();
+    const int executions = execution_count_per_inference();
+    if (executions == 1 || padded_size_bytes == actual_size_bytes) {
+      AddCopySpan(0, 0, z_bytes * executions);
+    } else {
+      // Remove padding values at the end of each execution.
+      const int padded_size_per_execution =
+          (padded_size_bytes - actual_size_bytes) / executions;
+      for (int i = 0; i < executions; ++i) {
+        AddCopySpan(i * (z_bytes + padded_size_per_execution), i * z_bytes,
+                    z_bytes);
       }
     }
+    return;
+  }
+
+  int z_bytes_padded;
+  if (x_dim() > 1) {
+    // If x-dim is > 1, padded-z-size can be deduced by looking at
+    // difference between offset of element y=0,x=0,z=0 and y=0,x=1,z=0.
+    z_bytes_padded = GetBufferIndex(0, 1, 0) - GetBufferIndex(0, 0, 0);
   } else {
-    int z_bytes_padded;
-    if (x_dim() > 1) {
-      // If x-dim is > 1, padded-z-size can be deduced by looking at
-      // difference between offset of element y=0,x=0,z=0 and y=0,x=1,z=0.
-      z_bytes_padded = GetBufferIndex(0, 1, 0) - GetBufferIndex(0, 0, 0);
-    } else {
-      // Otherwise when x-dim is 1 (y-dim must be > 1 in that case),
-      // padded-z-size can be deduced by looking at difference between
-      // offset of element y=0,x=0,z=0 and y=1,x=0,z=0.
-      z_bytes_padded = GetBufferIndex(1, 0, 0) - GetBufferIndex(0, 0, 0);
+    // Otherwise when x-dim is 1 (y-dim must be > 1 in that case),
+    // padded-z-size can be deduced by looking at difference between
+    // offset of element y=0,x=0,z=0 and y=1,x=0,z=0.
+    z_bytes_padded = GetBufferIndex(1, 0, 0) - GetBufferIndex(0, 0, 0);
+  }
+  z_bytes_padded *= data_type_size;
+  // Grayscale and RGB outputs are always padded to 4 bytes.
+  if (z_bytes == 1 || z_bytes == 3) z_bytes_padded = 4;
+  element_bytes_ = z_bytes;
+  element_stride_ = z_bytes_padded;
+
+  // Splits the x coordinates into runs that belong to the same tile.
+  const auto* layout = output_layer_->any_layer_as_OutputLayer()->layout();
+  std::vector<int> active_tile_x_sizes;
+  int last_x = 0;
+  int last_x_tile = layout->x_coordinate_to_linear_tile_id_map()->Get(0);
+  for (int x = 1; x < x_dim(); ++x) {
+    int cur_x_tile = layout->x_coordinate_to_linear_tile_id_map()->Get(x);
+    if (cur_x_tile != last_x_tile) {
+      active_tile_x_sizes.push_back(x - last_x);
+      last_x_tile = cur_x_tile;
+      last_x = x;
     }
-    z_bytes_padded *= data_type_size;
-
-    const auto* layout = output_layer_->any_layer_as_OutputLayer()->layout();
-    int last_x = 0;
-    size_t active_tile_x_count = 0;
-
-    int last_x_tile = layout->x_coordinate_to_linear_tile_id_map()->Get(0);
+  }
+  active_tile_x_sizes.push_back(x_dim() - last_x);
+
+  uint32_t dst_offset = 0;
+  for (int y = 0; y < y_dim(); ++y) {
+    const auto y_buffer_index = GetYBufferIndex(y);
+    int tile_starting_x = 0;
+    for (const int tile_x_size : active_tile_x_sizes) {
+      const uint32_t length = tile_x_size * z_bytes;
+      AddCopySpan(
+          GetBufferIndex(y_buffer_index, tile_starting_x, 0) * data_type_size,
+          dst_offset, length);
+      dst_offset += length;
+      tile_starting_x += tile_x_size;
+    }
+  }
+}
 
-    for (int x = 1; x < x_dim(); ++x) {
-      int cur_x_tile = layout->x_coordinate_to_linear_tile_id_map()->Get(x);
-      if (cur_x_tile != last_x_tile) {
-        active_tile_x_sizes_[active_tile_x_count] = x - last_x;
-        active_tile_x_count++;
-        last_x_tile = cur_x_tile;
-        last_x = x;
+void OutputLayer::Relayout(uint8_t* dest) const {
+  const uint8_t* src = output_buffer_.get();
+  if (element_bytes_ == element_stride_) {
+    for (const auto& span : spans_) {
+      if (sign_element_bytes_) {
+        CopyFlipSignBits(dest + span.dst_offset, src + span.src_offset,
+                         span.length, sign_element_bytes_);
+      } else {
+        memcpy(dest + span.dst_offset, src + span.src_offset, span.length);
       }
     }
-    active_tile_x_sizes_[active_tile_x_count] = x_dim() - last_x;
-    active_tile_x_count++;
-
-    // When the num_z_bytes parameter is a compile-time constant, the
-    // conditions in the innermost loop will be replaced with a single
-    // optimized path, specialized for that value. Specialization is
-    // provided for num_z_bytes value of 1 and 3. We can also make this a
-    // helper function and still realize the benefits provided we have a
-    // guaranteed way of ensuring this function would be inlined so that the
-    // compiler optimizations based on compile-time-constants can kick in.
-#define RELAYOUT_WITH_Z_BYTES_SPECIALIZATION(num_z_bytes, num_z_bytes_padded) \
-  do {                                                                        \
-    for (int y = 0; y < y_dim(); ++y) {                                       \
-      const auto y_buffer_index = GetYBufferIndex(y);                         \
-      int tile_starting_x = 0;                                                \
-      for (size_t x_tile = 0; x_tile < active_tile_x_count; ++x_tile) {       \
-        const unsigned char* source =                                         \
-            src + GetBufferIndex(y_buffer_index, tile_starting_x, 0) *        \
-                      data_type_size;                                         \
-        const int tile_x_size = active_tile_x_sizes_[x_tile];                 \
-        for (int local_offset_x = 0; local_offset_x < tile_x_size;            \
-             ++local_offset_x) {                                              \
-          if ((num_z_bytes) == 1) {                                           \
-            *dest = *source;                                                  \
-          } else if ((num_z_bytes) == 3) {                                    \
-            *(dest + 0) = *(source + 0);                                      \
-            *(dest + 1) = *(source + 1);                                      \
-            *(dest + 2) = *(source + 2);                                      \
-          } else {                                                            \
-            memcpy(dest, source, (num_z_bytes));                              \
-          }                                                                   \
-          dest += (num_z_bytes);                                              \
-          source += (num_z_bytes_padded);                                     \
-        }                                                                     \
-        tile_starting_x += tile_x_size;                                       \
-      }                                                                       \
-    }                                                                         \
-  } while (0)
-
-    if (z_bytes == 1) {
-      // Specialization for z_bytes = 1 (grayscale image).
-      RELAYOUT_WITH_Z_BYTES_SPECIALIZATION(1, 4);
-    } else if (z_bytes == 3) {
-      // Specialization for z_bytes = 3 (RGB image).
-      RELAYOUT_WITH_Z_BYTES_SPECIALIZATION(3, 4);
-    } else {
-      // Default.
-      RELAYOUT_WITH_Z_BYTES_SPECIALIZATION(z_bytes, z_bytes_padded);
-    }
-
-#undef RELAYOUT_WITH_Z_BYTES_SPECIALIZATION
+  } else if (element_bytes_ == 1) {
+    // Specialization for z_bytes = 1 (grayscale image).
+    CopyStridedSpans<1>(spans_, element_bytes_, element_stride_,
+                        sign_element_bytes_, src, dest);
+  } else if (element_bytes_ == 3) {
+    // Specialization for z_bytes = 3 (RGB image).
+    CopyStridedSpans<3>(spans_, element_bytes_, element_stride_,
+                        sign_element_bytes_, src, dest);
+  } else {
+    CopyStridedSpans<0>(spans_, element_bytes_, element_stride_,
+                        sign_element_bytes_, src, dest);
   }
 }
 
 void OutputLayer::TransformSignedDataType(uint8_t* buffer, int buffer_size,
                                           int data_type_size, int x_dim,
                                           int y_dim, int z_dim) {
-  int buffer_index = 0;
-
-  for (int y = 0; y < y_dim; ++y) {
-    for (int x = 0; x < x_dim; ++x) {
-      for (int z = 0; z < z_dim; ++z) {
-        // XORing with 128 on the last byte of each entry will flip the
-        // MSB of each entry. Please note that bytes are stored little
-        // endian.
-        int msb_index = buffer_index + data_type_size - 1;
-        buffer[msb_index] = buffer[msb_index] ^ 128;
-        buffer_index += data_type_size;
-      }
-    }
-  }
+  FlipSignBits(buffer, x_dim * y_dim * z_dim * data_type_size,
+               data_type_size);
 }
 
 void OutputLayer::TransformSignedDataType(uint8_t* buffer,
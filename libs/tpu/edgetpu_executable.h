@@ -20,6 +20,8 @@
 #include <cstdlib>
 #include <cstring>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "libs/tpu/edgetpu_driver.h"
 #include "libs/tpu/executable_generated.h"
@@ -29,22 +31,40 @@ namespace coralmicro {
 
 class OutputLayer {
  public:
-  explicit OutputLayer(const platforms::darwinn::Layer* layer)
-      : output_layer_(layer),
-        output_buffer_(std::make_unique<uint8_t[]>(layer->size_bytes())),
-        active_tile_x_sizes_(std::make_unique<int[]>(x_dim())) {}
+  // @param layer The output layer description.
+  // @param index The index of the output tensor the layer is written to.
+  OutputLayer(const platforms::darwinn::Layer* layer, int index);
   OutputLayer(const OutputLayer&) = delete;
   OutputLayer& operator=(const OutputLayer&) = delete;
-  uint8_t* output_buffer() { return output_buffer_.get(); }
+  // Gets the buffer to receive the Edge TPU output in, for `Relayout()` to
+  // copy to the output tensor. Layers with an identity layout only allocate
+  // it when their output must be kept out of the tensor for a while.
+  uint8_t* output_buffer();
+  int index() const { return index_; }
+  // Checks if the Edge TPU output already has the tensor layout, so it can
+  // be received directly into the output tensor without `Relayout()`.
+  bool identity_layout() const { return identity_layout_; }
 
   static bool SignedDataType(platforms::darwinn::DataType type);
   static void TransformSignedDataType(uint8_t* buffer, int buffer_size,
                                       int data_type_size, int x_dim, int y_dim,
                                       int z_dim);
+  // Copies the output buffer to `dest` in the tensor layout, converting
+  // signed data as it goes.
   void Relayout(uint8_t* dest) const;
   void TransformSignedDataType(uint8_t* buffer, int buffer_size) const;
 
  private:
+  // A run of elements copied from `output_buffer_` to the output tensor.
+  // The elements are `element_stride_` bytes apart in the source and packed
+  // in the destination.
+  struct CopySpan {
+    uint32_t src_offset;
+    uint32_t dst_offset;
+    // The number of destination bytes.
+    uint32_t length;
+  };
+
   struct YBufferIndex {
     // Holds the linearized tile ID for a given y value.
     int y_linearized_tile_id;
@@ -54,6 +74,8 @@ class OutputLayer {
   YBufferIndex GetYBufferIndex(int y) const;
   int GetBufferIndex(int y, int x, int z) const;
   int GetBufferIndex(const YBufferIndex& y_buffer_index, int x, int z) const;
+  void AddCopySpan(uint32_t src_offset, uint32_t dst_offset, uint32_t length);
+  void CompileRelayout();
 
   int execution_count_per_inference() const {
     return output_layer_->execution_count_per_inference();
@@ -74,8 +96,18 @@ class OutputLayer {
   int z_dim() const { return output_layer_->z_dim(); }
 
   const platforms::darwinn::Layer* output_layer_;
+  int index_;
+  // The size of each signed value to convert, or 0 if the data is unsigned.
+  int sign_element_bytes_;
+  bool identity_layout_ = false;
+  // Allocated on first use if the layout is the identity.
   std::unique_ptr<uint8_t[]> output_buffer_;
-  std::unique_ptr<int[]> active_tile_x_sizes_;
+  // The copies that make up `Relayout()`, computed once from the layout.
+  std::vector<CopySpan> spans_;
+  // The bytes of each element, and the distance between elements in the
+  // source. Spans are plain copies if they are equal.
+  int element_bytes_ = 1;
+  int element_stride_ = 1;
 };
 
 class EdgeTpuExecutable {
@@ -85,15 +117,66 @@ class EdgeTpuExecutable {
   EdgeTpuExecutable(const EdgeTpuExecutable&) = delete;
   EdgeTpuExecutable& operator=(const EdgeTpuExecutable&) = delete;
 
+  // Runs the executable and writes its outputs to the node's output tensors.
   TfLiteStatus Invoke(const TpuDriver& tpu_driver, TfLiteContext* context,
                       TfLiteNode* node);
+  // Sends everything up to the first output, so the Edge TPU is running when
+  // this returns. Nothing else may use `tpu_driver` until `Wait()`.
+  TfLiteStatus Submit(const TpuDriver& tpu_driver, TfLiteContext* context,
+                      TfLiteNode* node);
+  // Receives the outputs of the last `Submit()` and writes them to the node's
+  // output tensors.
+  TfLiteStatus Wait(const TpuDriver& tpu_driver, TfLiteContext* context,
+                    TfLiteNode* node);
+  // Receives the outputs of the last `Submit()` into the executable's own
+  // buffers without touching the node, which may be in use by another task.
+  // `WriteReceivedOutputs()` writes them to the node's output tensors later.
+  //
+  // @param tpu_driver The driver the inference was submitted to.
+  // @param node The node the inference was submitted for.
+  TfLiteStatus Receive(const TpuDriver& tpu_driver, const TfLiteNode* node);
+  // Writes the outputs kept by `Receive()` to the node's output tensors. They
+  // stay kept until `DropReceivedOutputs()` or the next `Submit()`.
+  TfLiteStatus WriteReceivedOutputs(TfLiteContext* context, TfLiteNode* node);
+  // Checks if `Receive()` kept outputs for `node` that are not written yet.
+  bool HasReceivedOutputs(const TfLiteNode* node) const {
+    return node && received_node_ == node;
+  }
+  // Forgets the outputs kept by `Receive()`.
+  void DropReceivedOutputs() { received_node_ = nullptr; }
+  // Checks if all inputs are sent before the first output is received, so
+  // `Submit()` leaves nothing for `Receive()` to read from the node.
+  bool CanSubmit() const { return can_submit_; }
 
   uint64_t ParameterCachingToken() const {
     return executable_->parameter_caching_token();
   }
 
+  size_t ParameterSizeBytes() const {
+    return executable_->parameters() ? executable_->parameters()->size() : 0;
+  }
+
  private:
+  // Gets where to receive the output of a layer: its output tensor if the
+  // layout is the identity, or else its buffer for `Relayout()`.
+  uint8_t* GetOutputDestination(TfLiteContext* context, TfLiteNode* node,
+                                OutputLayer* output_layer, size_t size_bytes);
+  // Runs the DMA hints from `next_hint_` on, stopping before the first
+  // output if `stop_at_output` is set. Receives the outputs into the output
+  // layer buffers if `node` is null.
+  TfLiteStatus RunDmaHints(const TpuDriver& tpu_driver, TfLiteContext* context,
+                           TfLiteNode* node, bool stop_at_output);
+  // Writes the received outputs to the node's output tensors, from the
+  // output layer buffers only if `received` is set.
+  TfLiteStatus WriteOutputs(TfLiteContext* context, TfLiteNode* node,
+                            bool received);
+
   const platforms::darwinn::Executable* executable_;
+  // The next DMA hint to run between `Submit()` and `Wait()`.
+  int next_hint_ = 0;
+  bool can_submit_ = true;
+  // The node whose outputs `Receive()` kept in the output layer buffers.
+  const TfLiteNode* received_node_ = nullptr;
 
   struct Less {
     bool operator()(const char* a, const char* b) const {
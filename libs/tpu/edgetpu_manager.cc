@@ -53,7 +53,8 @@ void EdgeTpuManager::NotifyConnected(
 
   // The EdgeTPU has left the USB bus -- clean up state.
   if (!usb_instance_) {
-    current_parameter_caching_token_ = 0;
+    parameter_cache_.Invalidate();
+    pending_ = {};
   }
 }
 
@@ -163,31 +164,158 @@ EdgeTpuPackage* EdgeTpuManager::RegisterPackage(const char* package_content,
   return edgetpu_package;
 }
 
+TfLiteStatus EdgeTpuManager::CacheParameters(EdgeTpuPackage* package,
+                                             TfLiteContext* context,
+                                             TfLiteNode* node,
+                                             bool* uploaded) {
+  auto* caching_exe = package->parameter_caching_exe();
+  *uploaded = false;
+  if (!caching_exe) {
+    // Without parameter caching, the parameters are sent with every invoke
+    // and overwrite whatever was cached.
+    parameter_cache_.Invalidate();
+  } else if (parameter_cache_.Acquire(package,
+                                      caching_exe->ParameterCachingToken(),
+                                      caching_exe->ParameterSizeBytes())) {
+    if (caching_exe->Invoke(tpu_driver_, context, node) != kTfLiteOk) {
+      parameter_cache_.Remove(package);
+      return kTfLiteError;
+    }
+    parameter_cache_.AddUploadedBytes(caching_exe->ParameterSizeBytes());
+    *uploaded = true;
+  }
+  return kTfLiteOk;
+}
+
+void EdgeTpuManager::CountInvoke(EdgeTpuPackage* package, bool uploaded) {
+  parameter_cache_.AddUploadedBytes(
+      package->inference_exe()->ParameterSizeBytes());
+  if (package->parameter_caching_exe()) {
+    parameter_cache_.CountInvoke(uploaded);
+  }
+}
+
+TfLiteStatus EdgeTpuManager::FinishPendingInvoke() {
+  if (!pending_.package) return kTfLiteOk;
+  PendingInvoke pending = pending_;
+  pending_ = {};
+  return pending.package->inference_exe()->Receive(tpu_driver_, pending.node);
+}
+
+TfLiteStatus EdgeTpuManager::RunInvoke(EdgeTpuPackage* package,
+                                       TfLiteContext* context,
+                                       TfLiteNode* node) {
+  if (FinishPendingInvoke() != kTfLiteOk) {
+    printf("%s: Submitted inference failed\r\n", __func__);
+  }
+  auto* exe = package->inference_exe();
+  bool uploaded;
+  if (CacheParameters(package, context, node, &uploaded) != kTfLiteOk ||
+      exe->Invoke(tpu_driver_, context, node) != kTfLiteOk) {
+    return kTfLiteError;
+  }
+  CountInvoke(package, uploaded);
+  return kTfLiteOk;
+}
+
 TfLiteStatus EdgeTpuManager::Invoke(EdgeTpuPackage* package,
                                     TfLiteContext* context, TfLiteNode* node) {
   MutexLock lock(mutex_);
-  if (package->parameter_caching_exe()) {
-    auto token = package->parameter_caching_exe()->ParameterCachingToken();
-    if (token != current_parameter_caching_token_) {
-      cached_packages_.fill(nullptr);
-      package->parameter_caching_exe()->Invoke(tpu_driver_, context, node);
-      current_parameter_caching_token_ = token;
-      cached_packages_[0] = package;
-    } else {
-      for (auto& cached_package : cached_packages_) {
-        if (cached_package == package) {
-          break;
-        } else if (cached_package == nullptr) {
-          package->parameter_caching_exe()->Invoke(tpu_driver_, context, node);
-          cached_package = package;
-        }
-      }
+  return RunInvoke(package, context, node);
+}
+
+TfLiteStatus EdgeTpuManager::SubmitInvoke(EdgeTpuPackage* package,
+                                          TfLiteContext* context,
+                                          TfLiteNode* node) {
+  auto* exe = package->inference_exe();
+  // Without all inputs sent up front, the inference can't run unattended.
+  if (!exe->CanSubmit()) return RunInvoke(package, context, node);
+
+  if (FinishPendingInvoke() != kTfLiteOk) {
+    printf("%s: Submitted inference failed\r\n", __func__);
+  }
+  bool uploaded;
+  if (CacheParameters(package, context, node, &uploaded) != kTfLiteOk ||
+      exe->Submit(tpu_driver_, context, node) != kTfLiteOk) {
+    return kTfLiteError;
+  }
+  CountInvoke(package, uploaded);
+  pending_ = {package, node};
+  return kTfLiteOk;
+}
+
+bool EdgeTpuManager::HasOutputs(EdgeTpuPackage* package,
+                                const TfLiteNode* node) const {
+  return (pending_.package == package && pending_.node == node) ||
+         package->inference_exe()->HasReceivedOutputs(node);
+}
+
+TfLiteStatus EdgeTpuManager::WaitInvoke(EdgeTpuPackage* package,
+                                        TfLiteContext* context,
+                                        TfLiteNode* node) {
+  auto* exe = package->inference_exe();
+  if (pending_.package == package && pending_.node == node) {
+    pending_ = {};
+    return exe->Wait(tpu_driver_, context, node);
+  }
+  // Another invoke finished this node's inference first, or there is none.
+  if (!exe->HasReceivedOutputs(node)) return kTfLiteOk;
+  const TfLiteStatus status = exe->WriteReceivedOutputs(context, node);
+  exe->DropReceivedOutputs();
+  return status;
+}
+
+TfLiteStatus EdgeTpuManager::Submit(EdgeTpuPackage* package,
+                                    TfLiteContext* context, TfLiteNode* node) {
+  MutexLock lock(mutex_);
+  return SubmitInvoke(package, context, node);
+}
+
+TfLiteStatus EdgeTpuManager::Wait(EdgeTpuPackage* package,
+                                  TfLiteContext* context, TfLiteNode* node) {
+  MutexLock lock(mutex_);
+  return WaitInvoke(package, context, node);
+}
+
+TfLiteStatus EdgeTpuManager::InvokePipelined(EdgeTpuPackage* package,
+                                             TfLiteContext* context,
+                                             TfLiteNode* node) {
+  MutexLock lock(mutex_);
+  auto* exe = package->inference_exe();
+  if (!exe->CanSubmit()) return RunInvoke(package, context, node);
+
+  if (!HasOutputs(package, node)) {
+    // This is the first invoke, or another interpreter running the same
+    // package overwrote this node's outputs. Runs the input once and keeps
+    // its outputs, so the next invoke has results to write before it submits
+    // its own input.
+    if (SubmitInvoke(package, context, node) != kTfLiteOk) {
+      return kTfLiteError;
     }
-  } else {
-    current_parameter_caching_token_ = 0;
+    pending_ = {};
+    if (exe->Receive(tpu_driver_, node) != kTfLiteOk) {
+      return kTfLiteError;
+    }
+    return exe->WriteReceivedOutputs(context, node);
   }
 
-  return package->inference_exe()->Invoke(tpu_driver_, context, node);
+  if (WaitInvoke(package, context, node) != kTfLiteOk) {
+    return kTfLiteError;
+  }
+  return SubmitInvoke(package, context, node);
+}
+
+void EdgeTpuManager::ReleasePackage(EdgeTpuPackage* package) {
+  MutexLock lock(mutex_);
+  if (pending_.package == package && FinishPendingInvoke() != kTfLiteOk) {
+    printf("%s: Submitted inference failed\r\n", __func__);
+  }
+  package->inference_exe()->DropReceivedOutputs();
+}
+
+TfLiteStatus EdgeTpuManager::Finish() {
+  MutexLock lock(mutex_);
+  return FinishPendingInvoke();
 }
 
 std::optional<float> EdgeTpuManager::GetTemperature() {
@@ -198,4 +326,14 @@ std::optional<float> EdgeTpuManager::GetTemperature() {
   return std::nullopt;
 }
 
+EdgeTpuParameterCacheStats EdgeTpuManager::GetParameterCacheStats() {
+  MutexLock lock(mutex_);
+  return parameter_cache_.stats();
+}
+
+void EdgeTpuManager::ResetParameterCacheStats() {
+  MutexLock lock(mutex_);
+  parameter_cache_.ResetStats();
+}
+
 }  // namespace coralmicro
@@ -24,6 +24,7 @@
 
 #include "libs/tpu/edgetpu_driver.h"
 #include "libs/tpu/edgetpu_executable.h"
+#include "libs/tpu/edgetpu_parameter_cache.h"
 #include "libs/tpu/executable_generated.h"
 #include "libs/tpu/usb_host_edgetpu.h"
 #include "third_party/freertos_kernel/include/FreeRTOS.h"
@@ -93,8 +94,59 @@ class EdgeTpuManager {
   EdgeTpuPackage* RegisterPackage(const char* package_content, size_t length);
   TfLiteStatus Invoke(EdgeTpuPackage* package, TfLiteContext* context,
                       TfLiteNode* node);
+  // Runs a pipelined Edge TPU op: writes the outputs of the node's previous
+  // inference to its output tensors and starts an inference on the current
+  // input. If the node has no previous inference, it runs the current input
+  // and keeps its outputs to write again on the next call.
+  TfLiteStatus InvokePipelined(EdgeTpuPackage* package, TfLiteContext* context,
+                               TfLiteNode* node);
+  // Finishes the inference of a pipelined op and forgets it and its outputs,
+  // for when the interpreter that invoked the package goes away.
+  void ReleasePackage(EdgeTpuPackage* package);
   // @endcond
 
+  // Starts an inference of an Edge TPU op on the current contents of its
+  // input tensor. This returns once the input is sent, so the CPU can work
+  // while the Edge TPU runs; get the outputs with `Wait()`.
+  //
+  // The input tensor may be overwritten as soon as this returns. The output
+  // tensors are not touched until `Wait()`. If another inference is running,
+  // this first finishes it and keeps its outputs for its own `Wait()`. If
+  // the model doesn't send all its inputs before its first output, this runs
+  // the whole inference and writes the outputs, and `Wait()` has nothing to
+  // do.
+  //
+  // @param package The Edge TPU package of the op, from the node's
+  // `user_data`.
+  // @param context The interpreter context.
+  // @param node The Edge TPU op node.
+  // @return The status of sending the input.
+  TfLiteStatus Submit(EdgeTpuPackage* package, TfLiteContext* context,
+                      TfLiteNode* node);
+
+  // Waits for the inference started by `Submit()` for the node and writes its
+  // outputs to the node's output tensors.
+  //
+  // The outputs of a package are kept for one node at a time, so submitting
+  // the same package for another node before this loses them, and this then
+  // leaves the output tensors as they are.
+  //
+  // @param package The Edge TPU package of the op, from the node's
+  // `user_data`.
+  // @param context The interpreter context.
+  // @param node The Edge TPU op node given to `Submit()`.
+  // @return The status of the inference.
+  TfLiteStatus Wait(EdgeTpuPackage* package, TfLiteContext* context,
+                    TfLiteNode* node);
+
+  // Waits for the inference running on the Edge TPU, if any, so the Edge TPU
+  // is idle. The outputs are kept for whoever started it: `Wait()` or the
+  // next `Invoke()` of a pipelined op (see `RegisterPipelinedCustomOp()`)
+  // writes them to the output tensors.
+  //
+  // @return The status of the inference.
+  TfLiteStatus Finish();
+
   // Gets the default Edge TPU device (and starts it if necessary).
   //
   // The Edge TPU device (represented by `EdgeTpuContext`) can be shared among
@@ -127,11 +179,45 @@ class EdgeTpuManager {
   // `EdgeTpuContext` is empty.
   std::optional<float> GetTemperature();
 
+  // Gets the counters for the model parameters cached on the Edge TPU.
+  //
+  // Models compiled together (with the same parameter caching token) can stay
+  // cached together. Invoking a model compiled separately uploads its
+  // parameters again and drops the parameters of the other models.
+  //
+  // @return The parameter cache counters since the last
+  // `ResetParameterCacheStats()`.
+  EdgeTpuParameterCacheStats GetParameterCacheStats();
+
+  // Resets the parameter cache counters to zero.
+  void ResetParameterCacheStats();
+
  private:
+  // The inference running on the Edge TPU. The node is only compared, its
+  // outputs are received into the executable and written by its own invoke.
+  struct PendingInvoke {
+    EdgeTpuPackage* package = nullptr;
+    const TfLiteNode* node = nullptr;
+  };
+
+  TfLiteStatus CacheParameters(EdgeTpuPackage* package,
+                               TfLiteContext* context, TfLiteNode* node,
+                               bool* uploaded);
+  void CountInvoke(EdgeTpuPackage* package, bool uploaded);
+  TfLiteStatus FinishPendingInvoke();
+  TfLiteStatus RunInvoke(EdgeTpuPackage* package, TfLiteContext* context,
+                         TfLiteNode* node);
+  TfLiteStatus SubmitInvoke(EdgeTpuPackage* package, TfLiteContext* context,
+                            TfLiteNode* node);
+  TfLiteStatus WaitInvoke(EdgeTpuPackage* package, TfLiteContext* context,
+                          TfLiteNode* node);
+  // Checks if `WaitInvoke()` has outputs to write for the node.
+  bool HasOutputs(EdgeTpuPackage* package, const TfLiteNode* node) const;
+
   TpuDriver tpu_driver_;
   std::map<uintptr_t, EdgeTpuPackage*> packages_;
-  std::array<EdgeTpuPackage*, 2> cached_packages_;
-  uint64_t current_parameter_caching_token_ = 0;
+  EdgeTpuParameterCache parameter_cache_;
+  PendingInvoke pending_;
   usb_host_edgetpu_instance_t* usb_instance_ = nullptr;
   std::weak_ptr<EdgeTpuContext> context_;
   SemaphoreHandle_t mutex_;
@@ -25,7 +25,11 @@ void* CustomOpInit(TfLiteContext* context, const char* buffer, size_t length) {
   return EdgeTpuManager::GetSingleton()->RegisterPackage(buffer, length);
 }
 
-void CustomOpFree(TfLiteContext* context, void* buffer) {}
+void CustomOpFree(TfLiteContext* context, void* buffer) {
+  if (buffer == nullptr) return;
+  EdgeTpuManager::GetSingleton()->ReleasePackage(
+      static_cast<EdgeTpuPackage*>(buffer));
+}
 
 TfLiteStatus CustomOpPrepare(TfLiteContext* context, TfLiteNode* node) {
   if (node->user_data == nullptr) return kTfLiteError;
@@ -36,6 +40,12 @@ TfLiteStatus CustomOpInvoke(TfLiteContext* context, TfLiteNode* node) {
   EdgeTpuPackage* package = static_cast<EdgeTpuPackage*>(node->user_data);
   return EdgeTpuManager::GetSingleton()->Invoke(package, context, node);
 }
+
+TfLiteStatus PipelinedCustomOpInvoke(TfLiteContext* context, TfLiteNode* node) {
+  EdgeTpuPackage* package = static_cast<EdgeTpuPackage*>(node->user_data);
+  return EdgeTpuManager::GetSingleton()->InvokePipelined(package, context,
+                                                         node);
+}
 }  // namespace
 
 TfLiteRegistration* RegisterCustomOp() {
@@ -47,4 +57,14 @@ TfLiteRegistration* RegisterCustomOp() {
   };
   return &registration;
 }
+
+TfLiteRegistration* RegisterPipelinedCustomOp() {
+  static TfLiteRegistration registration = {
+      CustomOpInit,
+      CustomOpFree,
+      CustomOpPrepare,
+      PipelinedCustomOpInvoke,
+  };
+  return &registration;
+}
 }  // namespace coralmicro
@@ -30,6 +30,30 @@ inline constexpr char kCustomOp[] = "edgetpu-custom-op";
 // `tflite::MicroMutableOpResolver::AddCustom()`.
 TfLiteRegistration* RegisterCustomOp();
 
+// Returns pointer to an instance of `tflite::TfLiteRegistration` to handle
+// Edge TPU custom ops with pipelining. Pass this to
+// `tflite::MicroMutableOpResolver::AddCustom()` instead of
+// `RegisterCustomOp()`.
+//
+// Each `Invoke()` of the interpreter gets the Edge TPU outputs of the
+// previous `Invoke()` and starts the Edge TPU on the current input, so the
+// results lag one frame behind the input. In return, the Edge TPU runs the
+// new input while the CPU runs the rest of the model and your own code, such
+// as post-processing the results and preparing the next input. The first
+// `Invoke()` has no previous input, so it runs its own input and returns its
+// results, and the second `Invoke()` returns the same results again.
+//
+// The op writes its output tensors only during its own `Invoke()`, even if
+// other interpreters use the Edge TPU in between. So the results of the last
+// input reach the model outputs only with one more `Invoke()`;
+// `EdgeTpuManager::Finish()` lets the Edge TPU finish that input and keeps
+// its results for that `Invoke()`. Models whose inputs are not all sent
+// before their first output run like `RegisterCustomOp()`, without lag.
+//
+// To run the Edge TPU without the lag, call `EdgeTpuManager::Submit()` and
+// `EdgeTpuManager::Wait()` from your own op instead.
+TfLiteRegistration* RegisterPipelinedCustomOp();
+
 }  // namespace coralmicro
 
 #endif  // LIBS_TPU_EDGETPU_OP_H_
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/tpu/edgetpu_parameter_cache.h"
+
+#include <algorithm>
+
+namespace coralmicro {
+
+bool EdgeTpuParameterCache::Acquire(const void* key, uint64_t token,
+                                    size_t size_bytes) {
+  auto it =
+      std::find_if(entries_.begin(), entries_.end(),
+                   [key](const Entry& entry) { return entry.key == key; });
+  if (it != entries_.end() && it->token == token) {
+    std::rotate(it, it + 1, entries_.end());
+    return false;
+  }
+  if (it != entries_.end()) Remove(key);
+
+  if (!entries_.empty() && entries_.front().token != token) Invalidate();
+
+  size_t evicted = 0;
+  while (evicted < entries_.size() &&
+         used_bytes_ + size_bytes > capacity_bytes_) {
+    used_bytes_ -= entries_[evicted++].size_bytes;
+  }
+  entries_.erase(entries_.begin(), entries_.begin() + evicted);
+  stats_.evictions += evicted;
+
+  entries_.push_back({key, token, size_bytes});
+  used_bytes_ += size_bytes;
+  return true;
+}
+
+void EdgeTpuParameterCache::Remove(const void* key) {
+  auto it =
+      std::find_if(entries_.begin(), entries_.end(),
+                   [key](const Entry& entry) { return entry.key == key; });
+  if (it == entries_.end()) return;
+  used_bytes_ -= it->size_bytes;
+  entries_.erase(it);
+}
+
+void EdgeTpuParameterCache::Invalidate() {
+  stats_.evictions += entries_.size();
+  entries_.clear();
+  used_bytes_ = 0;
+}
+
+}  // namespace coralmicro
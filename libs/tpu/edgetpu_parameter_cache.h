@@ -0,0 +1,121 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_TPU_EDGETPU_PARAMETER_CACHE_H_
+#define LIBS_TPU_EDGETPU_PARAMETER_CACHE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace coralmicro {
+
+// Counters for the parameters cached on the Edge TPU. Get them with
+// `EdgeTpuManager::GetParameterCacheStats()`.
+struct EdgeTpuParameterCacheStats {
+  // The number of invokes that found their parameters on the Edge TPU.
+  uint32_t hits;
+  // The number of invokes that uploaded their parameters first.
+  uint32_t misses;
+  // The number of models whose cached parameters were dropped.
+  uint32_t evictions;
+  // The parameter bytes sent to the Edge TPU, including the parameters that
+  // models compiled without parameter caching send on every invoke.
+  uint64_t bytes_uploaded;
+};
+
+// @cond Do not generate docs
+// Tracks which models have their parameters in the Edge TPU memory.
+//
+// Models compiled together share a parameter caching token and are placed
+// in separate parts of the Edge TPU memory, so they stay cached together as
+// long as they fit. Models compiled separately have different tokens and
+// all use the same memory, so caching a model with another token drops all
+// cached models.
+class EdgeTpuParameterCache {
+ public:
+  // The Edge TPU memory for parameters.
+  static constexpr size_t kDefaultCapacityBytes = 8 * 1024 * 1024;
+
+  explicit EdgeTpuParameterCache(size_t capacity_bytes = kDefaultCapacityBytes)
+      : capacity_bytes_(capacity_bytes) {}
+  EdgeTpuParameterCache(const EdgeTpuParameterCache&) = delete;
+  EdgeTpuParameterCache& operator=(const EdgeTpuParameterCache&) = delete;
+
+  // Marks the parameters of a model as the most recently used, and makes
+  // room for them if they aren't cached, dropping the least recently used
+  // models first. If the parameters must be uploaded, call `Remove()` if the
+  // upload fails. This counts nothing; see `CountInvoke()`.
+  //
+  // @param key Identifies the model.
+  // @param token The parameter caching token of the model.
+  // @param size_bytes The size of the parameters of the model.
+  // @return True if the caller must upload the parameters.
+  bool Acquire(const void* key, uint64_t token, size_t size_bytes);
+
+  // Counts a successful invoke of a model with cached parameters as a hit or
+  // a miss. Call it once the inference succeeds.
+  //
+  // @param uploaded Whether `Acquire()` asked to upload the parameters.
+  void CountInvoke(bool uploaded) {
+    if (uploaded) {
+      ++stats_.misses;
+    } else {
+      ++stats_.hits;
+    }
+  }
+
+  // Drops the parameters of a model, for example after a failed upload.
+  //
+  // @param key Identifies the model.
+  void Remove(const void* key);
+
+  // Drops all cached parameters, for example after a model without
+  // parameter caching overwrote them, or when the Edge TPU powers down.
+  void Invalidate();
+
+  // Counts parameters sent to the Edge TPU, either to cache them or with an
+  // invoke.
+  //
+  // @param size_bytes The number of bytes uploaded.
+  void AddUploadedBytes(size_t size_bytes) {
+    stats_.bytes_uploaded += size_bytes;
+  }
+
+  // Gets the bytes of parameters currently cached.
+  size_t used_bytes() const { return used_bytes_; }
+
+  const EdgeTpuParameterCacheStats& stats() const { return stats_; }
+  void ResetStats() { stats_ = {}; }
+
+ private:
+  struct Entry {
+    const void* key;
+    uint64_t token;
+    size_t size_bytes;
+  };
+
+  size_t capacity_bytes_;
+  size_t used_bytes_ = 0;
+  // Ordered from least to most recently used.
+  std::vector<Entry> entries_;
+  EdgeTpuParameterCacheStats stats_{};
+};
+// @endcond
+
+}  // namespace coralmicro
+
+#endif  // LIBS_TPU_EDGETPU_PARAMETER_CACHE_H_
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "libs/tpu/edgetpu_sign_conversion.h"
+
+#include <cstring>
+
+namespace coralmicro {
+namespace {
+// The most significant bit of every element in a little-endian word.
+uint32_t SignMask(int element_bytes) {
+  switch (element_bytes) {
+    case 1:
+      return 0x80808080;
+    case 2:
+      return 0x80008000;
+    case 4:
+      return 0x80000000;
+    default:
+      return 0;
+  }
+}
+}  // namespace
+
+void CopyFlipSignBits(uint8_t* dest, const uint8_t* src, size_t size,
+                      int element_bytes) {
+  const uint32_t mask = SignMask(element_bytes);
+  size_t i = 0;
+  // Words start at element boundaries because elements divide the word
+  // size. memcpy() compiles to single loads and stores, unaligned or not.
+  if (mask != 0) {
+    for (; i + 4 * sizeof(uint32_t) <= size; i += 4 * sizeof(uint32_t)) {
+      uint32_t words[4];
+      std::memcpy(words, src + i, sizeof(words));
+      words[0] ^= mask;
+      words[1] ^= mask;
+      words[2] ^= mask;
+      words[3] ^= mask;
+      std::memcpy(dest + i, words, sizeof(words));
+    }
+    for (; i + sizeof(uint32_t) <= size; i += sizeof(uint32_t)) {
+      uint32_t word;
+      std::memcpy(&word, src + i, sizeof(word));
+      word ^= mask;
+      std::memcpy(dest + i, &word, sizeof(word));
+    }
+  }
+  const size_t bytes = element_bytes;
+  for (; i < size; ++i) {
+    const bool msb = i % bytes == bytes - 1;
+    dest[i] = src[i] ^ (msb ? 0x80 : 0);
+  }
+}
+
+}  // namespace coralmicro
@@ -0,0 +1,48 @@
+/*
+ * Copyright 2022 Google LLC
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LIBS_TPU_EDGETPU_SIGN_CONVERSION_H_
+#define LIBS_TPU_EDGETPU_SIGN_CONVERSION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace coralmicro {
+
+// Copies little-endian elements and flips the most significant bit of each,
+// which converts between signed data and the unsigned data of the Edge TPU.
+// Works a word at a time. `dest` may be the same as `src`, but the buffers
+// must not overlap otherwise.
+//
+// @param dest The destination buffer.
+// @param src The source buffer, starting at an element boundary.
+// @param size The number of bytes to copy.
+// @param element_bytes The size of each element: 1, 2 or 4 bytes.
+void CopyFlipSignBits(uint8_t* dest, const uint8_t* src, size_t size,
+                      int element_bytes);
+
+// Flips the most significant bit of each little-endian element in place.
+//
+// @param buffer The buffer, starting at an element boundary.
+// @param size The number of bytes to convert.
+// @param element_bytes The size of each element: 1, 2 or 4 bytes.
+inline void FlipSignBits(uint8_t* buffer, size_t size, int element_bytes) {
+  CopyFlipSignBits(buffer, buffer, size, element_bytes);
+}
+
+}  // namespace coralmicro
+
+#endif  // LIBS_TPU_EDGETPU_SIGN_CONVERSION_H_